@@ -0,0 +1,435 @@
+/*
+ * arch/arm/crypto/aes-neon-core.c
+ *
+ * AES block processing using NEON, byte sliced.
+ *
+ * The state of each block lives in one q register. SubBytes is done with
+ * vtbl/vtbx lookups over the S-box held 32 bytes at a time, so there are
+ * no data dependent memory accesses; ShiftRows is a vtbl permutation and
+ * MixColumns is done on 32-bit lanes with shifts and xtime. Up to four
+ * blocks are processed in parallel, which lets each S-box slice that is
+ * loaded be used for all of them and hides the vtbx latency.
+ *
+ * This unit is built with -mfpu=neon and must only be called between
+ * kernel_neon_begin() and kernel_neon_end(); it deliberately includes no
+ * kernel headers, see arch/arm/include/asm/neon.h.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <arm_neon.h>
+
+#define __aes_inline	inline __attribute__((always_inline))
+
+#define AES_BLOCK_SIZE	16
+#define AES_PAR		4
+
+static const uint8_t aes_sbox[256] __attribute__((aligned(64))) = {
+	0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5,
+	0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+	0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0,
+	0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+	0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc,
+	0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+	0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a,
+	0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+	0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0,
+	0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+	0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b,
+	0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+	0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85,
+	0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+	0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5,
+	0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+	0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17,
+	0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+	0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88,
+	0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+	0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c,
+	0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+	0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9,
+	0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+	0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6,
+	0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+	0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e,
+	0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+	0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94,
+	0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+	0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68,
+	0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16,
+};
+
+static const uint8_t aes_inv_sbox[256] __attribute__((aligned(64))) = {
+	0x52, 0x09, 0x6a, 0xd5, 0x30, 0x36, 0xa5, 0x38,
+	0xbf, 0x40, 0xa3, 0x9e, 0x81, 0xf3, 0xd7, 0xfb,
+	0x7c, 0xe3, 0x39, 0x82, 0x9b, 0x2f, 0xff, 0x87,
+	0x34, 0x8e, 0x43, 0x44, 0xc4, 0xde, 0xe9, 0xcb,
+	0x54, 0x7b, 0x94, 0x32, 0xa6, 0xc2, 0x23, 0x3d,
+	0xee, 0x4c, 0x95, 0x0b, 0x42, 0xfa, 0xc3, 0x4e,
+	0x08, 0x2e, 0xa1, 0x66, 0x28, 0xd9, 0x24, 0xb2,
+	0x76, 0x5b, 0xa2, 0x49, 0x6d, 0x8b, 0xd1, 0x25,
+	0x72, 0xf8, 0xf6, 0x64, 0x86, 0x68, 0x98, 0x16,
+	0xd4, 0xa4, 0x5c, 0xcc, 0x5d, 0x65, 0xb6, 0x92,
+	0x6c, 0x70, 0x48, 0x50, 0xfd, 0xed, 0xb9, 0xda,
+	0x5e, 0x15, 0x46, 0x57, 0xa7, 0x8d, 0x9d, 0x84,
+	0x90, 0xd8, 0xab, 0x00, 0x8c, 0xbc, 0xd3, 0x0a,
+	0xf7, 0xe4, 0x58, 0x05, 0xb8, 0xb3, 0x45, 0x06,
+	0xd0, 0x2c, 0x1e, 0x8f, 0xca, 0x3f, 0x0f, 0x02,
+	0xc1, 0xaf, 0xbd, 0x03, 0x01, 0x13, 0x8a, 0x6b,
+	0x3a, 0x91, 0x11, 0x41, 0x4f, 0x67, 0xdc, 0xea,
+	0x97, 0xf2, 0xcf, 0xce, 0xf0, 0xb4, 0xe6, 0x73,
+	0x96, 0xac, 0x74, 0x22, 0xe7, 0xad, 0x35, 0x85,
+	0xe2, 0xf9, 0x37, 0xe8, 0x1c, 0x75, 0xdf, 0x6e,
+	0x47, 0xf1, 0x1a, 0x71, 0x1d, 0x29, 0xc5, 0x89,
+	0x6f, 0xb7, 0x62, 0x0e, 0xaa, 0x18, 0xbe, 0x1b,
+	0xfc, 0x56, 0x3e, 0x4b, 0xc6, 0xd2, 0x79, 0x20,
+	0x9a, 0xdb, 0xc0, 0xfe, 0x78, 0xcd, 0x5a, 0xf4,
+	0x1f, 0xdd, 0xa8, 0x33, 0x88, 0x07, 0xc7, 0x31,
+	0xb1, 0x12, 0x10, 0x59, 0x27, 0x80, 0xec, 0x5f,
+	0x60, 0x51, 0x7f, 0xa9, 0x19, 0xb5, 0x4a, 0x0d,
+	0x2d, 0xe5, 0x7a, 0x9f, 0x93, 0xc9, 0x9c, 0xef,
+	0xa0, 0xe0, 0x3b, 0x4d, 0xae, 0x2a, 0xf5, 0xb0,
+	0xc8, 0xeb, 0xbb, 0x3c, 0x83, 0x53, 0x99, 0x61,
+	0x17, 0x2b, 0x04, 0x7e, 0xba, 0x77, 0xd6, 0x26,
+	0xe1, 0x69, 0x14, 0x63, 0x55, 0x21, 0x0c, 0x7d,
+};
+
+static const uint8_t aes_shift_rows[16] = {
+	0x0, 0x5, 0xa, 0xf, 0x4, 0x9, 0xe, 0x3,
+	0x8, 0xd, 0x2, 0x7, 0xc, 0x1, 0x6, 0xb,
+};
+
+static const uint8_t aes_inv_shift_rows[16] = {
+	0x0, 0xd, 0xa, 0x7, 0x4, 0x1, 0xe, 0xb,
+	0x8, 0x5, 0x2, 0xf, 0xc, 0x9, 0x6, 0x3,
+};
+
+/* 16 entry table lookup, used for the row shifts */
+static __aes_inline uint8x16_t aes_permute(uint8x16_t s, uint8x16_t idx)
+{
+	uint8x8x2_t t = { { vget_low_u8(s), vget_high_u8(s) } };
+
+	return vcombine_u8(vtbl2_u8(t, vget_low_u8(idx)),
+			   vtbl2_u8(t, vget_high_u8(idx)));
+}
+
+/*
+ * Look up all 16 bytes of n states in a 256 byte S-box: slice i covers
+ * the values 32 * i .. 32 * i + 31, and vtbx leaves lanes whose index is
+ * out of range alone, so after eight slices every lane has been replaced
+ * exactly once.
+ */
+static __aes_inline void aes_sub_bytes(uint8x16_t s[], int n,
+				       const uint8_t *box)
+{
+	uint8x8_t lo[AES_PAR], hi[AES_PAR], rlo[AES_PAR], rhi[AES_PAR];
+	const uint8x8_t step = vdup_n_u8(0x20);
+	uint8x8x4_t tbl;
+	int i, b;
+
+	for (i = 0; i < 8; i++) {
+		tbl.val[0] = vld1_u8(box + 32 * i);
+		tbl.val[1] = vld1_u8(box + 32 * i + 8);
+		tbl.val[2] = vld1_u8(box + 32 * i + 16);
+		tbl.val[3] = vld1_u8(box + 32 * i + 24);
+
+		for (b = 0; b < n; b++) {
+			if (i == 0) {
+				lo[b] = vget_low_u8(s[b]);
+				hi[b] = vget_high_u8(s[b]);
+				rlo[b] = vtbl4_u8(tbl, lo[b]);
+				rhi[b] = vtbl4_u8(tbl, hi[b]);
+				continue;
+			}
+			lo[b] = vsub_u8(lo[b], step);
+			hi[b] = vsub_u8(hi[b], step);
+			rlo[b] = vtbx4_u8(rlo[b], tbl, lo[b]);
+			rhi[b] = vtbx4_u8(rhi[b], tbl, hi[b]);
+		}
+	}
+
+	for (b = 0; b < n; b++)
+		s[b] = vcombine_u8(rlo[b], rhi[b]);
+}
+
+static __aes_inline uint8x16_t aes_xtime(uint8x16_t x)
+{
+	uint8x16_t carry = vreinterpretq_u8_s8(
+				vshrq_n_s8(vreinterpretq_s8_u8(x), 7));
+
+	return veorq_u8(vshlq_n_u8(x, 1),
+			vandq_u8(carry, vdupq_n_u8(0x1b)));
+}
+
+/* rotate each column so that row j holds what row j + n held */
+static __aes_inline uint8x16_t aes_rot1(uint8x16_t s)
+{
+	uint32x4_t w = vreinterpretq_u32_u8(s);
+
+	return vreinterpretq_u8_u32(vsriq_n_u32(vshlq_n_u32(w, 24), w, 8));
+}
+
+static __aes_inline uint8x16_t aes_rot2(uint8x16_t s)
+{
+	return vreinterpretq_u8_u16(vrev32q_u16(vreinterpretq_u16_u8(s)));
+}
+
+static __aes_inline uint8x16_t aes_rot3(uint8x16_t s)
+{
+	uint32x4_t w = vreinterpretq_u32_u8(s);
+
+	return vreinterpretq_u8_u32(vsriq_n_u32(vshlq_n_u32(w, 8), w, 24));
+}
+
+/* b[j] = 2 a[j] ^ 3 a[j+1] ^ a[j+2] ^ a[j+3] */
+static __aes_inline uint8x16_t aes_mix_columns(uint8x16_t s)
+{
+	uint8x16_t r1 = aes_rot1(s);
+
+	return veorq_u8(veorq_u8(aes_xtime(veorq_u8(s, r1)), r1),
+			veorq_u8(aes_rot2(s), aes_rot3(s)));
+}
+
+/*
+ * InvMixColumns is MixColumns applied after adding 4 (a[j] ^ a[j+2]) to
+ * every byte.
+ */
+static __aes_inline uint8x16_t aes_inv_mix_columns(uint8x16_t s)
+{
+	uint8x16_t t = aes_xtime(aes_xtime(veorq_u8(s, aes_rot2(s))));
+
+	return aes_mix_columns(veorq_u8(s, t));
+}
+
+static __aes_inline void aes_encrypt_n(uint8x16_t s[], int n,
+				       const uint8_t rk[], int rounds)
+{
+	const uint8x16_t sr = vld1q_u8(aes_shift_rows);
+	uint8x16_t k = vld1q_u8(rk);
+	int r, b;
+
+	for (b = 0; b < n; b++)
+		s[b] = veorq_u8(s[b], k);
+
+	for (r = 1; r <= rounds; r++) {
+		for (b = 0; b < n; b++)
+			s[b] = aes_permute(s[b], sr);
+		aes_sub_bytes(s, n, aes_sbox);
+		k = vld1q_u8(rk + r * AES_BLOCK_SIZE);
+		for (b = 0; b < n; b++) {
+			if (r < rounds)
+				s[b] = aes_mix_columns(s[b]);
+			s[b] = veorq_u8(s[b], k);
+		}
+	}
+}
+
+/*
+ * Equivalent inverse cipher: expects the decryption key schedule with
+ * InvMixColumns already applied to the inner round keys, as produced by
+ * crypto_aes_expand_key().
+ */
+static __aes_inline void aes_decrypt_n(uint8x16_t s[], int n,
+				       const uint8_t rk[], int rounds)
+{
+	const uint8x16_t isr = vld1q_u8(aes_inv_shift_rows);
+	uint8x16_t k = vld1q_u8(rk);
+	int r, b;
+
+	for (b = 0; b < n; b++)
+		s[b] = veorq_u8(s[b], k);
+
+	for (r = 1; r <= rounds; r++) {
+		for (b = 0; b < n; b++)
+			s[b] = aes_permute(s[b], isr);
+		aes_sub_bytes(s, n, aes_inv_sbox);
+		k = vld1q_u8(rk + r * AES_BLOCK_SIZE);
+		for (b = 0; b < n; b++) {
+			if (r < rounds)
+				s[b] = aes_inv_mix_columns(s[b]);
+			s[b] = veorq_u8(s[b], k);
+		}
+	}
+}
+
+static void aes_encrypt_1(uint8x16_t s[], const uint8_t rk[], int rounds)
+{
+	aes_encrypt_n(s, 1, rk, rounds);
+}
+
+static void aes_encrypt_4(uint8x16_t s[], const uint8_t rk[], int rounds)
+{
+	aes_encrypt_n(s, AES_PAR, rk, rounds);
+}
+
+static void aes_decrypt_1(uint8x16_t s[], const uint8_t rk[], int rounds)
+{
+	aes_decrypt_n(s, 1, rk, rounds);
+}
+
+static void aes_decrypt_4(uint8x16_t s[], const uint8_t rk[], int rounds)
+{
+	aes_decrypt_n(s, AES_PAR, rk, rounds);
+}
+
+void aes_neon_cbc_encrypt(uint8_t out[], const uint8_t in[],
+			  const uint8_t rk[], int rounds, int blocks,
+			  uint8_t iv[])
+{
+	uint8x16_t s = vld1q_u8(iv);
+
+	for (; blocks > 0; blocks--) {
+		s = veorq_u8(s, vld1q_u8(in));
+		aes_encrypt_1(&s, rk, rounds);
+		vst1q_u8(out, s);
+		in += AES_BLOCK_SIZE;
+		out += AES_BLOCK_SIZE;
+	}
+	vst1q_u8(iv, s);
+}
+
+void aes_neon_cbc_decrypt(uint8_t out[], const uint8_t in[],
+			  const uint8_t rk[], int rounds, int blocks,
+			  uint8_t iv[])
+{
+	uint8x16_t prev = vld1q_u8(iv);
+	uint8x16_t c[AES_PAR], s[AES_PAR];
+	int b;
+
+	for (; blocks >= AES_PAR; blocks -= AES_PAR) {
+		for (b = 0; b < AES_PAR; b++)
+			s[b] = c[b] = vld1q_u8(in + b * AES_BLOCK_SIZE);
+		aes_decrypt_4(s, rk, rounds);
+		vst1q_u8(out, veorq_u8(s[0], prev));
+		for (b = 1; b < AES_PAR; b++)
+			vst1q_u8(out + b * AES_BLOCK_SIZE,
+				 veorq_u8(s[b], c[b - 1]));
+		prev = c[AES_PAR - 1];
+		in += AES_PAR * AES_BLOCK_SIZE;
+		out += AES_PAR * AES_BLOCK_SIZE;
+	}
+	for (; blocks > 0; blocks--) {
+		s[0] = c[0] = vld1q_u8(in);
+		aes_decrypt_1(s, rk, rounds);
+		vst1q_u8(out, veorq_u8(s[0], prev));
+		prev = c[0];
+		in += AES_BLOCK_SIZE;
+		out += AES_BLOCK_SIZE;
+	}
+	vst1q_u8(iv, prev);
+}
+
+/* increment a 128-bit big endian counter */
+static void aes_ctr_inc(uint8_t ctr[])
+{
+	int i;
+
+	for (i = AES_BLOCK_SIZE - 1; i >= 0; i--)
+		if (++ctr[i])
+			break;
+}
+
+void aes_neon_ctr_encrypt(uint8_t out[], const uint8_t in[],
+			  const uint8_t rk[], int rounds, int blocks,
+			  uint8_t ctr[])
+{
+	uint8x16_t s[AES_PAR];
+	int b;
+
+	for (; blocks >= AES_PAR; blocks -= AES_PAR) {
+		for (b = 0; b < AES_PAR; b++) {
+			s[b] = vld1q_u8(ctr);
+			aes_ctr_inc(ctr);
+		}
+		aes_encrypt_4(s, rk, rounds);
+		for (b = 0; b < AES_PAR; b++)
+			vst1q_u8(out + b * AES_BLOCK_SIZE,
+				 veorq_u8(s[b],
+					  vld1q_u8(in + b * AES_BLOCK_SIZE)));
+		in += AES_PAR * AES_BLOCK_SIZE;
+		out += AES_PAR * AES_BLOCK_SIZE;
+	}
+	for (; blocks > 0; blocks--) {
+		s[0] = vld1q_u8(ctr);
+		aes_ctr_inc(ctr);
+		aes_encrypt_1(s, rk, rounds);
+		vst1q_u8(out, veorq_u8(s[0], vld1q_u8(in)));
+		in += AES_BLOCK_SIZE;
+		out += AES_BLOCK_SIZE;
+	}
+}
+
+/*
+ * Multiply the tweak by x in GF(2^128), with the little endian block
+ * convention of IEEE 1619 (gf128mul_x_ble()).
+ */
+static __aes_inline uint8x16_t aes_xts_next_tweak(uint8x16_t t)
+{
+	const uint64x2_t poly = vcombine_u64(vcreate_u64(0x87),
+					     vcreate_u64(1));
+	int64x2_t w = vreinterpretq_s64_u8(t);
+	uint64x2_t carry = vreinterpretq_u64_s64(vshrq_n_s64(w, 63));
+
+	carry = vandq_u64(vextq_u64(carry, carry, 1), poly);
+	return vreinterpretq_u8_u64(veorq_u64(
+			vshlq_n_u64(vreinterpretq_u64_s64(w), 1), carry));
+}
+
+static __aes_inline void aes_xts_crypt(uint8_t out[], const uint8_t in[],
+				       const uint8_t rk1[], int rounds,
+				       int blocks, const uint8_t rk2[],
+				       uint8_t iv[], int first, int enc)
+{
+	uint8x16_t s[AES_PAR], t[AES_PAR];
+	uint8x16_t tweak = vld1q_u8(iv);
+	int b;
+
+	if (first)
+		aes_encrypt_1(&tweak, rk2, rounds);
+
+	for (; blocks >= AES_PAR; blocks -= AES_PAR) {
+		for (b = 0; b < AES_PAR; b++) {
+			t[b] = tweak;
+			tweak = aes_xts_next_tweak(tweak);
+			s[b] = veorq_u8(vld1q_u8(in + b * AES_BLOCK_SIZE),
+					t[b]);
+		}
+		if (enc)
+			aes_encrypt_4(s, rk1, rounds);
+		else
+			aes_decrypt_4(s, rk1, rounds);
+		for (b = 0; b < AES_PAR; b++)
+			vst1q_u8(out + b * AES_BLOCK_SIZE,
+				 veorq_u8(s[b], t[b]));
+		in += AES_PAR * AES_BLOCK_SIZE;
+		out += AES_PAR * AES_BLOCK_SIZE;
+	}
+	for (; blocks > 0; blocks--) {
+		s[0] = veorq_u8(vld1q_u8(in), tweak);
+		if (enc)
+			aes_encrypt_1(s, rk1, rounds);
+		else
+			aes_decrypt_1(s, rk1, rounds);
+		vst1q_u8(out, veorq_u8(s[0], tweak));
+		tweak = aes_xts_next_tweak(tweak);
+		in += AES_BLOCK_SIZE;
+		out += AES_BLOCK_SIZE;
+	}
+	vst1q_u8(iv, tweak);
+}
+
+void aes_neon_xts_encrypt(uint8_t out[], const uint8_t in[],
+			  const uint8_t rk1[], int rounds, int blocks,
+			  const uint8_t rk2[], uint8_t iv[], int first)
+{
+	aes_xts_crypt(out, in, rk1, rounds, blocks, rk2, iv, first, 1);
+}
+
+void aes_neon_xts_decrypt(uint8_t out[], const uint8_t in[],
+			  const uint8_t rk1[], int rounds, int blocks,
+			  const uint8_t rk2[], uint8_t iv[], int first)
+{
+	aes_xts_crypt(out, in, rk1, rounds, blocks, rk2, iv, first, 0);
+}
@@ -0,0 +1,389 @@
+/*
+ * arch/arm/crypto/aes-neon-glue.c
+ *
+ * CBC, CTR and XTS AES using NEON, glue to the crypto API. The block
+ * processing lives in aes-neon-core.c, which is built for NEON and must
+ * only be entered between kernel_neon_begin() and kernel_neon_end().
+ *
+ * Callers in softirq context (IPsec, dm-crypt completions) can't use
+ * NEON, every transform therefore carries a fallback to the generic
+ * templates over aes-generic.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/crypto.h>
+#include <linux/err.h>
+#include <crypto/aes.h>
+#include <crypto/algapi.h>
+#include <asm/neon.h>
+
+asmlinkage void aes_neon_cbc_encrypt(u8 out[], u8 const in[], u8 const rk[],
+				     int rounds, int blocks, u8 iv[]);
+asmlinkage void aes_neon_cbc_decrypt(u8 out[], u8 const in[], u8 const rk[],
+				     int rounds, int blocks, u8 iv[]);
+asmlinkage void aes_neon_ctr_encrypt(u8 out[], u8 const in[], u8 const rk[],
+				     int rounds, int blocks, u8 ctr[]);
+asmlinkage void aes_neon_xts_encrypt(u8 out[], u8 const in[], u8 const rk1[],
+				     int rounds, int blocks, u8 const rk2[],
+				     u8 iv[], int first);
+asmlinkage void aes_neon_xts_decrypt(u8 out[], u8 const in[], u8 const rk1[],
+				     int rounds, int blocks, u8 const rk2[],
+				     u8 iv[], int first);
+
+/*
+ * The core takes its round keys as byte arrays; crypto_aes_expand_key()
+ * stores them as little endian words, which is the same thing on the
+ * little endian kernels this driver is restricted to.
+ */
+struct aes_neon_ctx {
+	struct crypto_aes_ctx key1;
+	struct crypto_aes_ctx key2;	/* XTS tweak key */
+	struct crypto_blkcipher *fallback;
+};
+
+static int num_rounds(struct crypto_aes_ctx *ctx)
+{
+	/* 10, 12 or 14 rounds for 128, 192 and 256 bit keys */
+	return 6 + ctx->key_length / 4;
+}
+
+static int aes_neon_fallback_setkey(struct crypto_tfm *tfm, const u8 *key,
+				    unsigned int len)
+{
+	struct aes_neon_ctx *ctx = crypto_tfm_ctx(tfm);
+	int ret;
+
+	ctx->fallback->base.crt_flags &= ~CRYPTO_TFM_REQ_MASK;
+	ctx->fallback->base.crt_flags |= tfm->crt_flags & CRYPTO_TFM_REQ_MASK;
+
+	ret = crypto_blkcipher_setkey(ctx->fallback, key, len);
+	if (ret) {
+		tfm->crt_flags &= ~CRYPTO_TFM_RES_MASK;
+		tfm->crt_flags |= ctx->fallback->base.crt_flags &
+				  CRYPTO_TFM_RES_MASK;
+	}
+	return ret;
+}
+
+static int aes_neon_setkey(struct crypto_tfm *tfm, const u8 *key,
+			   unsigned int len)
+{
+	struct aes_neon_ctx *ctx = crypto_tfm_ctx(tfm);
+
+	if (crypto_aes_expand_key(&ctx->key1, key, len)) {
+		tfm->crt_flags |= CRYPTO_TFM_RES_BAD_KEY_LEN;
+		return -EINVAL;
+	}
+	return aes_neon_fallback_setkey(tfm, key, len);
+}
+
+static int xts_neon_setkey(struct crypto_tfm *tfm, const u8 *key,
+			   unsigned int len)
+{
+	struct aes_neon_ctx *ctx = crypto_tfm_ctx(tfm);
+
+	if ((len % 2) ||
+	    crypto_aes_expand_key(&ctx->key1, key, len / 2) ||
+	    crypto_aes_expand_key(&ctx->key2, key + len / 2, len / 2)) {
+		tfm->crt_flags |= CRYPTO_TFM_RES_BAD_KEY_LEN;
+		return -EINVAL;
+	}
+	return aes_neon_fallback_setkey(tfm, key, len);
+}
+
+static int fallback_crypt(struct blkcipher_desc *desc,
+			  struct scatterlist *dst, struct scatterlist *src,
+			  unsigned int nbytes, bool enc)
+{
+	struct aes_neon_ctx *ctx = crypto_blkcipher_ctx(desc->tfm);
+	struct crypto_blkcipher *tfm = desc->tfm;
+	int ret;
+
+	desc->tfm = ctx->fallback;
+	if (enc)
+		ret = crypto_blkcipher_encrypt_iv(desc, dst, src, nbytes);
+	else
+		ret = crypto_blkcipher_decrypt_iv(desc, dst, src, nbytes);
+	desc->tfm = tfm;
+	return ret;
+}
+
+/*
+ * NEON sections run with preemption disabled, so each walk step gets its
+ * own section and blkcipher_walk_done(), which may sleep, is called
+ * outside of it. A step is at most a page.
+ */
+static int cbc_crypt(struct blkcipher_desc *desc, struct scatterlist *dst,
+		     struct scatterlist *src, unsigned int nbytes, bool enc)
+{
+	struct aes_neon_ctx *ctx = crypto_blkcipher_ctx(desc->tfm);
+	int rounds = num_rounds(&ctx->key1);
+	struct blkcipher_walk walk;
+	unsigned int blocks;
+	int err;
+
+	if (!may_use_neon())
+		return fallback_crypt(desc, dst, src, nbytes, enc);
+
+	blkcipher_walk_init(&walk, dst, src, nbytes);
+	err = blkcipher_walk_virt(desc, &walk);
+
+	while ((blocks = walk.nbytes / AES_BLOCK_SIZE)) {
+		kernel_neon_begin();
+		if (enc)
+			aes_neon_cbc_encrypt(walk.dst.virt.addr,
+					     walk.src.virt.addr,
+					     (u8 *)ctx->key1.key_enc, rounds,
+					     blocks, walk.iv);
+		else
+			aes_neon_cbc_decrypt(walk.dst.virt.addr,
+					     walk.src.virt.addr,
+					     (u8 *)ctx->key1.key_dec, rounds,
+					     blocks, walk.iv);
+		kernel_neon_end();
+		err = blkcipher_walk_done(desc, &walk,
+					  walk.nbytes % AES_BLOCK_SIZE);
+	}
+	return err;
+}
+
+static int cbc_encrypt(struct blkcipher_desc *desc, struct scatterlist *dst,
+		       struct scatterlist *src, unsigned int nbytes)
+{
+	return cbc_crypt(desc, dst, src, nbytes, true);
+}
+
+static int cbc_decrypt(struct blkcipher_desc *desc, struct scatterlist *dst,
+		       struct scatterlist *src, unsigned int nbytes)
+{
+	return cbc_crypt(desc, dst, src, nbytes, false);
+}
+
+static int ctr_encrypt(struct blkcipher_desc *desc, struct scatterlist *dst,
+		       struct scatterlist *src, unsigned int nbytes)
+{
+	struct aes_neon_ctx *ctx = crypto_blkcipher_ctx(desc->tfm);
+	int rounds = num_rounds(&ctx->key1);
+	struct blkcipher_walk walk;
+	unsigned int blocks;
+	int err;
+
+	if (!may_use_neon())
+		return fallback_crypt(desc, dst, src, nbytes, true);
+
+	blkcipher_walk_init(&walk, dst, src, nbytes);
+	err = blkcipher_walk_virt_block(desc, &walk, AES_BLOCK_SIZE);
+
+	while ((blocks = walk.nbytes / AES_BLOCK_SIZE)) {
+		kernel_neon_begin();
+		aes_neon_ctr_encrypt(walk.dst.virt.addr, walk.src.virt.addr,
+				     (u8 *)ctx->key1.key_enc, rounds, blocks,
+				     walk.iv);
+		kernel_neon_end();
+		err = blkcipher_walk_done(desc, &walk,
+					  walk.nbytes % AES_BLOCK_SIZE);
+	}
+
+	/* a final partial block: xor it with one block of key stream */
+	if (walk.nbytes) {
+		u8 ks[AES_BLOCK_SIZE] = { 0 };
+		u8 *dst = walk.dst.virt.addr;
+		u8 *src = walk.src.virt.addr;
+
+		kernel_neon_begin();
+		aes_neon_ctr_encrypt(ks, ks, (u8 *)ctx->key1.key_enc, rounds,
+				     1, walk.iv);
+		kernel_neon_end();
+		crypto_xor(ks, src, walk.nbytes);
+		memcpy(dst, ks, walk.nbytes);
+		err = blkcipher_walk_done(desc, &walk, 0);
+	}
+	return err;
+}
+
+static int xts_crypt(struct blkcipher_desc *desc, struct scatterlist *dst,
+		     struct scatterlist *src, unsigned int nbytes, bool enc)
+{
+	struct aes_neon_ctx *ctx = crypto_blkcipher_ctx(desc->tfm);
+	int rounds = num_rounds(&ctx->key1);
+	struct blkcipher_walk walk;
+	unsigned int blocks;
+	int first = 1;
+	int err;
+
+	if (!may_use_neon())
+		return fallback_crypt(desc, dst, src, nbytes, enc);
+
+	blkcipher_walk_init(&walk, dst, src, nbytes);
+	err = blkcipher_walk_virt(desc, &walk);
+
+	/* the core turns walk.iv into the running tweak on the first step */
+	while ((blocks = walk.nbytes / AES_BLOCK_SIZE)) {
+		kernel_neon_begin();
+		if (enc)
+			aes_neon_xts_encrypt(walk.dst.virt.addr,
+					     walk.src.virt.addr,
+					     (u8 *)ctx->key1.key_enc, rounds,
+					     blocks, (u8 *)ctx->key2.key_enc,
+					     walk.iv, first);
+		else
+			aes_neon_xts_decrypt(walk.dst.virt.addr,
+					     walk.src.virt.addr,
+					     (u8 *)ctx->key1.key_dec, rounds,
+					     blocks, (u8 *)ctx->key2.key_enc,
+					     walk.iv, first);
+		kernel_neon_end();
+		first = 0;
+		err = blkcipher_walk_done(desc, &walk,
+					  walk.nbytes % AES_BLOCK_SIZE);
+	}
+	return err;
+}
+
+static int xts_encrypt(struct blkcipher_desc *desc, struct scatterlist *dst,
+		       struct scatterlist *src, unsigned int nbytes)
+{
+	return xts_crypt(desc, dst, src, nbytes, true);
+}
+
+static int xts_decrypt(struct blkcipher_desc *desc, struct scatterlist *dst,
+		       struct scatterlist *src, unsigned int nbytes)
+{
+	return xts_crypt(desc, dst, src, nbytes, false);
+}
+
+static int aes_neon_init(struct crypto_tfm *tfm)
+{
+	const char *name = tfm->__crt_alg->cra_name;
+	struct aes_neon_ctx *ctx = crypto_tfm_ctx(tfm);
+
+	ctx->fallback = crypto_alloc_blkcipher(name, 0,
+			CRYPTO_ALG_ASYNC | CRYPTO_ALG_NEED_FALLBACK);
+	if (IS_ERR(ctx->fallback)) {
+		printk(KERN_ERR "aes-neon: can't allocate fallback for %s\n",
+		       name);
+		return PTR_ERR(ctx->fallback);
+	}
+	return 0;
+}
+
+static void aes_neon_exit(struct crypto_tfm *tfm)
+{
+	struct aes_neon_ctx *ctx = crypto_tfm_ctx(tfm);
+
+	crypto_free_blkcipher(ctx->fallback);
+	ctx->fallback = NULL;
+}
+
+static struct crypto_alg aes_neon_algs[] = { {
+	.cra_name		= "cbc(aes)",
+	.cra_driver_name	= "cbc-aes-neon",
+	.cra_priority		= 300,
+	.cra_flags		= CRYPTO_ALG_TYPE_BLKCIPHER |
+				  CRYPTO_ALG_NEED_FALLBACK,
+	.cra_blocksize		= AES_BLOCK_SIZE,
+	.cra_ctxsize		= sizeof(struct aes_neon_ctx),
+	.cra_alignmask		= 0,
+	.cra_type		= &crypto_blkcipher_type,
+	.cra_module		= THIS_MODULE,
+	.cra_init		= aes_neon_init,
+	.cra_exit		= aes_neon_exit,
+	.cra_u = {
+		.blkcipher = {
+			.min_keysize	= AES_MIN_KEY_SIZE,
+			.max_keysize	= AES_MAX_KEY_SIZE,
+			.ivsize		= AES_BLOCK_SIZE,
+			.setkey		= aes_neon_setkey,
+			.encrypt	= cbc_encrypt,
+			.decrypt	= cbc_decrypt,
+		},
+	},
+}, {
+	.cra_name		= "ctr(aes)",
+	.cra_driver_name	= "ctr-aes-neon",
+	.cra_priority		= 300,
+	.cra_flags		= CRYPTO_ALG_TYPE_BLKCIPHER |
+				  CRYPTO_ALG_NEED_FALLBACK,
+	.cra_blocksize		= 1,
+	.cra_ctxsize		= sizeof(struct aes_neon_ctx),
+	.cra_alignmask		= 0,
+	.cra_type		= &crypto_blkcipher_type,
+	.cra_module		= THIS_MODULE,
+	.cra_init		= aes_neon_init,
+	.cra_exit		= aes_neon_exit,
+	.cra_u = {
+		.blkcipher = {
+			.min_keysize	= AES_MIN_KEY_SIZE,
+			.max_keysize	= AES_MAX_KEY_SIZE,
+			.ivsize		= AES_BLOCK_SIZE,
+			.setkey		= aes_neon_setkey,
+			.encrypt	= ctr_encrypt,
+			.decrypt	= ctr_encrypt,
+		},
+	},
+}, {
+	.cra_name		= "xts(aes)",
+	.cra_driver_name	= "xts-aes-neon",
+	.cra_priority		= 300,
+	.cra_flags		= CRYPTO_ALG_TYPE_BLKCIPHER |
+				  CRYPTO_ALG_NEED_FALLBACK,
+	.cra_blocksize		= AES_BLOCK_SIZE,
+	.cra_ctxsize		= sizeof(struct aes_neon_ctx),
+	.cra_alignmask		= 0,
+	.cra_type		= &crypto_blkcipher_type,
+	.cra_module		= THIS_MODULE,
+	.cra_init		= aes_neon_init,
+	.cra_exit		= aes_neon_exit,
+	.cra_u = {
+		.blkcipher = {
+			.min_keysize	= 2 * AES_MIN_KEY_SIZE,
+			.max_keysize	= 2 * AES_MAX_KEY_SIZE,
+			.ivsize		= AES_BLOCK_SIZE,
+			.setkey		= xts_neon_setkey,
+			.encrypt	= xts_encrypt,
+			.decrypt	= xts_decrypt,
+		},
+	},
+} };
+
+static int __init aes_neon_mod_init(void)
+{
+	int i, err;
+
+	if (!cpu_has_neon())
+		return -ENODEV;
+
+	for (i = 0; i < ARRAY_SIZE(aes_neon_algs); i++) {
+		INIT_LIST_HEAD(&aes_neon_algs[i].cra_list);
+		err = crypto_register_alg(&aes_neon_algs[i]);
+		if (err)
+			goto unregister;
+	}
+	return 0;
+
+unregister:
+	while (--i >= 0)
+		crypto_unregister_alg(&aes_neon_algs[i]);
+	return err;
+}
+
+static void __exit aes_neon_mod_exit(void)
+{
+	int i;
+
+	for (i = ARRAY_SIZE(aes_neon_algs) - 1; i >= 0; i--)
+		crypto_unregister_alg(&aes_neon_algs[i]);
+}
+
+module_init(aes_neon_mod_init);
+module_exit(aes_neon_mod_exit);
+
+MODULE_DESCRIPTION("AES in CBC, CTR and XTS modes using NEON");
+MODULE_LICENSE("GPL");
+MODULE_ALIAS("cbc(aes)");
+MODULE_ALIAS("ctr(aes)");
+MODULE_ALIAS("xts(aes)");
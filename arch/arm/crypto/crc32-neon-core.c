@@ -0,0 +1,138 @@
+/*
+ * arch/arm/crypto/crc32-neon-core.c
+ *
+ * Bit reflected CRC32 folding using NEON.
+ *
+ * ARMv7 has no 64-bit carry-less multiply, but vmull.p8 does eight 8x8
+ * bit ones at a time. The running remainder is kept as a 128-bit block
+ * which is advanced over the next blocks of input by multiplying each of
+ * its 64-bit halves with a 32-bit constant, x^n mod P for the distance
+ * folded, and xoring the next block in. Four blocks are folded in
+ * parallel to hide the multiply latency; what is left at the end is one
+ * block with the same remainder as all of the input, which the caller
+ * reduces with the table code.
+ *
+ * This unit is built with -mfpu=neon and must only be called between
+ * kernel_neon_begin() and kernel_neon_end(); it deliberately includes no
+ * kernel headers, see arch/arm/include/asm/neon.h.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <arm_neon.h>
+
+#define __crc_inline	inline __attribute__((always_inline))
+
+#define CRC_BLOCK_SIZE	16
+#define CRC_PAR		4
+
+/*
+ * Byte j of the low (lanes 0-3) and high (lanes 4-7) half constants,
+ * lined up with the even or odd input bytes that vmovn/vshrn pick out.
+ */
+struct crc_fold_k {
+	uint8x8_t c[4];
+};
+
+static __crc_inline void crc_fold_k_init(struct crc_fold_k *k, uint32_t klo,
+					 uint32_t khi)
+{
+	int j;
+
+	for (j = 0; j < 4; j++)
+		k->c[j] = vext_u8(vdup_n_u8(klo >> (8 * j)),
+				  vdup_n_u8(khi >> (8 * j)), 4);
+}
+
+static __crc_inline uint8x16_t crc_pmull_long(uint8x8_t a, uint8x8_t b)
+{
+	return vreinterpretq_u8_p16(vmull_p8(vreinterpret_p8_u8(a),
+					     vreinterpret_p8_u8(b)));
+}
+
+/* the two 64-bit halves of a product, xored and widened back to 128 bits */
+static __crc_inline uint8x16_t crc_halves(uint8x16_t x)
+{
+	return vcombine_u8(veor_u8(vget_low_u8(x), vget_high_u8(x)),
+			   vdup_n_u8(0));
+}
+
+static __crc_inline uint8x16_t crc_shl8(uint8x16_t x)
+{
+	return vextq_u8(vdupq_n_u8(0), x, 15);
+}
+
+/*
+ * Returns lo(v) * klo ^ hi(v) * khi. Every 16-bit lane of vmull.p8 holds
+ * the full product of one even (or odd) input byte with one constant
+ * byte, so a product whose bytes are i and j only has to be shifted up
+ * by i + j bytes, i.e. by j (or j + 1) bytes from where the lane of i
+ * already puts it. The shifts are shared by collecting all products
+ * per shift first.
+ */
+static __crc_inline uint8x16_t crc_fold(uint8x16_t v,
+					const struct crc_fold_k *k)
+{
+	uint16x8_t w = vreinterpretq_u16_u8(v);
+	uint8x8_t even = vmovn_u16(w);
+	uint8x8_t odd = vshrn_n_u16(w, 8);
+	uint8x16_t p, r;
+	int j;
+
+	r = crc_halves(crc_pmull_long(odd, k->c[3]));
+	for (j = 3; j > 0; j--) {
+		p = veorq_u8(crc_pmull_long(even, k->c[j]),
+			     crc_pmull_long(odd, k->c[j - 1]));
+		r = veorq_u8(crc_shl8(r), crc_halves(p));
+	}
+	p = crc_pmull_long(even, k->c[0]);
+	return veorq_u8(crc_shl8(r), crc_halves(p));
+}
+
+/**
+ * crc32_neon_fold - fold a buffer down to a single block
+ * @out:	16 byte block with the same remainder as the input
+ * @crc:	bit reflected crc of the data before @in
+ * @in:		input data
+ * @len:	length of @in, a multiple of 16 and at least 64
+ * @k:		rev32(x^n mod P) for n = 543, 479, 159 and 95
+ *
+ * The crc of @out with a zero seed is the crc of @in seeded with @crc.
+ */
+void crc32_neon_fold(uint8_t out[], uint32_t crc, const uint8_t in[],
+		     unsigned int len, const uint32_t k[])
+{
+	struct crc_fold_k k4, k1;
+	uint8x16_t v[CRC_PAR];
+	int i;
+
+	crc_fold_k_init(&k4, k[0], k[1]);
+	crc_fold_k_init(&k1, k[2], k[3]);
+
+	for (i = 0; i < CRC_PAR; i++)
+		v[i] = vld1q_u8(in + i * CRC_BLOCK_SIZE);
+	v[0] = veorq_u8(v[0], vreinterpretq_u8_u32(vsetq_lane_u32(crc,
+						vdupq_n_u32(0), 0)));
+	in += CRC_PAR * CRC_BLOCK_SIZE;
+	len -= CRC_PAR * CRC_BLOCK_SIZE;
+
+	for (; len >= CRC_PAR * CRC_BLOCK_SIZE;
+	     len -= CRC_PAR * CRC_BLOCK_SIZE) {
+		for (i = 0; i < CRC_PAR; i++)
+			v[i] = veorq_u8(crc_fold(v[i], &k4),
+					vld1q_u8(in + i * CRC_BLOCK_SIZE));
+		in += CRC_PAR * CRC_BLOCK_SIZE;
+	}
+
+	for (i = 1; i < CRC_PAR; i++)
+		v[0] = veorq_u8(crc_fold(v[0], &k1), v[i]);
+
+	for (; len; len -= CRC_BLOCK_SIZE) {
+		v[0] = veorq_u8(crc_fold(v[0], &k1), vld1q_u8(in));
+		in += CRC_BLOCK_SIZE;
+	}
+
+	vst1q_u8(out, v[0]);
+}
@@ -0,0 +1,241 @@
+/*
+ * arch/arm/crypto/crc32c-neon-glue.c
+ *
+ * CRC32c using NEON folding, glue to the crypto API. The folding lives
+ * in crc32-neon-core.c, which is built for NEON and must only be entered
+ * between kernel_neon_begin() and kernel_neon_end(); the block it leaves
+ * behind and any tail shorter than a block go through __crc32c_le().
+ *
+ * Saving and restoring the VFP state costs about as much as checksumming
+ * a few hundred bytes with the tables, and how vmull.p8 compares with
+ * table lookups depends on the core. The module therefore times both at
+ * load and only uses NEON from the length where it wins, or not at all.
+ * Callers in interrupt context always get the table code.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/crc32.h>
+#include <linux/gfp.h>
+#include <linux/hrtimer.h>
+#include <linux/random.h>
+#include <crypto/internal/hash.h>
+#include <asm/neon.h>
+
+#define CHKSUM_BLOCK_SIZE	1
+#define CHKSUM_DIGEST_SIZE	4
+
+#define CRC32C_NEON_BLOCK	16
+#define CRC32C_NEON_MIN		64	/* crc32_neon_fold() needs four blocks */
+#define CRC32C_NEON_MAX		PAGE_SIZE
+
+asmlinkage void crc32_neon_fold(u8 out[], u32 crc, u8 const in[],
+				unsigned int len, u32 const k[]);
+
+/* rev32(x^n mod P) for the Castagnoli polynomial, n = 543, 479, 159, 95 */
+static const u32 crc32c_fold_k[] = {
+	0x740eef02, 0x9e4addf8, 0xf20c0dfe, 0x493c7d27,
+};
+
+/* shortest update that is worth NEON, set by crc32c_neon_calibrate() */
+static unsigned int crc32c_neon_min_len __read_mostly = UINT_MAX;
+
+static u32 crc32c_neon_bulk(u32 crc, const u8 *p, unsigned int len)
+{
+	unsigned int bulk = round_down(len, CRC32C_NEON_BLOCK);
+	u8 block[CRC32C_NEON_BLOCK];
+
+	kernel_neon_begin();
+	crc32_neon_fold(block, crc, p, bulk, crc32c_fold_k);
+	kernel_neon_end();
+
+	crc = __crc32c_le(0, block, CRC32C_NEON_BLOCK);
+	return __crc32c_le(crc, p + bulk, len - bulk);
+}
+
+static u32 crc32c_neon_le(u32 crc, const u8 *p, unsigned int len)
+{
+	if (len >= crc32c_neon_min_len && may_use_neon())
+		return crc32c_neon_bulk(crc, p, len);
+	return __crc32c_le(crc, p, len);
+}
+
+/*
+ * Setting the seed allows arbitrary accumulators and flexible XOR policy
+ * If your algorithm starts with ~0, then XOR with ~0 before you set
+ * the seed.
+ */
+static int crc32c_neon_setkey(struct crypto_shash *hash, const u8 *key,
+			      unsigned int keylen)
+{
+	u32 *mctx = crypto_shash_ctx(hash);
+
+	if (keylen != sizeof(u32)) {
+		crypto_shash_set_flags(hash, CRYPTO_TFM_RES_BAD_KEY_LEN);
+		return -EINVAL;
+	}
+	*mctx = le32_to_cpup((__le32 *)key);
+	return 0;
+}
+
+static int crc32c_neon_init(struct shash_desc *desc)
+{
+	u32 *mctx = crypto_shash_ctx(desc->tfm);
+	u32 *crcp = shash_desc_ctx(desc);
+
+	*crcp = *mctx;
+	return 0;
+}
+
+static int crc32c_neon_update(struct shash_desc *desc, const u8 *data,
+			      unsigned int len)
+{
+	u32 *crcp = shash_desc_ctx(desc);
+
+	*crcp = crc32c_neon_le(*crcp, data, len);
+	return 0;
+}
+
+static int __crc32c_neon_finup(u32 *crcp, const u8 *data, unsigned int len,
+			       u8 *out)
+{
+	*(__le32 *)out = ~cpu_to_le32(crc32c_neon_le(*crcp, data, len));
+	return 0;
+}
+
+static int crc32c_neon_finup(struct shash_desc *desc, const u8 *data,
+			     unsigned int len, u8 *out)
+{
+	return __crc32c_neon_finup(shash_desc_ctx(desc), data, len, out);
+}
+
+static int crc32c_neon_final(struct shash_desc *desc, u8 *out)
+{
+	u32 *crcp = shash_desc_ctx(desc);
+
+	*(__le32 *)out = ~cpu_to_le32p(crcp);
+	return 0;
+}
+
+static int crc32c_neon_digest(struct shash_desc *desc, const u8 *data,
+			      unsigned int len, u8 *out)
+{
+	return __crc32c_neon_finup(crypto_shash_ctx(desc->tfm), data, len,
+				   out);
+}
+
+static int crc32c_neon_cra_init(struct crypto_tfm *tfm)
+{
+	u32 *key = crypto_tfm_ctx(tfm);
+
+	*key = ~0;
+	return 0;
+}
+
+static struct shash_alg alg = {
+	.setkey			=	crc32c_neon_setkey,
+	.init			=	crc32c_neon_init,
+	.update			=	crc32c_neon_update,
+	.final			=	crc32c_neon_final,
+	.finup			=	crc32c_neon_finup,
+	.digest			=	crc32c_neon_digest,
+	.descsize		=	sizeof(u32),
+	.digestsize		=	CHKSUM_DIGEST_SIZE,
+	.base			=	{
+		.cra_name		=	"crc32c",
+		.cra_driver_name	=	"crc32c-neon",
+		.cra_priority		=	200,
+		.cra_blocksize		=	CHKSUM_BLOCK_SIZE,
+		.cra_ctxsize		=	sizeof(u32),
+		.cra_module		=	THIS_MODULE,
+		.cra_init		=	crc32c_neon_cra_init,
+	}
+};
+
+/* best of a few runs over @len bytes, in ns */
+static s64 __init crc32c_neon_time(u32 (*fn)(u32, const u8 *, unsigned int),
+				   const u8 *buf, unsigned int len, u32 *crc)
+{
+	s64 best = LLONG_MAX;
+	int run, i, loops = max_t(int, 8, (32 * CRC32C_NEON_MAX) / len);
+
+	for (run = 0; run < 3; run++) {
+		ktime_t start = ktime_get();
+
+		for (i = 0; i < loops; i++)
+			*crc = fn(*crc, buf, len);
+		best = min(best, ktime_to_ns(ktime_sub(ktime_get(), start)));
+	}
+	return best;
+}
+
+static u32 __init crc32c_table_le(u32 crc, const u8 *p, unsigned int len)
+{
+	return __crc32c_le(crc, p, len);
+}
+
+/*
+ * Times the table code against NEON for power of two lengths and sets
+ * crc32c_neon_min_len to the first one where NEON is faster. Returns
+ * false if it never is, or if the two disagree.
+ */
+static bool __init crc32c_neon_calibrate(void)
+{
+	unsigned int len;
+	u8 *buf;
+
+	buf = (u8 *)__get_free_page(GFP_KERNEL);
+	if (!buf)
+		return false;
+	get_random_bytes(buf, CRC32C_NEON_MAX);
+
+	for (len = CRC32C_NEON_MIN; len <= CRC32C_NEON_MAX; len <<= 1) {
+		u32 crc_table = ~0, crc_neon = ~0;
+		s64 t_table, t_neon;
+
+		t_table = crc32c_neon_time(crc32c_table_le, buf, len,
+					   &crc_table);
+		t_neon = crc32c_neon_time(crc32c_neon_bulk, buf, len,
+					  &crc_neon);
+		if (crc_table != crc_neon) {
+			pr_err("crc32c-neon: self test failed at %u bytes\n",
+			       len);
+			break;
+		}
+		if (t_neon < t_table) {
+			crc32c_neon_min_len = len;
+			break;
+		}
+	}
+	free_page((unsigned long)buf);
+
+	if (crc32c_neon_min_len == UINT_MAX)
+		return false;
+	pr_info("crc32c-neon: using NEON from %u bytes\n",
+		crc32c_neon_min_len);
+	return true;
+}
+
+static int __init crc32c_neon_mod_init(void)
+{
+	if (!cpu_has_neon() || !crc32c_neon_calibrate())
+		return -ENODEV;
+	return crypto_register_shash(&alg);
+}
+
+static void __exit crc32c_neon_mod_fini(void)
+{
+	crypto_unregister_shash(&alg);
+}
+
+module_init(crc32c_neon_mod_init);
+module_exit(crc32c_neon_mod_fini);
+
+MODULE_DESCRIPTION("CRC32c (Castagnoli) using NEON folding");
+MODULE_LICENSE("GPL");
+MODULE_ALIAS("crc32c");
+MODULE_ALIAS("crc32c-neon");
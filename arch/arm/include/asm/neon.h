@@ -0,0 +1,50 @@
+/*
+ * arch/arm/include/asm/neon.h
+ *
+ * Kernel mode NEON support.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef __ASM_ARM_NEON_H
+#define __ASM_ARM_NEON_H
+
+#include <linux/hardirq.h>
+#include <asm/hwcap.h>
+
+#define cpu_has_neon()		(!!(elf_hwcap & HWCAP_NEON))
+
+#ifdef __ARM_NEON__
+
+/*
+ * NEON code must live in its own compilation unit, built with -mfpu=neon,
+ * and be called from a kernel_neon_begin()/kernel_neon_end() pair in a
+ * unit built without it. Otherwise GCC is free to emit or move NEON
+ * instructions outside the section.
+ */
+#define kernel_neon_begin()	BUILD_BUG_ON(1)
+
+#else
+/*
+ * kernel_neon_begin() saves the current task's NEON/VFP state, if it is
+ * live in the hardware, and enables the unit for the kernel. Preemption
+ * stays disabled until kernel_neon_end(), so the section must not sleep.
+ * Only process context may use NEON; see may_use_neon().
+ */
+void kernel_neon_begin(void);
+#endif
+void kernel_neon_end(void);
+
+/*
+ * Softirqs and hard interrupts can land in the middle of a
+ * kernel_neon_begin() section or of the lazy VFP switching code, so
+ * NEON users that may be called from there must check this first and
+ * fall back to their scalar code when it is false.
+ */
+static inline bool may_use_neon(void)
+{
+	return cpu_has_neon() && !in_interrupt();
+}
+
+#endif /* __ASM_ARM_NEON_H */
@@ -0,0 +1,123 @@
+/*
+ * linux/arch/arm/lib/xor-neon.c
+ *
+ * NEON xor_blocks routines, used through the xor_block_neon template in
+ * asm/xor.h, which wraps them in kernel_neon_begin()/kernel_neon_end().
+ * This unit is built with -mfpu=neon and must not be entered otherwise.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/raid/xor.h>
+
+#ifndef __ARM_NEON__
+#error This file must be built with -mfloat-abi=softfp -mfpu=neon
+#endif
+
+/*
+ * GCC vector types rather than arm_neon.h, which can't be mixed with the
+ * kernel headers. Each loop iteration covers 64 bytes, four q registers
+ * per source, which is enough to hide the load latency; the callers
+ * always pass whole pages.
+ */
+typedef unsigned long xor_vec_t __attribute__((vector_size(16)));
+
+#define XOR_VECS	4
+#define XOR_LINE	(XOR_VECS * sizeof(xor_vec_t))
+
+static void
+xor_neon_2(unsigned long bytes, unsigned long *p1, unsigned long *p2)
+{
+	xor_vec_t *d = (xor_vec_t *)p1;
+	const xor_vec_t *s1 = (const xor_vec_t *)p2;
+	unsigned long lines = bytes / XOR_LINE;
+
+	do {
+		d[0] ^= s1[0];
+		d[1] ^= s1[1];
+		d[2] ^= s1[2];
+		d[3] ^= s1[3];
+		d += XOR_VECS;
+		s1 += XOR_VECS;
+	} while (--lines);
+}
+
+static void
+xor_neon_3(unsigned long bytes, unsigned long *p1, unsigned long *p2,
+	   unsigned long *p3)
+{
+	xor_vec_t *d = (xor_vec_t *)p1;
+	const xor_vec_t *s1 = (const xor_vec_t *)p2;
+	const xor_vec_t *s2 = (const xor_vec_t *)p3;
+	unsigned long lines = bytes / XOR_LINE;
+
+	do {
+		d[0] ^= s1[0] ^ s2[0];
+		d[1] ^= s1[1] ^ s2[1];
+		d[2] ^= s1[2] ^ s2[2];
+		d[3] ^= s1[3] ^ s2[3];
+		d += XOR_VECS;
+		s1 += XOR_VECS;
+		s2 += XOR_VECS;
+	} while (--lines);
+}
+
+static void
+xor_neon_4(unsigned long bytes, unsigned long *p1, unsigned long *p2,
+	   unsigned long *p3, unsigned long *p4)
+{
+	xor_vec_t *d = (xor_vec_t *)p1;
+	const xor_vec_t *s1 = (const xor_vec_t *)p2;
+	const xor_vec_t *s2 = (const xor_vec_t *)p3;
+	const xor_vec_t *s3 = (const xor_vec_t *)p4;
+	unsigned long lines = bytes / XOR_LINE;
+
+	do {
+		d[0] ^= s1[0] ^ s2[0] ^ s3[0];
+		d[1] ^= s1[1] ^ s2[1] ^ s3[1];
+		d[2] ^= s1[2] ^ s2[2] ^ s3[2];
+		d[3] ^= s1[3] ^ s2[3] ^ s3[3];
+		d += XOR_VECS;
+		s1 += XOR_VECS;
+		s2 += XOR_VECS;
+		s3 += XOR_VECS;
+	} while (--lines);
+}
+
+static void
+xor_neon_5(unsigned long bytes, unsigned long *p1, unsigned long *p2,
+	   unsigned long *p3, unsigned long *p4, unsigned long *p5)
+{
+	xor_vec_t *d = (xor_vec_t *)p1;
+	const xor_vec_t *s1 = (const xor_vec_t *)p2;
+	const xor_vec_t *s2 = (const xor_vec_t *)p3;
+	const xor_vec_t *s3 = (const xor_vec_t *)p4;
+	const xor_vec_t *s4 = (const xor_vec_t *)p5;
+	unsigned long lines = bytes / XOR_LINE;
+
+	do {
+		d[0] ^= s1[0] ^ s2[0] ^ s3[0] ^ s4[0];
+		d[1] ^= s1[1] ^ s2[1] ^ s3[1] ^ s4[1];
+		d[2] ^= s1[2] ^ s2[2] ^ s3[2] ^ s4[2];
+		d[3] ^= s1[3] ^ s2[3] ^ s3[3] ^ s4[3];
+		d += XOR_VECS;
+		s1 += XOR_VECS;
+		s2 += XOR_VECS;
+		s3 += XOR_VECS;
+		s4 += XOR_VECS;
+	} while (--lines);
+}
+
+struct xor_block_template const xor_block_neon_inner = {
+	.name	= "__inner_neon__",
+	.do_2	= xor_neon_2,
+	.do_3	= xor_neon_3,
+	.do_4	= xor_neon_4,
+	.do_5	= xor_neon_5,
+};
+EXPORT_SYMBOL(xor_block_neon_inner);
+
+MODULE_LICENSE("GPL");
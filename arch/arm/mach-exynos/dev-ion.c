@@ -23,9 +23,9 @@ void __init exynos_ion_set_platdata(void)
 {
 	struct ion_platform_data *pdata;
 	pdata = kzalloc(sizeof(struct ion_platform_data)
-			+ 5 * sizeof(struct ion_platform_heap), GFP_KERNEL);
+			+ 6 * sizeof(struct ion_platform_heap), GFP_KERNEL);
 	if (pdata) {
-		pdata->nr = 5;
+		pdata->nr = 6;
 		pdata->heaps[0].type = ION_HEAP_TYPE_SYSTEM;
 		pdata->heaps[0].name = "ion_noncontig_heap";
 		pdata->heaps[0].id = ION_HEAP_TYPE_SYSTEM;
@@ -41,6 +41,9 @@ void __init exynos_ion_set_platdata(void)
 		pdata->heaps[4].type = ION_HEAP_TYPE_EXYNOS_USER;
 		pdata->heaps[4].name = "exynos_user_heap";
 		pdata->heaps[4].id = ION_HEAP_TYPE_EXYNOS_USER;
+		pdata->heaps[5].type = ION_HEAP_TYPE_PAGE_POOL;
+		pdata->heaps[5].name = "ion_page_pool_heap";
+		pdata->heaps[5].id = ION_HEAP_TYPE_PAGE_POOL;
 		exynos_device_ion.dev.platform_data = pdata;
 	}
 }
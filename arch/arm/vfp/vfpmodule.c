@@ -513,6 +513,117 @@ void vfp_flush_hwstate(struct thread_info *thread)
 	put_cpu();
 }
 
+#ifdef CONFIG_NEON
+static bool vfp_state_in_hw(unsigned int cpu, struct thread_info *thread)
+{
+#ifdef CONFIG_SMP
+	if (thread->vfpstate.hard.cpu != cpu)
+		return false;
+#endif
+	return vfp_current_hw_state[cpu] == &thread->vfpstate;
+}
+
+/*
+ * Kernel mode NEON is only allowed outside of interrupt context with
+ * preemption disabled, so the kernel's register contents never need to be
+ * preserved. The task's own state is saved here only if it is actually
+ * live in the hardware; it is then reloaded lazily through the usual
+ * undefined instruction trap the next time the task touches the unit.
+ */
+void kernel_neon_begin(void)
+{
+	struct thread_info *thread = current_thread_info();
+	unsigned int cpu;
+	u32 fpexc;
+
+	BUG_ON(in_interrupt());
+	cpu = get_cpu();
+
+	fpexc = fmrx(FPEXC) | FPEXC_EN;
+	fmxr(FPEXC, fpexc);
+
+	/*
+	 * Save the userland NEON/VFP state. Under UP, the owner could be a
+	 * task other than 'current'.
+	 */
+	if (vfp_state_in_hw(cpu, thread))
+		vfp_save_state(&thread->vfpstate, fpexc);
+#ifndef CONFIG_SMP
+	else if (vfp_current_hw_state[cpu] != NULL)
+		vfp_save_state(vfp_current_hw_state[cpu], fpexc);
+#endif
+	vfp_current_hw_state[cpu] = NULL;
+}
+EXPORT_SYMBOL(kernel_neon_begin);
+
+void kernel_neon_end(void)
+{
+	/* Disable the NEON/VFP unit. */
+	fmxr(FPEXC, fmrx(FPEXC) & ~FPEXC_EN);
+	put_cpu();
+}
+EXPORT_SYMBOL(kernel_neon_end);
+
+/*
+ * Pretend the running thread has live state in d0, clobber it from a
+ * kernel_neon_begin() section and check that the state was saved and the
+ * unit handed back disabled and unowned, so the lazy reload would kick in.
+ */
+static int __init vfp_kernel_neon_selftest(void)
+{
+	static const u32 a[4] __initconst = { 1, 2, 3, 0x7fffffff };
+	static const u32 b[4] __initconst = { 0x10, 0x20, 0x30, 1 };
+	const u64 pattern = 0x0123456789abcdefULL;
+	struct thread_info *thread = current_thread_info();
+	union vfp_state saved = thread->vfpstate;
+	unsigned int cpu;
+	const char *err = NULL;
+	u32 sum[4];
+	int i;
+
+	preempt_disable();
+	cpu = smp_processor_id();
+
+	fmxr(FPEXC, fmrx(FPEXC) | FPEXC_EN);
+	asm volatile(".fpu neon\n\tvmov d0, %Q0, %R0" : : "r" (pattern));
+	vfp_current_hw_state[cpu] = &thread->vfpstate;
+#ifdef CONFIG_SMP
+	thread->vfpstate.hard.cpu = cpu;
+#endif
+
+	kernel_neon_begin();
+	asm volatile(
+	".fpu	neon\n\t"
+	"vld1.32	{d0-d1}, [%1]\n\t"
+	"vld1.32	{d2-d3}, [%2]\n\t"
+	"vadd.i32	q0, q0, q1\n\t"
+	"vst1.32	{d0-d1}, [%0]"
+	: : "r" (sum), "r" (a), "r" (b) : "memory");
+	kernel_neon_end();
+
+	if (fmrx(FPEXC) & FPEXC_EN)
+		err = "unit left enabled";
+	else if (vfp_current_hw_state[cpu])
+		err = "hardware state still owned";
+	else if (thread->vfpstate.hard.fpregs[0] != pattern)
+		err = "task state not saved";
+
+	thread->vfpstate = saved;
+	preempt_enable();
+
+	for (i = 0; !err && i < ARRAY_SIZE(sum); i++)
+		if (sum[i] != a[i] + b[i])
+			err = "wrong result";
+
+	if (err) {
+		printk(KERN_ERR "VFP: kernel mode NEON self-test failed: %s\n",
+		       err);
+		return -EINVAL;
+	}
+	return 0;
+}
+#endif /* CONFIG_NEON */
+
 /*
  * VFP hardware can lose all context when a CPU goes offline.
  * As we will be running in SMP mode with CPU hotplug, we will save the
@@ -608,6 +719,10 @@ static int __init vfp_init(void)
 #ifdef CONFIG_NEON
 			if ((fmrx(MVFR1) & 0x000fff00) == 0x00011100)
 				elf_hwcap |= HWCAP_NEON;
+			/* hide a unit we cannot switch correctly */
+			if ((elf_hwcap & HWCAP_NEON) &&
+			    vfp_kernel_neon_selftest())
+				elf_hwcap &= ~HWCAP_NEON;
 #endif
 			if ((fmrx(MVFR1) & 0xf0000000) == 0x10000000)
 				elf_hwcap |= HWCAP_VFPv4;
@@ -38,105 +38,17 @@
 
 /*
  * runqueue average
+ *
+ * The scheduler keeps a time-weighted average of nr_running for us (see
+ * kernel/sched_avg.c), so there is no sampling timer here any more. On top
+ * of that it tells us from the tick when runqueues back up, and a sample
+ * is taken right away instead of waiting for the next sampling period.
+ * Those burst samples are rate limited to BURST_MIN_RATE (usec) and only
+ * pick a frequency: they are kept out of hotplug_history, so cpu_up_rate
+ * and cpu_down_rate still count regular samples.
  */
 
-#define RQ_AVG_TIMER_RATE	10
-
-struct runqueue_data {
-	unsigned int nr_run_avg;
-	unsigned int update_rate;
-	int64_t last_time;
-	int64_t total_time;
-	struct delayed_work work;
-	struct workqueue_struct *nr_run_wq;
-	spinlock_t lock;
-};
-
-static struct runqueue_data *rq_data;
-static void rq_work_fn(struct work_struct *work);
-
-static void start_rq_work(void)
-{
-	rq_data->nr_run_avg = 0;
-	rq_data->last_time = 0;
-	rq_data->total_time = 0;
-	if (rq_data->nr_run_wq == NULL)
-		rq_data->nr_run_wq =
-			create_singlethread_workqueue("nr_run_avg");
-
-	queue_delayed_work(rq_data->nr_run_wq, &rq_data->work,
-			   msecs_to_jiffies(rq_data->update_rate));
-	return;
-}
-
-static void stop_rq_work(void)
-{
-	if (rq_data->nr_run_wq)
-		cancel_delayed_work(&rq_data->work);
-	return;
-}
-
-static int __init init_rq_avg(void)
-{
-	rq_data = kzalloc(sizeof(struct runqueue_data), GFP_KERNEL);
-	if (rq_data == NULL) {
-		pr_err("%s cannot allocate memory\n", __func__);
-		return -ENOMEM;
-	}
-	spin_lock_init(&rq_data->lock);
-	rq_data->update_rate = RQ_AVG_TIMER_RATE;
-	INIT_DELAYED_WORK_DEFERRABLE(&rq_data->work, rq_work_fn);
-
-	return 0;
-}
-
-static void rq_work_fn(struct work_struct *work)
-{
-	int64_t time_diff = 0;
-	int64_t nr_run = 0;
-	unsigned long flags = 0;
-	int64_t cur_time = ktime_to_ns(ktime_get());
-
-	spin_lock_irqsave(&rq_data->lock, flags);
-
-	if (rq_data->last_time == 0)
-		rq_data->last_time = cur_time;
-	if (rq_data->nr_run_avg == 0)
-		rq_data->total_time = 0;
-
-	nr_run = nr_running() * 100;
-	time_diff = cur_time - rq_data->last_time;
-	do_div(time_diff, 1000 * 1000);
-
-	if (time_diff != 0 && rq_data->total_time != 0) {
-		nr_run = (nr_run * time_diff) +
-			(rq_data->nr_run_avg * rq_data->total_time);
-		do_div(nr_run, rq_data->total_time + time_diff);
-	}
-	rq_data->nr_run_avg = nr_run;
-	rq_data->total_time += time_diff;
-	rq_data->last_time = cur_time;
-
-	if (rq_data->update_rate != 0)
-		queue_delayed_work(rq_data->nr_run_wq, &rq_data->work,
-				   msecs_to_jiffies(rq_data->update_rate));
-
-	spin_unlock_irqrestore(&rq_data->lock, flags);
-}
-
-static unsigned int get_nr_run_avg(void)
-{
-	unsigned int nr_run_avg;
-	unsigned long flags = 0;
-
-	spin_lock_irqsave(&rq_data->lock, flags);
-	nr_run_avg = rq_data->nr_run_avg;
-	rq_data->nr_run_avg = 0;
-	spin_unlock_irqrestore(&rq_data->lock, flags);
-
-	return nr_run_avg;
-}
-
+#define BURST_MIN_RATE		10000
 
 /*
  * dbs is used in this file as a shortform for demandbased switching
@@ -231,9 +143,12 @@ struct cpu_dbs_info_s {
 	struct delayed_work work;
 	struct work_struct up_work;
 	struct work_struct down_work;
+	struct work_struct burst_work;
 	struct cpufreq_frequency_table *freq_table;
 	unsigned int rate_mult;
 	int cpu;
+	/* jiffies of the last dbs_check_cpu(), rate limits burst samples */
+	unsigned long last_sample;
 	/*
 	 * percpu mutex that serializes governor limit change with
 	 * do_dbs_timer invocation. We do not want do_dbs_timer to run
@@ -252,6 +167,9 @@ static unsigned int dbs_enable;	/* number of CPUs using this policy */
  */
 static DEFINE_MUTEX(dbs_mutex);
 
+/* governor instance fed by the scheduler's nr_running notifier */
+static struct cpu_dbs_info_s *rq_avg_dbs_info;
+
 static struct dbs_tuners {
 	unsigned int sampling_rate;
 	unsigned int up_threshold;
@@ -1070,7 +988,7 @@ static int check_down(void)
 	return 0;
 }
 
-static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
+static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info, bool burst)
 {
 	unsigned int max_load_freq;
 
@@ -1087,14 +1005,18 @@ static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 	int load_each[4] = {-1, -1, -1, -1};
 	int rq_avg = 0;
 	policy = this_dbs_info->cur_policy;
+	this_dbs_info->last_sample = jiffies;
 
-	hotplug_history->usage[num_hist].freq = policy->cur;
-	hotplug_history->usage[num_hist].rq_avg = get_nr_run_avg();
+	if (!burst) {
+		hotplug_history->usage[num_hist].freq = policy->cur;
+		hotplug_history->usage[num_hist].rq_avg =
+			sched_get_nr_running_avg();
 
-	/* add total_load, avg_load to get average load */
-	rq_avg = hotplug_history->usage[num_hist].rq_avg;
+		/* add total_load, avg_load to get average load */
+		rq_avg = hotplug_history->usage[num_hist].rq_avg;
 
-	++hotplug_history->num_hist;
+		++hotplug_history->num_hist;
+	}
 
 	/* Get Absolute Load - in terms of freq */
 	max_load_freq = 0;
@@ -1157,7 +1079,8 @@ static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 			load_each[j] = load;
 		total_load += load;
 
-		hotplug_history->usage[num_hist].load[j] = load;
+		if (!burst)
+			hotplug_history->usage[num_hist].load[j] = load;
 
 		freq_avg = __cpufreq_driver_getavg(policy, j);
 		if (freq_avg <= 0)
@@ -1169,19 +1092,21 @@ static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 	}
 	/* calculate the average load across all related CPUs */
 	avg_load = total_load / num_online_cpus();
-	hotplug_history->usage[num_hist].avg_load = avg_load;
 
+	if (!burst) {
+		hotplug_history->usage[num_hist].avg_load = avg_load;
 
-	/* Check for CPU hotplug */
-	if (check_up()) {
-		queue_work_on(this_dbs_info->cpu, dvfs_workqueue,
-			      &this_dbs_info->up_work);
-	} else if (check_down()) {
-		queue_work_on(this_dbs_info->cpu, dvfs_workqueue,
-			      &this_dbs_info->down_work);
+		/* Check for CPU hotplug */
+		if (check_up()) {
+			queue_work_on(this_dbs_info->cpu, dvfs_workqueue,
+				      &this_dbs_info->up_work);
+		} else if (check_down()) {
+			queue_work_on(this_dbs_info->cpu, dvfs_workqueue,
+				      &this_dbs_info->down_work);
+		}
+		if (hotplug_history->num_hist  == max_hotplug_rate)
+			hotplug_history->num_hist = 0;
 	}
-	if (hotplug_history->num_hist  == max_hotplug_rate)
-		hotplug_history->num_hist = 0;
 
 	/* Check for frequency increase */
 	if (policy->cur < FREQ_FOR_RESPONSIVENESS)
@@ -1269,7 +1194,7 @@ static void do_dbs_timer(struct work_struct *work)
 
 	mutex_lock(&dbs_info->timer_mutex);
 
-	dbs_check_cpu(dbs_info);
+	dbs_check_cpu(dbs_info, false);
 	/* We want all CPUs to do sampling nearly on
 	 * same jiffy
 	 */
@@ -1283,6 +1208,19 @@ static void do_dbs_timer(struct work_struct *work)
 	mutex_unlock(&dbs_info->timer_mutex);
 }
 
+static void do_dbs_burst(struct work_struct *work)
+{
+	struct cpu_dbs_info_s *dbs_info =
+		container_of(work, struct cpu_dbs_info_s, burst_work);
+
+	mutex_lock(&dbs_info->timer_mutex);
+	/* the regular timer may have beaten us to it */
+	if (time_after_eq(jiffies, dbs_info->last_sample +
+			  usecs_to_jiffies(BURST_MIN_RATE)))
+		dbs_check_cpu(dbs_info, true);
+	mutex_unlock(&dbs_info->timer_mutex);
+}
+
 static inline void dbs_timer_init(struct cpu_dbs_info_s *dbs_info)
 {
 	/* We want all CPUs to do sampling nearly on same jiffy */
@@ -1294,6 +1232,8 @@ static inline void dbs_timer_init(struct cpu_dbs_info_s *dbs_info)
 	INIT_DELAYED_WORK_DEFERRABLE(&dbs_info->work, do_dbs_timer);
 	INIT_WORK(&dbs_info->up_work, cpu_up_work);
 	INIT_WORK(&dbs_info->down_work, cpu_down_work);
+	INIT_WORK(&dbs_info->burst_work, do_dbs_burst);
+	dbs_info->last_sample = jiffies;
 
 	queue_delayed_work_on(dbs_info->cpu, dvfs_workqueue,
 			      &dbs_info->work, delay + 2 * HZ);
@@ -1304,6 +1244,71 @@ static inline void dbs_timer_exit(struct cpu_dbs_info_s *dbs_info)
 	cancel_delayed_work_sync(&dbs_info->work);
 	cancel_work_sync(&dbs_info->up_work);
 	cancel_work_sync(&dbs_info->down_work);
+	cancel_work_sync(&dbs_info->burst_work);
+}
+
+/*
+ * Runs from the scheduler tick, in hard interrupt context, whenever a cpu
+ * has tasks waiting behind the running one.
+ */
+static int nr_running_notifier_call(struct notifier_block *this,
+				    unsigned long nr_running, void *v)
+{
+	struct cpu_dbs_info_s *dbs_info = rq_avg_dbs_info;
+	struct cpufreq_policy *policy;
+
+	if (!dbs_info)
+		return NOTIFY_DONE;
+
+	if (time_before(jiffies, dbs_info->last_sample +
+			usecs_to_jiffies(BURST_MIN_RATE)))
+		return NOTIFY_DONE;
+
+	/* nothing left to ramp up */
+	policy = dbs_info->cur_policy;
+	if (policy->cur >= policy->max &&
+	    num_online_cpus() >= num_possible_cpus())
+		return NOTIFY_DONE;
+
+	queue_work_on(dbs_info->cpu, dvfs_workqueue, &dbs_info->burst_work);
+	return NOTIFY_OK;
+}
+
+static struct notifier_block nr_running_notifier = {
+	.notifier_call = nr_running_notifier_call,
+};
+
+/*
+ * rq_avg_dbs_info is protected by dbs_mutex, the notifier only reads it
+ * while registered.
+ */
+static void start_rq_work(struct cpu_dbs_info_s *dbs_info)
+{
+	mutex_lock(&dbs_mutex);
+	if (!rq_avg_dbs_info && dbs_info) {
+		/* start a fresh averaging window */
+		sched_get_nr_running_avg();
+		rq_avg_dbs_info = dbs_info;
+		register_sched_nr_running_notifier(&nr_running_notifier);
+	}
+	mutex_unlock(&dbs_mutex);
+}
+
+static void stop_rq_work(void)
+{
+	struct cpu_dbs_info_s *dbs_info;
+
+	mutex_lock(&dbs_mutex);
+	dbs_info = rq_avg_dbs_info;
+	if (dbs_info) {
+		/* waits for running notifier calls to finish */
+		unregister_sched_nr_running_notifier(&nr_running_notifier);
+		rq_avg_dbs_info = NULL;
+	}
+	mutex_unlock(&dbs_mutex);
+
+	if (dbs_info)
+		cancel_work_sync(&dbs_info->burst_work);
 }
 
 static int pm_notifier_call(struct notifier_block *this,
@@ -1346,6 +1351,7 @@ static struct notifier_block reboot_notifier = {
 
 #ifdef CONFIG_HAS_EARLYSUSPEND
 static struct early_suspend early_suspend;
+static struct cpu_dbs_info_s *rq_avg_suspended;
 unsigned int prev_freq_step;
 unsigned int prev_sampling_rate;
 static void cpufreq_pegasusq_early_suspend(struct early_suspend *h)
@@ -1362,6 +1368,7 @@ static void cpufreq_pegasusq_early_suspend(struct early_suspend *h)
 	atomic_set(&g_hotplug_lock,
 	    (dbs_tuners_ins.min_cpu_lock) ? dbs_tuners_ins.min_cpu_lock : 1);
 	apply_hotplug_lock();
+	rq_avg_suspended = rq_avg_dbs_info;
 	stop_rq_work();
 #endif
 }
@@ -1375,7 +1382,8 @@ static void cpufreq_pegasusq_late_resume(struct early_suspend *h)
 	dbs_tuners_ins.sampling_rate = prev_sampling_rate;
 #if EARLYSUSPEND_HOTPLUGLOCK
 	apply_hotplug_lock();
-	start_rq_work();
+	start_rq_work(rq_avg_suspended);
+	rq_avg_suspended = NULL;
 #endif
 }
 #endif
@@ -1398,7 +1406,6 @@ static int cpufreq_governor_dbs(struct cpufreq_policy *policy,
 		dbs_tuners_ins.max_freq = policy->max;
 		dbs_tuners_ins.min_freq = policy->min;
 		hotplug_history->num_hist = 0;
-		start_rq_work();
 
 		mutex_lock(&dbs_mutex);
 
@@ -1439,6 +1446,7 @@ static int cpufreq_governor_dbs(struct cpufreq_policy *policy,
 
 		mutex_init(&this_dbs_info->timer_mutex);
 		dbs_timer_init(this_dbs_info);
+		start_rq_work(this_dbs_info);
 
 #if !EARLYSUSPEND_HOTPLUGLOCK
 		register_pm_notifier(&pm_notifier);
@@ -1456,6 +1464,7 @@ static int cpufreq_governor_dbs(struct cpufreq_policy *policy,
 		unregister_pm_notifier(&pm_notifier);
 #endif
 
+		stop_rq_work();
 		dbs_timer_exit(this_dbs_info);
 
 		mutex_lock(&dbs_mutex);
@@ -1466,8 +1475,6 @@ static int cpufreq_governor_dbs(struct cpufreq_policy *policy,
 		dbs_enable--;
 		mutex_unlock(&dbs_mutex);
 
-		stop_rq_work();
-
 		if (!dbs_enable)
 			sysfs_remove_group(cpufreq_global_kobject,
 					   &dbs_attr_group);
@@ -1496,15 +1503,10 @@ static int __init cpufreq_gov_dbs_init(void)
 {
 	int ret;
 
-	ret = init_rq_avg();
-	if (ret)
-		return ret;
-
 	hotplug_history = kzalloc(sizeof(struct cpu_usage_history), GFP_KERNEL);
 	if (!hotplug_history) {
 		pr_err("%s cannot create hotplug history array\n", __func__);
-		ret = -ENOMEM;
-		goto err_hist;
+		return -ENOMEM;
 	}
 
 	dvfs_workqueue = create_workqueue("kpegasusq");
@@ -1530,8 +1532,6 @@ err_reg:
 	destroy_workqueue(dvfs_workqueue);
 err_queue:
 	kfree(hotplug_history);
-err_hist:
-	kfree(rq_data);
 	return ret;
 }
 
@@ -1540,7 +1540,6 @@ static void __exit cpufreq_gov_dbs_exit(void)
 	cpufreq_unregister_governor(&cpufreq_gov_pegasusq);
 	destroy_workqueue(dvfs_workqueue);
 	kfree(hotplug_history);
-	kfree(rq_data);
 }
 
 MODULE_AUTHOR("ByungChang Cha <bc.cha@samsung.com>");
@@ -400,6 +400,7 @@ static struct ion_heap *ion_exynos_heap_create(struct ion_platform_heap *unused)
 		return ERR_PTR(-ENOMEM);
 	heap->ops = &vmheap_ops;
 	heap->type = ION_HEAP_TYPE_EXYNOS;
+	heap->flags = ION_HEAP_FLAG_DEFER_FREE;
 	return heap;
 }
 
@@ -1075,6 +1076,8 @@ void __ion_heap_destroy(struct ion_heap *heap)
 	if (!heap)
 		return;
 
+	ion_heap_drain_freelist(heap);
+
 	switch (heap->type) {
 	case ION_HEAP_TYPE_EXYNOS:
 		ion_exynos_heap_destroy(heap);
@@ -59,7 +59,8 @@ struct ion_device {
  * @node:		node in the tree of all clients
  * @dev:		backpointer to ion device
  * @handles:		an rb tree of all the handles in this client
- * @lock:		lock protecting the tree of handles
+ * @buffer_handles:	the same handles, indexed by the buffer they refer to
+ * @lock:		lock protecting the trees of handles
  * @heap_mask:		mask of all supported heaps
  * @name:		used for debugging
  * @task:		used for debugging
@@ -73,6 +74,7 @@ struct ion_client {
 	struct rb_node node;
 	struct ion_device *dev;
 	struct rb_root handles;
+	struct rb_root buffer_handles;
 	struct mutex lock;
 	unsigned int heap_mask;
 	const char *name;
@@ -87,6 +89,7 @@ struct ion_client {
  * @client:		back pointer to the client the buffer resides in
  * @buffer:		pointer to the buffer
  * @node:		node in the client's handle rbtree
+ * @buffer_node:	node in the client's buffer_handles rbtree
  * @kmap_cnt:		count of times this client has mapped to kernel
  * @dmap_cnt:		count of times this client has mapped for dma
  * @usermap_cnt:	count of times this client has mapped for userspace
@@ -99,6 +102,7 @@ struct ion_handle {
 	struct ion_client *client;
 	struct ion_buffer *buffer;
 	struct rb_node node;
+	struct rb_node buffer_node;
 	unsigned int kmap_cnt;
 	unsigned int dmap_cnt;
 	unsigned int usermap_cnt;
@@ -159,11 +163,8 @@ static struct ion_buffer *ion_buffer_create(struct ion_heap *heap,
 	return buffer;
 }
 
-static void ion_buffer_destroy(struct kref *kref)
+static void _ion_buffer_destroy(struct ion_buffer *buffer)
 {
-	struct ion_buffer *buffer = container_of(kref, struct ion_buffer, ref);
-	struct ion_device *dev = buffer->dev;
-
 	if (WARN_ON(buffer->kmap_cnt > 0))
 		buffer->heap->ops->unmap_kernel(buffer->heap, buffer);
 
@@ -171,10 +172,56 @@ static void ion_buffer_destroy(struct kref *kref)
 		buffer->heap->ops->unmap_dma(buffer->heap, buffer);
 
 	buffer->heap->ops->free(buffer);
+	kfree(buffer);
+}
+
+static void ion_buffer_destroy(struct kref *kref)
+{
+	struct ion_buffer *buffer = container_of(kref, struct ion_buffer, ref);
+	struct ion_heap *heap = buffer->heap;
+	struct ion_device *dev = buffer->dev;
+
 	mutex_lock(&dev->lock);
 	rb_erase(&buffer->node, &dev->buffers);
 	mutex_unlock(&dev->lock);
-	kfree(buffer);
+
+	if (heap->flags & ION_HEAP_FLAG_DEFER_FREE) {
+		spin_lock(&heap->free_lock);
+		list_add_tail(&buffer->list, &heap->free_list);
+		heap->free_list_size += buffer->size;
+		spin_unlock(&heap->free_lock);
+		schedule_work(&heap->free_work);
+		return;
+	}
+
+	_ion_buffer_destroy(buffer);
+}
+
+static void ion_heap_deferred_free(struct work_struct *work)
+{
+	struct ion_heap *heap = container_of(work, struct ion_heap, free_work);
+	struct ion_buffer *buffer;
+
+	while (1) {
+		spin_lock(&heap->free_lock);
+		if (list_empty(&heap->free_list)) {
+			spin_unlock(&heap->free_lock);
+			break;
+		}
+		buffer = list_first_entry(&heap->free_list, struct ion_buffer,
+					  list);
+		list_del(&buffer->list);
+		heap->free_list_size -= buffer->size;
+		spin_unlock(&heap->free_lock);
+
+		_ion_buffer_destroy(buffer);
+	}
+}
+
+void ion_heap_drain_freelist(struct ion_heap *heap)
+{
+	if (heap->flags & ION_HEAP_FLAG_DEFER_FREE)
+		flush_work_sync(&heap->free_work);
 }
 
 static void ion_buffer_get(struct ion_buffer *buffer)
@@ -197,6 +244,7 @@ static struct ion_handle *ion_handle_create(struct ion_client *client,
 		return ERR_PTR(-ENOMEM);
 	kref_init(&handle->ref);
 	rb_init_node(&handle->node);
+	rb_init_node(&handle->buffer_node);
 	handle->client = client;
 	ion_buffer_get(buffer);
 	handle->buffer = buffer;
@@ -212,8 +260,10 @@ static void ion_handle_destroy(struct kref *kref)
 	 */
 	ion_buffer_put(handle->buffer);
 	mutex_lock(&handle->client->lock);
-	if (!RB_EMPTY_NODE(&handle->node))
+	if (!RB_EMPTY_NODE(&handle->node)) {
 		rb_erase(&handle->node, &handle->client->handles);
+		rb_erase(&handle->buffer_node, &handle->client->buffer_handles);
+	}
 	mutex_unlock(&handle->client->lock);
 	kfree(handle);
 }
@@ -233,15 +283,20 @@ static int ion_handle_put(struct ion_handle *handle)
 	return kref_put(&handle->ref, ion_handle_destroy);
 }
 
+/* this function should only be called while client->lock is held */
 static struct ion_handle *ion_handle_lookup(struct ion_client *client,
 					    struct ion_buffer *buffer)
 {
-	struct rb_node *n;
+	struct rb_node *n = client->buffer_handles.rb_node;
 
-	for (n = rb_first(&client->handles); n; n = rb_next(n)) {
+	while (n) {
 		struct ion_handle *handle = rb_entry(n, struct ion_handle,
-						     node);
-		if (handle->buffer == buffer)
+						     buffer_node);
+		if (buffer < handle->buffer)
+			n = n->rb_left;
+		else if (buffer > handle->buffer)
+			n = n->rb_right;
+		else
 			return handle;
 	}
 	return NULL;
@@ -284,6 +339,25 @@ static void ion_handle_add(struct ion_client *client, struct ion_handle *handle)
 
 	rb_link_node(&handle->node, parent, p);
 	rb_insert_color(&handle->node, &client->handles);
+
+	/*
+	 * A client may hold several handles to one buffer (ion_alloc never
+	 * looks for an existing one), equal keys go to the right.
+	 */
+	p = &client->buffer_handles.rb_node;
+	parent = NULL;
+	while (*p) {
+		parent = *p;
+		entry = rb_entry(parent, struct ion_handle, buffer_node);
+
+		if (handle->buffer < entry->buffer)
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+
+	rb_link_node(&handle->buffer_node, parent, p);
+	rb_insert_color(&handle->buffer_node, &client->buffer_handles);
 }
 
 struct ion_handle *ion_alloc(struct ion_client *client, size_t len,
@@ -823,6 +897,7 @@ struct ion_client *ion_client_create(struct ion_device *dev,
 
 	client->dev = dev;
 	client->handles = RB_ROOT;
+	client->buffer_handles = RB_ROOT;
 	mutex_init(&client->lock);
 	client->name = name;
 	client->heap_mask = heap_mask;
@@ -1285,6 +1360,11 @@ static int ion_debug_heap_show(struct seq_file *s, void *unused)
 		seq_printf(s, "%16.s %16u %16u\n", client->name, client->pid,
 			   size);
 	}
+	if (heap->flags & ION_HEAP_FLAG_DEFER_FREE)
+		seq_printf(s, "%16.s %16u\n", "deferred free",
+			   heap->free_list_size);
+	if (heap->debug_show)
+		heap->debug_show(heap, s, unused);
 	return 0;
 }
 
@@ -1307,6 +1387,12 @@ void ion_device_add_heap(struct ion_device *dev, struct ion_heap *heap)
 	struct ion_heap *entry;
 
 	heap->dev = dev;
+	if (heap->flags & ION_HEAP_FLAG_DEFER_FREE) {
+		INIT_LIST_HEAD(&heap->free_list);
+		heap->free_list_size = 0;
+		spin_lock_init(&heap->free_lock);
+		INIT_WORK(&heap->free_work, ion_heap_deferred_free);
+	}
 	mutex_lock(&dev->lock);
 	while (*p) {
 		parent = *p;
@@ -0,0 +1,222 @@
+/*
+ * drivers/gpu/ion/ion_page_pool.c
+ *
+ * Copyright (C) 2011 Google, Inc.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <linux/highmem.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <asm/cacheflush.h>
+#include <asm/outercache.h>
+#include "ion_priv.h"
+
+/*
+ * Pages are handed to devices as well as mapped cached into the kernel and
+ * userspace, so the zeroes must not be left dirty in the cpu caches where
+ * they could later be written back over whatever a device put there.
+ */
+static void ion_page_pool_zero(struct ion_page_pool *pool, struct page *page)
+{
+	phys_addr_t phys = page_to_phys(page);
+	int i;
+
+	for (i = 0; i < (1 << pool->order); i++) {
+		void *addr = kmap_atomic(page + i, KM_USER0);
+
+		clear_page(addr);
+		dmac_flush_range(addr, addr + PAGE_SIZE);
+		kunmap_atomic(addr, KM_USER0);
+	}
+	outer_flush_range(phys, phys + (PAGE_SIZE << pool->order));
+}
+
+/* caller must hold pool->lock and make sure the list is not empty */
+static struct page *ion_page_pool_remove(struct ion_page_pool *pool,
+					 bool clean)
+{
+	struct page *page;
+
+	if (clean) {
+		page = list_first_entry(&pool->clean, struct page, lru);
+		pool->clean_count--;
+	} else {
+		page = list_first_entry(&pool->dirty, struct page, lru);
+		pool->dirty_count--;
+	}
+	list_del(&page->lru);
+	return page;
+}
+
+/**
+ * ion_page_pool_alloc - get a zeroed page of pool->order
+ *
+ * Pages zeroed by ion_page_pool_zero_dirty() are preferred; a dirty page is
+ * zeroed here, which still beats the page allocator for the higher orders.
+ * Only when the pool is empty is a new page allocated with pool->gfp_mask.
+ */
+struct page *ion_page_pool_alloc(struct ion_page_pool *pool)
+{
+	struct page *page = NULL;
+	bool zero = true;
+
+	spin_lock(&pool->lock);
+	if (pool->clean_count) {
+		page = ion_page_pool_remove(pool, true);
+		pool->clean_hits++;
+		zero = false;
+	} else if (pool->dirty_count) {
+		page = ion_page_pool_remove(pool, false);
+		pool->dirty_hits++;
+	} else {
+		pool->misses++;
+	}
+	spin_unlock(&pool->lock);
+
+	if (!page) {
+		page = alloc_pages(pool->gfp_mask, pool->order);
+		if (!page)
+			return NULL;
+	}
+	if (zero)
+		ion_page_pool_zero(pool, page);
+
+	return page;
+}
+
+/**
+ * ion_page_pool_free - return a page to the pool
+ *
+ * The page is queued as dirty; the caller is expected to kick
+ * ion_page_pool_zero_dirty() from a worker.
+ */
+void ion_page_pool_free(struct ion_page_pool *pool, struct page *page)
+{
+	spin_lock(&pool->lock);
+	list_add_tail(&page->lru, &pool->dirty);
+	pool->dirty_count++;
+	spin_unlock(&pool->lock);
+}
+
+/**
+ * ion_page_pool_zero_dirty - zero every dirty page in the pool
+ *
+ * Meant to run from a worker, off the allocation path. Pages are zeroed
+ * one at a time without the lock held, so allocations and the shrinker
+ * are never held up behind it.
+ */
+void ion_page_pool_zero_dirty(struct ion_page_pool *pool)
+{
+	struct page *page;
+
+	while (1) {
+		spin_lock(&pool->lock);
+		if (!pool->dirty_count) {
+			spin_unlock(&pool->lock);
+			break;
+		}
+		page = ion_page_pool_remove(pool, false);
+		spin_unlock(&pool->lock);
+
+		ion_page_pool_zero(pool, page);
+
+		spin_lock(&pool->lock);
+		list_add_tail(&page->lru, &pool->clean);
+		pool->clean_count++;
+		spin_unlock(&pool->lock);
+
+		cond_resched();
+	}
+}
+
+/**
+ * ion_page_pool_total - number of order-0 pages held by the pool
+ */
+int ion_page_pool_total(struct ion_page_pool *pool)
+{
+	int count;
+
+	spin_lock(&pool->lock);
+	count = pool->clean_count + pool->dirty_count;
+	spin_unlock(&pool->lock);
+
+	return count << pool->order;
+}
+
+/**
+ * ion_page_pool_shrink - give pages back to the page allocator
+ * @nr_to_scan:		number of order-0 pages to free
+ *
+ * Dirty pages go first, nobody has paid for zeroing them yet. Returns the
+ * number of order-0 pages freed, which may overshoot nr_to_scan by up to
+ * one pool page.
+ */
+int ion_page_pool_shrink(struct ion_page_pool *pool, int nr_to_scan)
+{
+	int freed = 0;
+
+	while (freed < nr_to_scan) {
+		struct page *page;
+
+		spin_lock(&pool->lock);
+		if (pool->dirty_count) {
+			page = ion_page_pool_remove(pool, false);
+		} else if (pool->clean_count) {
+			page = ion_page_pool_remove(pool, true);
+		} else {
+			spin_unlock(&pool->lock);
+			break;
+		}
+		spin_unlock(&pool->lock);
+
+		__free_pages(page, pool->order);
+		freed += 1 << pool->order;
+	}
+
+	return freed;
+}
+
+void ion_page_pool_debug_show(struct ion_page_pool *pool, struct seq_file *s)
+{
+	spin_lock(&pool->lock);
+	seq_printf(s, "order %2u: %6d clean %6d dirty, %8lu clean hits "
+		   "%8lu dirty hits %8lu misses\n", pool->order,
+		   pool->clean_count, pool->dirty_count, pool->clean_hits,
+		   pool->dirty_hits, pool->misses);
+	spin_unlock(&pool->lock);
+}
+
+struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order)
+{
+	struct ion_page_pool *pool;
+
+	pool = kzalloc(sizeof(struct ion_page_pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+	INIT_LIST_HEAD(&pool->clean);
+	INIT_LIST_HEAD(&pool->dirty);
+	spin_lock_init(&pool->lock);
+	pool->gfp_mask = gfp_mask;
+	pool->order = order;
+	return pool;
+}
+
+void ion_page_pool_destroy(struct ion_page_pool *pool)
+{
+	ion_page_pool_shrink(pool, INT_MAX);
+	kfree(pool);
+}
@@ -0,0 +1,347 @@
+/*
+ * drivers/gpu/ion/ion_page_pool_heap.c
+ *
+ * Copyright (C) 2011 Google, Inc.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <linux/err.h>
+#include <linux/ion.h>
+#include <linux/mm.h>
+#include <linux/scatterlist.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+#include "ion_priv.h"
+
+/*
+ * Buffers are built from the largest chunks available, 1MB and 64KB chunks
+ * keep the IOMMU and TLB footprint of large camera and video buffers down.
+ */
+static const unsigned int orders[] = {8, 4, 0};
+#define NUM_ORDERS ARRAY_SIZE(orders)
+
+struct ion_page_pool_heap {
+	struct ion_heap heap;
+	struct ion_page_pool *pools[NUM_ORDERS];
+	struct work_struct zero_work;
+	struct shrinker shrinker;
+};
+
+static int order_to_index(unsigned int order)
+{
+	int i;
+
+	for (i = 0; i < NUM_ORDERS; i++)
+		if (order == orders[i])
+			return i;
+	BUG();
+	return -1;
+}
+
+static struct page *alloc_largest_available(struct ion_page_pool_heap *heap,
+					    unsigned long size,
+					    unsigned int max_order)
+{
+	struct page *page;
+	int i;
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		if (size < (PAGE_SIZE << orders[i]))
+			continue;
+		if (max_order < orders[i])
+			continue;
+
+		page = ion_page_pool_alloc(heap->pools[i]);
+		if (!page)
+			continue;
+		return page;
+	}
+	return NULL;
+}
+
+static void ion_page_pool_heap_free_page(struct ion_page_pool_heap *heap,
+					 struct page *page)
+{
+	int i = order_to_index(compound_order(page));
+
+	ion_page_pool_free(heap->pools[i], page);
+}
+
+static int ion_page_pool_heap_allocate(struct ion_heap *heap,
+				       struct ion_buffer *buffer,
+				       unsigned long size, unsigned long align,
+				       unsigned long flags)
+{
+	struct ion_page_pool_heap *pool_heap =
+		container_of(heap, struct ion_page_pool_heap, heap);
+	struct sg_table *sgtable;
+	struct scatterlist *sg;
+	struct list_head pages;
+	struct page *page, *tmp;
+	unsigned long size_remaining = PAGE_ALIGN(size);
+	unsigned int max_order = orders[0];
+	int nents = 0;
+
+	INIT_LIST_HEAD(&pages);
+	while (size_remaining > 0) {
+		page = alloc_largest_available(pool_heap, size_remaining,
+					       max_order);
+		if (!page)
+			goto err;
+		list_add_tail(&page->lru, &pages);
+		size_remaining -= PAGE_SIZE << compound_order(page);
+		/* don't retry orders that already failed */
+		max_order = compound_order(page);
+		nents++;
+	}
+
+	sgtable = kmalloc(sizeof(struct sg_table), GFP_KERNEL);
+	if (!sgtable)
+		goto err;
+
+	if (sg_alloc_table(sgtable, nents, GFP_KERNEL))
+		goto err_free_sgtable;
+
+	sg = sgtable->sgl;
+	list_for_each_entry_safe(page, tmp, &pages, lru) {
+		sg_set_page(sg, page, PAGE_SIZE << compound_order(page), 0);
+		sg = sg_next(sg);
+		list_del(&page->lru);
+	}
+
+	buffer->priv_virt = sgtable;
+	return 0;
+
+err_free_sgtable:
+	kfree(sgtable);
+err:
+	list_for_each_entry_safe(page, tmp, &pages, lru) {
+		list_del(&page->lru);
+		ion_page_pool_heap_free_page(pool_heap, page);
+	}
+	schedule_work(&pool_heap->zero_work);
+	return -ENOMEM;
+}
+
+static void ion_page_pool_heap_free(struct ion_buffer *buffer)
+{
+	struct ion_page_pool_heap *pool_heap =
+		container_of(buffer->heap, struct ion_page_pool_heap, heap);
+	struct sg_table *sgtable = buffer->priv_virt;
+	struct scatterlist *sg;
+	int i;
+
+	for_each_sg(sgtable->sgl, sg, sgtable->nents, i)
+		ion_page_pool_heap_free_page(pool_heap, sg_page(sg));
+
+	sg_free_table(sgtable);
+	kfree(sgtable);
+
+	schedule_work(&pool_heap->zero_work);
+}
+
+static struct scatterlist *ion_page_pool_heap_map_dma(struct ion_heap *heap,
+						      struct ion_buffer *buffer)
+{
+	return ((struct sg_table *)buffer->priv_virt)->sgl;
+}
+
+static void ion_page_pool_heap_unmap_dma(struct ion_heap *heap,
+					 struct ion_buffer *buffer)
+{
+}
+
+static void *ion_page_pool_heap_map_kernel(struct ion_heap *heap,
+					   struct ion_buffer *buffer)
+{
+	struct sg_table *sgtable = buffer->priv_virt;
+	int npages = PAGE_ALIGN(buffer->size) / PAGE_SIZE;
+	struct page **pages, **tmp;
+	struct scatterlist *sg;
+	void *vaddr;
+	int i, j;
+
+	pages = vmalloc(sizeof(struct page *) * npages);
+	if (!pages)
+		return ERR_PTR(-ENOMEM);
+
+	tmp = pages;
+	for_each_sg(sgtable->sgl, sg, sgtable->nents, i) {
+		struct page *page = sg_page(sg);
+
+		for (j = 0; j < sg->length / PAGE_SIZE; j++)
+			*(tmp++) = page++;
+	}
+
+	vaddr = vmap(pages, npages, VM_MAP, PAGE_KERNEL);
+	vfree(pages);
+
+	return vaddr ? vaddr : ERR_PTR(-ENOMEM);
+}
+
+static void ion_page_pool_heap_unmap_kernel(struct ion_heap *heap,
+					    struct ion_buffer *buffer)
+{
+	vunmap(buffer->vaddr);
+}
+
+static int ion_page_pool_heap_map_user(struct ion_heap *heap,
+				       struct ion_buffer *buffer,
+				       struct vm_area_struct *vma)
+{
+	struct sg_table *sgtable = buffer->priv_virt;
+	unsigned long addr = vma->vm_start;
+	unsigned long offset = vma->vm_pgoff;
+	struct scatterlist *sg;
+	int i;
+
+	vma->vm_flags |= VM_RESERVED;
+
+	for_each_sg(sgtable->sgl, sg, sgtable->nents, i) {
+		unsigned long npages = sg->length / PAGE_SIZE;
+		struct page *page = sg_page(sg);
+		unsigned long j;
+
+		if (offset >= npages) {
+			offset -= npages;
+			continue;
+		}
+
+		for (j = offset; j < npages && addr < vma->vm_end; j++) {
+			int ret = vm_insert_page(vma, addr, page + j);
+
+			if (ret)
+				return ret;
+			addr += PAGE_SIZE;
+		}
+		offset = 0;
+
+		if (addr >= vma->vm_end)
+			break;
+	}
+	return 0;
+}
+
+static struct ion_heap_ops page_pool_ops = {
+	.allocate = ion_page_pool_heap_allocate,
+	.free = ion_page_pool_heap_free,
+	.map_dma = ion_page_pool_heap_map_dma,
+	.unmap_dma = ion_page_pool_heap_unmap_dma,
+	.map_kernel = ion_page_pool_heap_map_kernel,
+	.unmap_kernel = ion_page_pool_heap_unmap_kernel,
+	.map_user = ion_page_pool_heap_map_user,
+};
+
+static void ion_page_pool_heap_zero_work(struct work_struct *work)
+{
+	struct ion_page_pool_heap *pool_heap =
+		container_of(work, struct ion_page_pool_heap, zero_work);
+	int i;
+
+	for (i = 0; i < NUM_ORDERS; i++)
+		ion_page_pool_zero_dirty(pool_heap->pools[i]);
+}
+
+/*
+ * Counts and frees in units of order-0 pages, highest orders first: a
+ * freed 1MB block helps a stalled high-order allocation more than 256
+ * scattered pages would.
+ */
+static int ion_page_pool_heap_shrink(struct shrinker *shrinker,
+				     struct shrink_control *sc)
+{
+	struct ion_page_pool_heap *pool_heap =
+		container_of(shrinker, struct ion_page_pool_heap, shrinker);
+	int nr_to_scan = sc->nr_to_scan;
+	int nr_total = 0;
+	int i;
+
+	for (i = 0; nr_to_scan > 0 && i < NUM_ORDERS; i++)
+		nr_to_scan -= ion_page_pool_shrink(pool_heap->pools[i],
+						   nr_to_scan);
+
+	for (i = 0; i < NUM_ORDERS; i++)
+		nr_total += ion_page_pool_total(pool_heap->pools[i]);
+
+	return nr_total;
+}
+
+static int ion_page_pool_heap_debug_show(struct ion_heap *heap,
+					 struct seq_file *s, void *unused)
+{
+	struct ion_page_pool_heap *pool_heap =
+		container_of(heap, struct ion_page_pool_heap, heap);
+	unsigned long total = 0;
+	int i;
+
+	seq_printf(s, "\npage pools:\n");
+	for (i = 0; i < NUM_ORDERS; i++) {
+		ion_page_pool_debug_show(pool_heap->pools[i], s);
+		total += ion_page_pool_total(pool_heap->pools[i]);
+	}
+	seq_printf(s, "total pooled: %lu kB\n", total << (PAGE_SHIFT - 10));
+	return 0;
+}
+
+struct ion_heap *ion_page_pool_heap_create(struct ion_platform_heap *unused)
+{
+	struct ion_page_pool_heap *pool_heap;
+	int i;
+
+	pool_heap = kzalloc(sizeof(struct ion_page_pool_heap), GFP_KERNEL);
+	if (!pool_heap)
+		return ERR_PTR(-ENOMEM);
+	pool_heap->heap.ops = &page_pool_ops;
+	pool_heap->heap.type = ION_HEAP_TYPE_PAGE_POOL;
+	pool_heap->heap.debug_show = ion_page_pool_heap_debug_show;
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		gfp_t gfp_flags = GFP_HIGHUSER | __GFP_NOWARN | __GFP_COMP;
+
+		/* high orders are opportunistic, don't reclaim for them */
+		if (orders[i] > 0)
+			gfp_flags = (gfp_flags | __GFP_NORETRY) & ~__GFP_WAIT;
+
+		pool_heap->pools[i] = ion_page_pool_create(gfp_flags,
+							   orders[i]);
+		if (!pool_heap->pools[i])
+			goto err;
+	}
+
+	INIT_WORK(&pool_heap->zero_work, ion_page_pool_heap_zero_work);
+	pool_heap->shrinker.shrink = ion_page_pool_heap_shrink;
+	pool_heap->shrinker.seeks = DEFAULT_SEEKS;
+	register_shrinker(&pool_heap->shrinker);
+
+	return &pool_heap->heap;
+err:
+	for (i = 0; i < NUM_ORDERS; i++)
+		if (pool_heap->pools[i])
+			ion_page_pool_destroy(pool_heap->pools[i]);
+	kfree(pool_heap);
+	return ERR_PTR(-ENOMEM);
+}
+
+void ion_page_pool_heap_destroy(struct ion_heap *heap)
+{
+	struct ion_page_pool_heap *pool_heap =
+		container_of(heap, struct ion_page_pool_heap, heap);
+	int i;
+
+	unregister_shrinker(&pool_heap->shrinker);
+	cancel_work_sync(&pool_heap->zero_work);
+	for (i = 0; i < NUM_ORDERS; i++)
+		ion_page_pool_destroy(pool_heap->pools[i]);
+	kfree(pool_heap);
+}
@@ -21,9 +21,12 @@
 #include <linux/mm_types.h>
 #include <linux/mutex.h>
 #include <linux/rbtree.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
 #include <linux/ion.h>
 
 struct ion_mapping;
+struct seq_file;
 
 struct ion_dma_mapping {
 	struct kref ref;
@@ -54,6 +57,7 @@ struct ion_buffer *ion_handle_buffer(struct ion_handle *handle);
  * @vaddr:		the kenrel mapping if kmap_cnt is not zero
  * @dmap_cnt:		number of times the buffer is mapped for dma
  * @sglist:		the scatterlist for the buffer is dmap_cnt is not zero
+ * @list:		entry in the heap's deferred free list
 */
 struct ion_buffer {
 	struct kref ref;
@@ -71,6 +75,7 @@ struct ion_buffer {
 	void *vaddr;
 	int dmap_cnt;
 	struct scatterlist *sglist;
+	struct list_head list;
 };
 
 /**
@@ -111,6 +116,13 @@ struct ion_heap_ops {
  *			allocating.  These are specified by platform data and
  *			MUST be unique
  * @name:		used for debugging
+ * @debug_show:		called when the heap debug file is read to add any
+ *			heap specific debug info to the output
+ * @flags:		ION_HEAP_FLAG_* set by the heap's create function
+ * @free_list:		buffers waiting to be freed, if deferred free is on
+ * @free_list_size:	total size of the buffers on free_list
+ * @free_lock:		protects free_list and free_list_size
+ * @free_work:		frees the buffers on free_list
  *
  * Represents a pool of memory from which buffers can be made.  In some
  * systems the only heap is regular system memory allocated via vmalloc.
@@ -124,8 +136,29 @@ struct ion_heap {
 	struct ion_heap_ops *ops;
 	int id;
 	const char *name;
+	int (*debug_show)(struct ion_heap *heap, struct seq_file *, void *);
+	unsigned long flags;
+	struct list_head free_list;
+	size_t free_list_size;
+	spinlock_t free_lock;
+	struct work_struct free_work;
 };
 
+/*
+ * Buffers of heaps with this flag are released from a worker when their
+ * last reference goes away, so the caller doesn't wait for the heap to
+ * unmap and free them.
+ */
+#define ION_HEAP_FLAG_DEFER_FREE	(1 << 0)
+
+/**
+ * ion_heap_drain_freelist - wait for all deferred frees of a heap
+ * @heap:		the heap
+ *
+ * Must be called before a heap with ION_HEAP_FLAG_DEFER_FREE is destroyed.
+ */
+void ion_heap_drain_freelist(struct ion_heap *heap);
+
 /**
  * ion_device_create - allocates and returns an ion device
  * @custom_ioctl:	arch specific ioctl function if applicable
@@ -167,6 +200,9 @@ void ion_system_contig_heap_destroy(struct ion_heap *);
 
 struct ion_heap *ion_carveout_heap_create(struct ion_platform_heap *);
 void ion_carveout_heap_destroy(struct ion_heap *);
+
+struct ion_heap *ion_page_pool_heap_create(struct ion_platform_heap *);
+void ion_page_pool_heap_destroy(struct ion_heap *);
 /**
  * kernel api to allocate/free from carveout -- used when carveout is
  * used to back an architecture specific custom heap
@@ -181,4 +217,44 @@ void ion_carveout_free(struct ion_heap *heap, ion_phys_addr_t addr,
  */
 #define ION_CARVEOUT_ALLOCATE_FAIL -1
 
+/**
+ * struct ion_page_pool - pagepool struct
+ * @clean_count:	number of zeroed pages in the pool
+ * @dirty_count:	number of pages in the pool still to be zeroed
+ * @clean:		list of zeroed pages
+ * @dirty:		list of pages returned by freed buffers
+ * @lock:		protects the lists, counts and stats
+ * @gfp_mask:		gfp_mask to use from alloc
+ * @order:		order of pages in the pool
+ * @clean_hits:		allocations served with a zeroed page
+ * @dirty_hits:		allocations that had to zero a pooled page
+ * @misses:		allocations that went to the page allocator
+ *
+ * Keeps freed pages of one order around so that buffers can be rebuilt
+ * without going back to the page allocator. Freed pages are zeroed, and
+ * flushed from the cpu caches, before they are handed out again. Pages are
+ * compound so they can be mapped into userspace page by page.
+ */
+struct ion_page_pool {
+	int clean_count;
+	int dirty_count;
+	struct list_head clean;
+	struct list_head dirty;
+	spinlock_t lock;
+	gfp_t gfp_mask;
+	unsigned int order;
+	unsigned long clean_hits;
+	unsigned long dirty_hits;
+	unsigned long misses;
+};
+
+struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order);
+void ion_page_pool_destroy(struct ion_page_pool *);
+struct page *ion_page_pool_alloc(struct ion_page_pool *);
+void ion_page_pool_free(struct ion_page_pool *, struct page *);
+void ion_page_pool_zero_dirty(struct ion_page_pool *);
+int ion_page_pool_total(struct ion_page_pool *);
+int ion_page_pool_shrink(struct ion_page_pool *, int nr_to_scan);
+void ion_page_pool_debug_show(struct ion_page_pool *, struct seq_file *);
+
 #endif /* _ION_PRIV_H */
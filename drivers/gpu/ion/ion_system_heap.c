@@ -110,6 +110,7 @@ struct ion_heap *ion_system_heap_create(struct ion_platform_heap *unused)
 		return ERR_PTR(-ENOMEM);
 	heap->ops = &vmalloc_ops;
 	heap->type = ION_HEAP_TYPE_SYSTEM;
+	heap->flags = ION_HEAP_FLAG_DEFER_FREE;
 	return heap;
 }
 
@@ -19,6 +19,8 @@
 #include <linux/workqueue.h>
 #include <linux/backing-dev.h>
 #include <linux/percpu.h>
+#include <linux/kthread.h>
+#include <linux/rbtree.h>
 #include <asm/atomic.h>
 #include <linux/scatterlist.h>
 #include <asm/page.h>
@@ -45,6 +47,7 @@ struct convert_context {
 	unsigned int idx_out;
 	sector_t sector;
 	atomic_t pending;
+	struct ablkcipher_request *req;
 };
 
 /*
@@ -63,6 +66,15 @@ struct dm_crypt_io {
 	struct dm_crypt_io *base_io;
 };
 
+/*
+ * Write clones are allocated with this in front of them, it keeps them
+ * in cc->write_tree until the write thread submits them.
+ */
+struct dm_crypt_clone {
+	struct rb_node rb_node;
+	struct bio bio;
+};
+
 struct dm_crypt_request {
 	struct convert_context *ctx;
 	struct scatterlist sg_in;
@@ -103,13 +115,15 @@ struct iv_lmk_private {
  * Crypt: maps a linear range of a block device
  * and encrypts / decrypts at the same time.
  */
-enum flags { DM_CRYPT_SUSPENDED, DM_CRYPT_KEY_VALID };
+enum flags { DM_CRYPT_SUSPENDED, DM_CRYPT_KEY_VALID,
+	     DM_CRYPT_SAME_CPU, DM_CRYPT_NO_OFFLOAD };
 
 /*
  * Duplicated per-CPU state for cipher.
  */
 struct crypt_cpu {
-	struct ablkcipher_request *req;
+	/* where the next bio queued from this cpu is crypted */
+	int next_cpu;
 	/* ESSIV: struct crypto_cipher *essiv_tfm */
 	void *iv_private;
 	struct crypto_ablkcipher *tfms[0];
@@ -135,6 +149,19 @@ struct crypt_config {
 	struct workqueue_struct *io_queue;
 	struct workqueue_struct *crypt_queue;
 
+	/*
+	 * Encrypted writes are handed to write_thread, which submits them
+	 * in sector order: with the crypt work spread over all cpus they
+	 * finish out of order, and the device would see a sequential
+	 * stream as random writes. Protected by write_thread_wait.lock.
+	 */
+	struct task_struct *write_thread;
+	wait_queue_head_t write_thread_wait;
+	struct rb_root write_tree;
+
+	/* bios up to this size are crypted without a context switch */
+	unsigned int inline_sectors;
+
 	char *cipher;
 	char *cipher_string;
 
@@ -184,9 +211,14 @@ static void clone_init(struct dm_crypt_io *, struct bio *);
 static void kcryptd_queue_crypt(struct dm_crypt_io *io);
 static u8 *iv_of_dmreq(struct crypt_config *cc, struct dm_crypt_request *dmreq);
 
+/*
+ * The per-cpu tfms can be shared, they only save cache line bouncing, so
+ * callers may be preempted and use the state of another cpu: bios that
+ * are crypted inline run in preemptible context.
+ */
 static struct crypt_cpu *this_crypt_config(struct crypt_config *cc)
 {
-	return this_cpu_ptr(cc->cpu);
+	return __this_cpu_ptr(cc->cpu);
 }
 
 /*
@@ -666,6 +698,7 @@ static void crypt_convert_init(struct crypt_config *cc,
 	ctx->idx_in = bio_in ? bio_in->bi_idx : 0;
 	ctx->idx_out = bio_out ? bio_out->bi_idx : 0;
 	ctx->sector = sector + cc->iv_offset;
+	ctx->req = NULL;
 	init_completion(&ctx->restart);
 }
 
@@ -752,13 +785,13 @@ static void crypt_alloc_req(struct crypt_config *cc,
 	struct crypt_cpu *this_cc = this_crypt_config(cc);
 	unsigned key_index = ctx->sector & (cc->tfms_count - 1);
 
-	if (!this_cc->req)
-		this_cc->req = mempool_alloc(cc->req_pool, GFP_NOIO);
+	if (!ctx->req)
+		ctx->req = mempool_alloc(cc->req_pool, GFP_NOIO);
 
-	ablkcipher_request_set_tfm(this_cc->req, this_cc->tfms[key_index]);
-	ablkcipher_request_set_callback(this_cc->req,
+	ablkcipher_request_set_tfm(ctx->req, this_cc->tfms[key_index]);
+	ablkcipher_request_set_callback(ctx->req,
 	    CRYPTO_TFM_REQ_MAY_BACKLOG | CRYPTO_TFM_REQ_MAY_SLEEP,
-	    kcryptd_async_done, dmreq_of_req(cc, this_cc->req));
+	    kcryptd_async_done, dmreq_of_req(cc, ctx->req));
 }
 
 /*
@@ -767,7 +800,6 @@ static void crypt_alloc_req(struct crypt_config *cc,
 static int crypt_convert(struct crypt_config *cc,
 			 struct convert_context *ctx)
 {
-	struct crypt_cpu *this_cc = this_crypt_config(cc);
 	int r;
 
 	atomic_set(&ctx->pending, 1);
@@ -779,7 +811,7 @@ static int crypt_convert(struct crypt_config *cc,
 
 		atomic_inc(&ctx->pending);
 
-		r = crypt_convert_block(cc, ctx, this_cc->req);
+		r = crypt_convert_block(cc, ctx, ctx->req);
 
 		switch (r) {
 		/* async */
@@ -788,7 +820,7 @@ static int crypt_convert(struct crypt_config *cc,
 			INIT_COMPLETION(ctx->restart);
 			/* fall through*/
 		case -EINPROGRESS:
-			this_cc->req = NULL;
+			ctx->req = NULL;
 			ctx->sector++;
 			continue;
 
@@ -897,6 +929,7 @@ static struct dm_crypt_io *crypt_io_alloc(struct dm_target *ti,
 	io->sector = sector;
 	io->error = 0;
 	io->base_io = NULL;
+	io->ctx.req = NULL;
 	atomic_set(&io->pending, 0);
 
 	return io;
@@ -922,6 +955,8 @@ static void crypt_dec_pending(struct dm_crypt_io *io)
 	if (!atomic_dec_and_test(&io->pending))
 		return;
 
+	if (io->ctx.req)
+		mempool_free(io->ctx.req, cc->req_pool);
 	mempool_free(io, cc->io_pool);
 
 	if (likely(!base_io))
@@ -947,8 +982,10 @@ static void crypt_dec_pending(struct dm_crypt_io *io)
  * starved by new requests which can block in the first stages due
  * to memory allocation.
  *
- * The work is done per CPU global for all dm-crypt instances.
- * They should not depend on each other and do not block.
+ * kcryptd is bound to the cpus and each bio is queued to the next
+ * online cpu in turn, so one submitter or the cpu taking the storage
+ * interrupt doesn't end up doing all the crypto. Encrypted writes are
+ * then submitted in sector order by dmcrypt_write.
  */
 static void crypt_endio(struct bio *clone, int error)
 {
@@ -1045,10 +1082,68 @@ static void kcryptd_queue_io(struct dm_crypt_io *io)
 	queue_work(cc->io_queue, &io->work);
 }
 
+static struct rb_node *node_of_clone(struct bio *clone)
+{
+	return &container_of(clone, struct dm_crypt_clone, bio)->rb_node;
+}
+
+static struct bio *clone_of_node(struct rb_node *node)
+{
+	return &rb_entry(node, struct dm_crypt_clone, rb_node)->bio;
+}
+
+static int dmcrypt_write(void *data)
+{
+	struct crypt_config *cc = data;
+	DECLARE_WAITQUEUE(wait, current);
+
+	while (1) {
+		struct rb_root write_tree;
+		struct blk_plug plug;
+		struct bio *clone;
+
+		spin_lock_irq(&cc->write_thread_wait.lock);
+		while (RB_EMPTY_ROOT(&cc->write_tree)) {
+			__set_current_state(TASK_INTERRUPTIBLE);
+			__add_wait_queue(&cc->write_thread_wait, &wait);
+			spin_unlock_irq(&cc->write_thread_wait.lock);
+
+			if (unlikely(kthread_should_stop())) {
+				set_current_state(TASK_RUNNING);
+				remove_wait_queue(&cc->write_thread_wait,
+						  &wait);
+				return 0;
+			}
+			schedule();
+
+			set_current_state(TASK_RUNNING);
+			spin_lock_irq(&cc->write_thread_wait.lock);
+			__remove_wait_queue(&cc->write_thread_wait, &wait);
+		}
+		write_tree = cc->write_tree;
+		cc->write_tree = RB_ROOT;
+		spin_unlock_irq(&cc->write_thread_wait.lock);
+
+		/*
+		 * rb_next() can't be used, a clone may complete and be freed
+		 * as soon as it is submitted.
+		 */
+		blk_start_plug(&plug);
+		do {
+			clone = clone_of_node(rb_first(&write_tree));
+			rb_erase(node_of_clone(clone), &write_tree);
+			generic_make_request(clone);
+		} while (!RB_EMPTY_ROOT(&write_tree));
+		blk_finish_plug(&plug);
+	}
+}
+
 static void kcryptd_crypt_write_io_submit(struct dm_crypt_io *io, int async)
 {
 	struct bio *clone = io->ctx.bio_out;
 	struct crypt_config *cc = io->target->private;
+	struct rb_node **p, *parent = NULL;
+	unsigned long flags;
 
 	if (unlikely(io->error < 0)) {
 		crypt_free_buffer_pages(cc, clone);
@@ -1062,10 +1157,27 @@ static void kcryptd_crypt_write_io_submit(struct dm_crypt_io *io, int async)
 
 	clone->bi_sector = cc->start + io->sector;
 
-	if (async)
-		kcryptd_queue_io(io);
-	else
-		generic_make_request(clone);
+	if (test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags)) {
+		if (async)
+			kcryptd_queue_io(io);
+		else
+			generic_make_request(clone);
+		return;
+	}
+
+	spin_lock_irqsave(&cc->write_thread_wait.lock, flags);
+	p = &cc->write_tree.rb_node;
+	while (*p) {
+		parent = *p;
+		if (clone->bi_sector < clone_of_node(parent)->bi_sector)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(node_of_clone(clone), parent, p);
+	rb_insert_color(node_of_clone(clone), &cc->write_tree);
+	wake_up_locked(&cc->write_thread_wait);
+	spin_unlock_irqrestore(&cc->write_thread_wait.lock, flags);
 }
 
 static void kcryptd_crypt_write_convert(struct dm_crypt_io *io)
@@ -1231,9 +1343,36 @@ static void kcryptd_crypt(struct work_struct *work)
 static void kcryptd_queue_crypt(struct dm_crypt_io *io)
 {
 	struct crypt_config *cc = io->target->private;
+	struct crypt_cpu *this_cc;
+	int cpu;
+
+	/*
+	 * Small bios are crypted by the caller when it is allowed to sleep:
+	 * the submitter for writes, for reads the completion when the
+	 * driver completes from its own thread. The wake up and switch to
+	 * kcryptd would take longer than the crypto itself.
+	 */
+	if (bio_sectors(io->base_bio) <= cc->inline_sectors && preemptible() &&
+	    cc->inline_sectors) {
+		kcryptd_crypt(&io->work);
+		return;
+	}
 
 	INIT_WORK(&io->work, kcryptd_crypt);
-	queue_work(cc->crypt_queue, &io->work);
+
+	if (test_bit(DM_CRYPT_SAME_CPU, &cc->flags)) {
+		queue_work(cc->crypt_queue, &io->work);
+		return;
+	}
+
+	/* a cpu can't go offline while preemption is disabled */
+	this_cc = per_cpu_ptr(cc->cpu, get_cpu());
+	cpu = cpumask_next(this_cc->next_cpu, cpu_online_mask);
+	if (cpu >= nr_cpu_ids)
+		cpu = cpumask_first(cpu_online_mask);
+	this_cc->next_cpu = cpu;
+	queue_work_on(cpu, cc->crypt_queue, &io->work);
+	put_cpu();
 }
 
 /*
@@ -1362,7 +1501,6 @@ static int crypt_wipe_key(struct crypt_config *cc)
 static void crypt_dtr(struct dm_target *ti)
 {
 	struct crypt_config *cc = ti->private;
-	struct crypt_cpu *cpu_cc;
 	int cpu;
 
 	ti->private = NULL;
@@ -1370,18 +1508,17 @@ static void crypt_dtr(struct dm_target *ti)
 	if (!cc)
 		return;
 
+	if (cc->write_thread)
+		kthread_stop(cc->write_thread);
+
 	if (cc->io_queue)
 		destroy_workqueue(cc->io_queue);
 	if (cc->crypt_queue)
 		destroy_workqueue(cc->crypt_queue);
 
 	if (cc->cpu)
-		for_each_possible_cpu(cpu) {
-			cpu_cc = per_cpu_ptr(cc->cpu, cpu);
-			if (cpu_cc->req)
-				mempool_free(cpu_cc->req, cc->req_pool);
+		for_each_possible_cpu(cpu)
 			crypt_free_tfms(cc, cpu);
-		}
 
 	if (cc->bs)
 		bioset_free(cc->bs);
@@ -1570,9 +1707,50 @@ bad_mem:
 	return -ENOMEM;
 }
 
+static int crypt_ctr_features(struct dm_target *ti, unsigned int argc,
+			      char **argv)
+{
+	struct crypt_config *cc = ti->private;
+	unsigned int count;
+	char dummy;
+
+	if (!argc)
+		return 0;
+
+	if (sscanf(argv[0], "%u%c", &count, &dummy) != 1 ||
+	    count != argc - 1) {
+		ti->error = "Invalid number of feature args";
+		return -EINVAL;
+	}
+
+	while (count--) {
+		const char *arg = *++argv;
+
+		if (!strcasecmp(arg, "same_cpu_crypt"))
+			set_bit(DM_CRYPT_SAME_CPU, &cc->flags);
+		else if (!strcasecmp(arg, "submit_from_crypt_cpus"))
+			set_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags);
+		else if (sscanf(arg, "inline_crypt:%u%c", &cc->inline_sectors,
+				&dummy) != 1) {
+			ti->error = "Invalid feature arguments";
+			return -EINVAL;
+		}
+	}
+	return 0;
+}
+
 /*
  * Construct an encryption mapping:
  * <cipher> <key> <iv_offset> <dev_path> <start>
+ *	[<#features> [same_cpu_crypt] [submit_from_crypt_cpus]
+ *	 [inline_crypt:<sectors>]]
+ *
+ * same_cpu_crypt: crypt each bio on the cpu that queued it instead of
+ *	spreading the work over all online cpus.
+ * submit_from_crypt_cpus: submit writes from the crypt workers as soon
+ *	as they are encrypted instead of sorting them in dmcrypt_write.
+ * inline_crypt: crypt bios of up to <sectors> in the submitting, or for
+ *	reads the completing, context when it may sleep.
  */
 static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 {
@@ -1581,7 +1759,7 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 	unsigned long long tmpll;
 	int ret;
 
-	if (argc != 5) {
+	if (argc < 5) {
 		ti->error = "Not enough arguments";
 		return -EINVAL;
 	}
@@ -1626,7 +1804,7 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 		goto bad;
 	}
 
-	cc->bs = bioset_create(MIN_IOS, 0);
+	cc->bs = bioset_create(MIN_IOS, offsetof(struct dm_crypt_clone, bio));
 	if (!cc->bs) {
 		ti->error = "Cannot allocate crypt bioset";
 		goto bad;
@@ -1650,33 +1828,42 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 	}
 	cc->start = tmpll;
 
+	ret = crypt_ctr_features(ti, argc - 5, argv + 5);
+	if (ret)
+		goto bad;
+
 	ret = -ENOMEM;
-#if 1
-	cc->io_queue = create_singlethread_workqueue("kcryptd_io");
-#else
 	cc->io_queue = alloc_workqueue("kcryptd_io",
 				       WQ_NON_REENTRANT|
 				       WQ_MEM_RECLAIM,
 				       1);
-#endif
 	if (!cc->io_queue) {
 		ti->error = "Couldn't create kcryptd io queue";
 		goto bad;
 	}
-#if 1
-	cc->crypt_queue = create_singlethread_workqueue("kcryptd");
-#else
+
+	/* bound and max_active 1: one crypt worker per cpu */
 	cc->crypt_queue = alloc_workqueue("kcryptd",
 					  WQ_NON_REENTRANT|
 					  WQ_CPU_INTENSIVE|
 					  WQ_MEM_RECLAIM,
 					  1);
-#endif
 	if (!cc->crypt_queue) {
 		ti->error = "Couldn't create kcryptd queue";
 		goto bad;
 	}
 
+	init_waitqueue_head(&cc->write_thread_wait);
+	cc->write_tree = RB_ROOT;
+
+	cc->write_thread = kthread_run(dmcrypt_write, cc, "dmcrypt_write");
+	if (IS_ERR(cc->write_thread)) {
+		ret = PTR_ERR(cc->write_thread);
+		cc->write_thread = NULL;
+		ti->error = "Couldn't spawn write thread";
+		goto bad;
+	}
+
 	ti->num_flush_requests = 1;
 	return 0;
 
@@ -1713,6 +1900,7 @@ static int crypt_status(struct dm_target *ti, status_type_t type,
 {
 	struct crypt_config *cc = ti->private;
 	unsigned int sz = 0;
+	int num_feature_args = 0;
 
 	switch (type) {
 	case STATUSTYPE_INFO:
@@ -1736,6 +1924,19 @@ static int crypt_status(struct dm_target *ti, status_type_t type,
 
 		DMEMIT(" %llu %s %llu", (unsigned long long)cc->iv_offset,
 				cc->dev->name, (unsigned long long)cc->start);
+
+		num_feature_args += !!test_bit(DM_CRYPT_SAME_CPU, &cc->flags);
+		num_feature_args += !!test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags);
+		num_feature_args += !!cc->inline_sectors;
+		if (num_feature_args) {
+			DMEMIT(" %d", num_feature_args);
+			if (test_bit(DM_CRYPT_SAME_CPU, &cc->flags))
+				DMEMIT(" same_cpu_crypt");
+			if (test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags))
+				DMEMIT(" submit_from_crypt_cpus");
+			if (cc->inline_sectors)
+				DMEMIT(" inline_crypt:%u", cc->inline_sectors);
+		}
 		break;
 	}
 	return 0;
@@ -1832,7 +2033,7 @@ static int crypt_iterate_devices(struct dm_target *ti,
 
 static struct target_type crypt_target = {
 	.name   = "crypt",
-	.version = {1, 10, 0},
+	.version = {1, 11, 0},
 	.module = THIS_MODULE,
 	.ctr    = crypt_ctr,
 	.dtr    = crypt_dtr,
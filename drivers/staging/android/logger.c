@@ -34,16 +34,23 @@
  * struct logger_log - represents a specific log, such as 'main' or 'radio'
  *
  * This structure lives from module insertion until module removal, so it does
- * not need additional reference counting. The structure is protected by the
- * mutex 'mutex'.
+ * not need additional reference counting. The offsets, the reader list and
+ * the pending list are protected by the spinlock 'lock'.
+ *
+ * Writers never copy user memory or wait for readers under the lock: they
+ * reserve space between c_off and w_off, fill it in with preemption disabled
+ * and then commit it. Readers only see entries up to c_off, which stops at
+ * the oldest write still in flight.
  */
 struct logger_log {
 	unsigned char 		*buffer;/* the ring buffer itself */
 	struct miscdevice	misc;	/* misc device representing the log */
 	wait_queue_head_t	wq;	/* wait queue for readers */
 	struct list_head	readers; /* this log's readers */
-	struct mutex		mutex;	/* mutex protecting buffer */
-	size_t			w_off;	/* current write head offset */
+	struct list_head	pending; /* reserved, not yet committed writes */
+	spinlock_t		lock;	/* lock protecting the offsets */
+	size_t			w_off;	/* current write (reserve) head offset */
+	size_t			c_off;	/* end of committed entries */
 	size_t			head;	/* new readers start here */
 	size_t			size;	/* size of the log */
 };
@@ -52,7 +59,8 @@ struct logger_log {
  * struct logger_reader - a logging device open for reading
  *
  * This object lives from open to release, so we don't need additional
- * reference counting. The structure is protected by log->mutex.
+ * reference counting. r_off is protected by log->lock, r_buf and changes
+ * of r_ver by r_mutex.
  */
 struct logger_reader {
 	struct logger_log	*log;	/* associated log */
@@ -60,8 +68,27 @@ struct logger_reader {
 	size_t			r_off;	/* current read head offset */
 	bool			r_all;	/* reader can read all entries */
 	int			r_ver;	/* reader ABI version */
+	struct mutex		r_mutex; /* serializes reads of this reader */
+	unsigned char		*r_buf;	/* the entry being copied out */
+};
+
+/*
+ * struct logger_write - a write that has reserved space in the log but not
+ * yet committed it. Lives on the writer's stack, linked on log->pending in
+ * reservation order.
+ */
+struct logger_write {
+	struct list_head	list;
+	size_t			off;	/* offset of the reserved entry */
 };
 
+/* largest entry, header included, a reader has to buffer */
+#define LOGGER_ENTRY_MAX_LEN \
+	(sizeof(struct logger_entry) + LOGGER_ENTRY_MAX_PAYLOAD)
+
+/* payloads up to this size are staged on the writer's stack */
+#define LOGGER_WRITE_STACK_BUF	256
+
 /* logger_offset - returns index 'n' into the log via (optimized) modulus */
 #define logger_offset(n)	((n) & (log->size - 1))
 
@@ -113,7 +140,7 @@ static struct logger_entry *get_entry_header(struct logger_log *log,
  * get_entry_msg_len - Grabs the length of the message of the entry
  * starting from from 'off'.
  *
- * Caller needs to hold log->mutex.
+ * Caller needs to hold log->lock.
  */
 static __u32 get_entry_msg_len(struct logger_log *log, size_t off)
 {
@@ -157,64 +184,54 @@ static ssize_t copy_header_to_user(int ver, struct logger_entry *entry,
 }
 
 /*
- * do_read_log_to_user - reads exactly 'count' bytes from 'log' into the
- * user-space buffer 'buf'. Returns 'count' on success.
+ * do_read_log - copies 'count' bytes starting at 'off' out of the ring
+ * buffer into 'buf'.
  *
- * Caller must hold log->mutex.
+ * Called without log->lock: a writer may overwrite the data under us, so
+ * the caller must check it was not lapped before trusting the copy.
  */
-static ssize_t do_read_log_to_user(struct logger_log *log,
-				   struct logger_reader *reader,
-				   char __user *buf,
-				   size_t count)
+static void do_read_log(struct logger_log *log, size_t off, void *buf,
+			size_t count)
 {
-	struct logger_entry scratch;
-	struct logger_entry *entry;
 	size_t len;
-	size_t msg_start;
 
-	/*
-	 * First, copy the header to userspace, using the version of
-	 * the header requested
-	 */
-	entry = get_entry_header(log, reader->r_off, &scratch);
-	if (copy_header_to_user(reader->r_ver, entry, buf))
-		return -EFAULT;
+	len = min(count, log->size - off);
+	memcpy(buf, log->buffer + off, len);
 
-	count -= get_user_hdr_len(reader->r_ver);
-	buf += get_user_hdr_len(reader->r_ver);
-	msg_start = logger_offset(reader->r_off + sizeof(struct logger_entry));
+	if (count != len)
+		memcpy(buf + len, log->buffer, count - len);
+}
 
-	/*
-	 * We read from the msg in two disjoint operations. First, we read from
-	 * the current msg head offset up to 'count' bytes or to the end of
-	 * the log, whichever comes first.
-	 */
-	len = min(count, log->size - msg_start);
-	if (copy_to_user(buf, log->buffer + msg_start, len))
-		return -EFAULT;
+/*
+ * copy_entry_to_user - copies the entry buffered in 'reader->r_buf' to the
+ * user-space buffer 'buf', using the header version requested by the reader.
+ * Returns the number of bytes copied.
+ */
+static ssize_t copy_entry_to_user(struct logger_reader *reader,
+				  char __user *buf)
+{
+	struct logger_entry *entry = (struct logger_entry *) reader->r_buf;
+	size_t hdr_len = get_user_hdr_len(reader->r_ver);
 
-	/*
-	 * Second, we read any remaining bytes, starting back at the head of
-	 * the log.
-	 */
-	if (count != len)
-		if (copy_to_user(buf + len, log->buffer, count - len))
-			return -EFAULT;
+	if (copy_header_to_user(reader->r_ver, entry, buf))
+		return -EFAULT;
 
-	reader->r_off = logger_offset(reader->r_off +
-		sizeof(struct logger_entry) + count);
+	if (copy_to_user(buf + hdr_len, entry->msg, entry->len))
+		return -EFAULT;
 
-	return count + get_user_hdr_len(reader->r_ver);
+	return hdr_len + entry->len;
 }
 
 /*
  * get_next_entry_by_uid - Starting at 'off', returns an offset into
  * 'log->buffer' which contains the first entry readable by 'euid'
+ *
+ * Caller needs to hold log->lock.
  */
 static size_t get_next_entry_by_uid(struct logger_log *log,
 		size_t off, uid_t euid)
 {
-	while (off != log->w_off) {
+	while (off != log->c_off) {
 		struct logger_entry *entry;
 		struct logger_entry scratch;
 		size_t next_len;
@@ -248,16 +265,19 @@ static ssize_t logger_read(struct file *file, char __user *buf,
 {
 	struct logger_reader *reader = file->private_data;
 	struct logger_log *log = reader->log;
+	size_t off, len;
+	bool lapped;
 	ssize_t ret;
 	DEFINE_WAIT(wait);
 
+	mutex_lock(&reader->r_mutex);
 start:
 	while (1) {
 		prepare_to_wait(&log->wq, &wait, TASK_INTERRUPTIBLE);
 
-		mutex_lock(&log->mutex);
-		ret = (log->w_off == reader->r_off);
-		mutex_unlock(&log->mutex);
+		spin_lock(&log->lock);
+		ret = (log->c_off == reader->r_off);
+		spin_unlock(&log->lock);
 		if (!ret)
 			break;
 
@@ -276,33 +296,56 @@ start:
 
 	finish_wait(&log->wq, &wait);
 	if (ret)
-		return ret;
+		goto out;
 
-	mutex_lock(&log->mutex);
+	spin_lock(&log->lock);
 
 	if (!reader->r_all)
 		reader->r_off = get_next_entry_by_uid(log,
 			reader->r_off, current_euid());
 
 	/* is there still something to read or did we race? */
-	if (unlikely(log->w_off == reader->r_off)) {
-		mutex_unlock(&log->mutex);
+	if (unlikely(log->c_off == reader->r_off)) {
+		spin_unlock(&log->lock);
 		goto start;
 	}
 
 	/* get the size of the next entry */
-	ret = get_user_hdr_len(reader->r_ver) +
-		get_entry_msg_len(log, reader->r_off);
-	if (count < ret) {
+	off = reader->r_off;
+	len = get_entry_msg_len(log, off);
+	spin_unlock(&log->lock);
+
+	if (count < get_user_hdr_len(reader->r_ver) + len) {
 		ret = -EINVAL;
 		goto out;
 	}
 
+	/*
+	 * Copy the entry out without holding the lock and only trust the copy
+	 * if no writer pulled us forward meanwhile, i.e. the entry was not
+	 * overwritten.
+	 */
+	len += sizeof(struct logger_entry);
+	do_read_log(log, off, reader->r_buf, len);
+
+	spin_lock(&log->lock);
+	lapped = reader->r_off != off;
+	spin_unlock(&log->lock);
+	if (unlikely(lapped))
+		goto start;
+
 	/* get exactly one entry from the log */
-	ret = do_read_log_to_user(log, reader, buf, ret);
+	ret = copy_entry_to_user(reader, buf);
+	if (ret < 0)
+		goto out;
+
+	spin_lock(&log->lock);
+	if (reader->r_off == off)
+		reader->r_off = logger_offset(off + len);
+	spin_unlock(&log->lock);
 
 out:
-	mutex_unlock(&log->mutex);
+	mutex_unlock(&reader->r_mutex);
 
 	return ret;
 }
@@ -311,7 +354,7 @@ out:
  * get_next_entry - return the offset of the first valid entry at least 'len'
  * bytes after 'off'.
  *
- * Caller must hold log->mutex.
+ * Caller must hold log->lock.
  */
 static size_t get_next_entry(struct logger_log *log, size_t off, size_t len)
 {
@@ -350,7 +393,7 @@ static inline int clock_interval(size_t a, size_t b, size_t c)
  * We do this by "pulling forward" the readers and start head to the first
  * entry after the new write head.
  *
- * The caller needs to hold log->mutex.
+ * The caller needs to hold log->lock.
  */
 static void fix_up_readers(struct logger_log *log, size_t len)
 {
@@ -367,84 +410,78 @@ static void fix_up_readers(struct logger_log *log, size_t len)
 }
 
 /*
- * do_write_log - writes 'len' bytes from 'buf' to 'log'
+ * do_write_log - writes 'count' bytes from 'buf' to 'log' at offset 'off'
  *
- * The caller needs to hold log->mutex.
+ * The caller must own the reservation covering the range.
  */
-static void do_write_log(struct logger_log *log, const void *buf, size_t count)
+static void do_write_log(struct logger_log *log, size_t off, const void *buf,
+			 size_t count)
 {
 	size_t len;
 
-	len = min(count, log->size - log->w_off);
-	memcpy(log->buffer + log->w_off, buf, len);
+	len = min(count, log->size - off);
+	memcpy(log->buffer + off, buf, len);
 
 	if (count != len)
 		memcpy(log->buffer, buf + len, count - len);
-
-	log->w_off = logger_offset(log->w_off + count);
-
 }
 
 /*
- * do_write_log_user - writes 'len' bytes from the user-space buffer 'buf' to
- * the log 'log'
- *
- * The caller needs to hold log->mutex.
+ * copy_payload_from_user - gathers up to 'count' bytes of payload from the
+ * iovecs into the kernel buffer 'buf'.
  *
- * Returns 'count' on success, negative error code on failure.
+ * Returns the number of bytes copied, negative error code on failure.
  */
-static ssize_t do_write_log_from_user(struct logger_log *log,
-				      const void __user *buf, size_t count)
+static ssize_t copy_payload_from_user(unsigned char *buf, size_t count,
+				      const struct iovec *iov,
+				      unsigned long nr_segs)
 {
-	size_t len;
+	size_t copied = 0;
 
-	len = min(count, log->size - log->w_off);
-	if (len && copy_from_user(log->buffer + log->w_off, buf, len))
-		return -EFAULT;
+	while (nr_segs-- > 0 && copied < count) {
+		size_t len;
 
-	if (count != len)
-		if (copy_from_user(log->buffer, buf + len, count - len))
+		/* figure out how much of this vector we can keep */
+		len = min_t(size_t, iov->iov_len, count - copied);
+
+		if (len && copy_from_user(buf + copied, iov->iov_base, len))
 			return -EFAULT;
 
-	/* print as kernel log if the log string starts with "!@" */
-	if (count >= 2) {
-		if (log->buffer[log->w_off] == '!'
-		    && log->buffer[logger_offset(log->w_off + 1)] == '@') {
-			char tmp[256];
-			int i;
-			for (i = 0; i < min(count, sizeof(tmp) - 1); i++)
-				tmp[i] =
-				    log->buffer[logger_offset(log->w_off + i)];
-			tmp[i] = '\0';
-			printk("%s\n", tmp);
-		}
-	}
+		/* print as kernel log if the log string starts with "!@" */
+		if (len >= 2 && buf[copied] == '!' && buf[copied + 1] == '@')
+			printk("%.*s\n", (int) min_t(size_t, len, 255),
+			       buf + copied);
 
-	log->w_off = logger_offset(log->w_off + count);
+		iov++;
+		copied += len;
+	}
 
-	return count;
+	return copied;
 }
 
 /*
  * logger_aio_write - our write method, implementing support for write(),
  * writev(), and aio_write(). Writes are our fast path, and we try to optimize
  * them above all else.
+ *
+ * The payload is staged in a kernel buffer first, so that nothing can fault
+ * or sleep between reserving space in the log and committing it. Readers
+ * never hold log->lock for longer than it takes to look up an entry.
  */
 ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 			 unsigned long nr_segs, loff_t ppos)
 {
 	struct logger_log *log = file_get_log(iocb->ki_filp);
-	size_t orig = log->w_off;
+	unsigned char stack_buf[LOGGER_WRITE_STACK_BUF];
+	unsigned char *payload = stack_buf;
+	struct logger_write write;
 	struct logger_entry header;
 	struct timespec now;
-	ssize_t ret = 0;
-
-	now = current_kernel_time();
+	bool wake;
+	ssize_t ret;
 
 	header.pid = current->tgid;
 	header.tid = current->pid;
-	header.sec = now.tv_sec;
-	header.nsec = now.tv_nsec;
 	header.euid = current_euid();
 	header.len = min_t(size_t, iocb->ki_left, LOGGER_ENTRY_MAX_PAYLOAD);
 	header.hdr_size = sizeof(struct logger_entry);
@@ -453,41 +490,65 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 	if (unlikely(!header.len))
 		return 0;
 
-	mutex_lock(&log->mutex);
+	if (header.len > sizeof(stack_buf)) {
+		payload = kmalloc(header.len, GFP_KERNEL);
+		if (!payload)
+			return -ENOMEM;
+	}
+
+	ret = copy_payload_from_user(payload, header.len, iov, nr_segs);
+	if (unlikely(ret <= 0))
+		goto out;
+	header.len = ret;
+
+	/*
+	 * Other writers cannot commit past our reservation until we are done,
+	 * so keep the window between reserving and committing short.
+	 */
+	preempt_disable();
+	spin_lock(&log->lock);
+
+	/* stamp under the lock so entries are in timestamp order */
+	now = current_kernel_time();
+	header.sec = now.tv_sec;
+	header.nsec = now.tv_nsec;
 
 	/*
 	 * Fix up any readers, pulling them forward to the first readable
-	 * entry after (what will be) the new write offset. We do this now
-	 * because if we partially fail, we can end up with clobbered log
-	 * entries that encroach on readable buffer.
+	 * entry after (what will be) the new write offset.
 	 */
 	fix_up_readers(log, sizeof(struct logger_entry) + header.len);
 
-	do_write_log(log, &header, sizeof(struct logger_entry));
+	write.off = log->w_off;
+	list_add_tail(&write.list, &log->pending);
+	log->w_off = logger_offset(log->w_off + sizeof(struct logger_entry) +
+				   header.len);
 
-	while (nr_segs-- > 0) {
-		size_t len;
-		ssize_t nr;
+	spin_unlock(&log->lock);
 
-		/* figure out how much of this vector we can keep */
-		len = min_t(size_t, iov->iov_len, header.len - ret);
-
-		/* write out this segment's payload */
-		nr = do_write_log_from_user(log, iov->iov_base, len);
-		if (unlikely(nr < 0)) {
-			log->w_off = orig;
-			mutex_unlock(&log->mutex);
-			return nr;
-		}
+	do_write_log(log, write.off, &header, sizeof(struct logger_entry));
+	do_write_log(log, logger_offset(write.off + sizeof(struct logger_entry)),
+		     payload, header.len);
 
-		iov++;
-		ret += nr;
-	}
-
-	mutex_unlock(&log->mutex);
+	spin_lock(&log->lock);
+	list_del(&write.list);
+	/* entries behind an older write still in flight stay invisible */
+	wake = log->c_off == write.off;
+	if (list_empty(&log->pending))
+		log->c_off = log->w_off;
+	else
+		log->c_off = list_first_entry(&log->pending,
+					      struct logger_write, list)->off;
+	spin_unlock(&log->lock);
+	preempt_enable();
 
 	/* wake up any blocked readers */
-	wake_up_interruptible(&log->wq);
+	if (wake)
+		wake_up_interruptible(&log->wq);
+
+out:
+	if (payload != stack_buf)
+		kfree(payload);
 
 	return ret;
 }
@@ -519,17 +580,24 @@ static int logger_open(struct inode *inode, struct file *file)
 		if (!reader)
 			return -ENOMEM;
 
+		reader->r_buf = kmalloc(LOGGER_ENTRY_MAX_LEN, GFP_KERNEL);
+		if (!reader->r_buf) {
+			kfree(reader);
+			return -ENOMEM;
+		}
+
 		reader->log = log;
 		reader->r_ver = 1;
 		reader->r_all = in_egroup_p(inode->i_gid) ||
 			capable(CAP_SYSLOG);
+		mutex_init(&reader->r_mutex);
 
 		INIT_LIST_HEAD(&reader->list);
 
-		mutex_lock(&log->mutex);
+		spin_lock(&log->lock);
 		reader->r_off = log->head;
 		list_add_tail(&reader->list, &log->readers);
-		mutex_unlock(&log->mutex);
+		spin_unlock(&log->lock);
 
 		file->private_data = reader;
 	} else
@@ -550,9 +618,10 @@ static int logger_release(struct inode *inode, struct file *file)
 		struct logger_log *log;
 		unsigned long start = jiffies;
 		log = get_log_from_minor(MINOR(inode->i_rdev));
-		mutex_lock(&log->mutex);
+		spin_lock(&log->lock);
 		list_del(&reader->list);
-		mutex_unlock(&log->mutex);
+		spin_unlock(&log->lock);
+		kfree(reader->r_buf);
 		kfree(reader);
 		pr_info("%s: took %d msec\n", __func__,
 			jiffies_to_msecs(jiffies - start));
@@ -584,14 +653,14 @@ static unsigned int logger_poll(struct file *file, poll_table *wait)
 
 	poll_wait(file, &log->wq, wait);
 
-	mutex_lock(&log->mutex);
+	spin_lock(&log->lock);
 	if (!reader->r_all)
 		reader->r_off = get_next_entry_by_uid(log,
 			reader->r_off, current_euid());
 
-	if (log->w_off != reader->r_off)
+	if (log->c_off != reader->r_off)
 		ret |= POLLIN | POLLRDNORM;
-	mutex_unlock(&log->mutex);
+	spin_unlock(&log->lock);
 
 	return ret;
 }
@@ -605,7 +674,10 @@ static long logger_set_version(struct logger_reader *reader, void __user *arg)
 	if ((version < 1) || (version > 2))
 		return -EINVAL;
 
+	/* a read in progress must copy out headers of a single version */
+	mutex_lock(&reader->r_mutex);
 	reader->r_ver = version;
+	mutex_unlock(&reader->r_mutex);
 	return 0;
 }
 
@@ -616,7 +688,15 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	long ret = -EINVAL;
 	void __user *argp = (void __user *) arg;
 
-	mutex_lock(&log->mutex);
+	/* copies from user space, so it cannot run under log->lock */
+	if (cmd == LOGGER_SET_VERSION) {
+		if (!(file->f_mode & FMODE_READ))
+			return -EBADF;
+		reader = file->private_data;
+		return logger_set_version(reader, argp);
+	}
+
+	spin_lock(&log->lock);
 
 	switch (cmd) {
 	case LOGGER_GET_LOG_BUF_SIZE:
@@ -628,10 +708,10 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			break;
 		}
 		reader = file->private_data;
-		if (log->w_off >= reader->r_off)
-			ret = log->w_off - reader->r_off;
+		if (log->c_off >= reader->r_off)
+			ret = log->c_off - reader->r_off;
 		else
-			ret = (log->size - reader->r_off) + log->w_off;
+			ret = (log->size - reader->r_off) + log->c_off;
 		break;
 	case LOGGER_GET_NEXT_ENTRY_LEN:
 		if (!(file->f_mode & FMODE_READ)) {
@@ -644,7 +724,7 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			reader->r_off = get_next_entry_by_uid(log,
 				reader->r_off, current_euid());
 
-		if (log->w_off != reader->r_off)
+		if (log->c_off != reader->r_off)
 			ret = get_user_hdr_len(reader->r_ver) +
 				get_entry_msg_len(log, reader->r_off);
 		else
@@ -656,8 +736,8 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			break;
 		}
 		list_for_each_entry(reader, &log->readers, list)
-			reader->r_off = log->w_off;
-		log->head = log->w_off;
+			reader->r_off = log->c_off;
+		log->head = log->c_off;
 		ret = 0;
 		break;
 	case LOGGER_GET_VERSION:
@@ -668,17 +748,9 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		reader = file->private_data;
 		ret = reader->r_ver;
 		break;
-	case LOGGER_SET_VERSION:
-		if (!(file->f_mode & FMODE_READ)) {
-			ret = -EBADF;
-			break;
-		}
-		reader = file->private_data;
-		ret = logger_set_version(reader, argp);
-		break;
 	}
 
-	mutex_unlock(&log->mutex);
+	spin_unlock(&log->lock);
 
 	return ret;
 }
@@ -711,8 +783,10 @@ static struct logger_log VAR = { \
 	}, \
 	.wq = __WAIT_QUEUE_HEAD_INITIALIZER(VAR .wq), \
 	.readers = LIST_HEAD_INIT(VAR .readers), \
-	.mutex = __MUTEX_INITIALIZER(VAR .mutex), \
+	.pending = LIST_HEAD_INIT(VAR .pending), \
+	.lock = __SPIN_LOCK_UNLOCKED(VAR .lock), \
 	.w_off = 0, \
+	.c_off = 0, \
 	.head = 0, \
 	.size = SIZE, \
 };
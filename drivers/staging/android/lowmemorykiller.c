@@ -12,6 +12,13 @@
  * and kill processes with a oom_adj value of 0 or higher when the free memory
  * drops below 1024 pages.
  *
+ * The thresholds are checked each time global reclaim reports a window's
+ * worth of scanning (see linux/vmpressure.h), optionally only once the
+ * reclaim pressure reaches /sys/module/lowmemorykiller/parameters/vmpressure_min.
+ * The events, scans, tasks_scanned and kills parameters count how often that
+ * happened, how often memory was low enough to look for victims, how many
+ * processes were looked at and how many were killed.
+ *
  * The driver considers memory used for caches to be free, but if a large
  * percentage of the cached memory is locked this can be very inaccurate
  * and processes may not get killed until the normal oom killer is triggered.
@@ -35,6 +42,7 @@
 #include <linux/oom.h>
 #include <linux/sched.h>
 #include <linux/notifier.h>
+#include <linux/vmpressure.h>
 #ifdef CONFIG_ZRAM_FOR_ANDROID
 #include <linux/swap.h>
 #include <linux/device.h>
@@ -62,6 +70,18 @@ static size_t lowmem_minfree[6] = {
 	16 * 1024,	/* 64MB */
 };
 static int lowmem_minfree_size = 4;
+
+/*
+ * Minimum reclaim pressure (see linux/vmpressure.h) at which the minfree
+ * thresholds are checked. 0 checks after every reclaim window.
+ */
+static uint32_t lowmem_vmpressure_min;
+
+/* vmpressure events seen, kill passes that found memory low, kills */
+static uint32_t lowmem_event_count;
+static uint32_t lowmem_scan_count;
+static uint32_t lowmem_tasks_scanned;
+static uint32_t lowmem_kill_count;
 #ifdef CONFIG_ZRAM_FOR_ANDROID
 static struct class *lmk_class;
 static struct device *lmk_dev;
@@ -131,18 +151,55 @@ task_notify_func(struct notifier_block *self, unsigned long val, void *data)
 	return NOTIFY_OK;
 }
 
-static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
+static int lowmem_min_adj(void)
+{
+	int array_size = ARRAY_SIZE(lowmem_adj);
+#ifndef CONFIG_DMA_CMA
+	int other_free = global_page_state(NR_FREE_PAGES);
+#else
+	int other_free = global_page_state(NR_FREE_PAGES) -
+					global_page_state(NR_FREE_CMA_PAGES);
+#endif
+	int other_file = global_page_state(NR_FILE_PAGES) -
+						global_page_state(NR_SHMEM);
+	int min_adj = OOM_ADJUST_MAX + 1;
+	int i;
+
+	if (lowmem_adj_size < array_size)
+		array_size = lowmem_adj_size;
+	if (lowmem_minfree_size < array_size)
+		array_size = lowmem_minfree_size;
+	for (i = 0; i < array_size; i++) {
+		if (other_free < lowmem_minfree[i] &&
+		    other_file < lowmem_minfree[i]) {
+			min_adj = lowmem_adj[i];
+			break;
+		}
+	}
+	lowmem_print(3, "lowmem_scan ofree %d %d, ma %d\n",
+		     other_free, other_file, min_adj);
+	return min_adj;
+}
+
+/*
+ * Candidates are looked up in the oom_adj buckets from the highest oom_adj
+ * down, so only processes that may actually be killed are looked at, and
+ * the walk stops at the first bucket boundary once enough victims are
+ * lined up: nothing in a lower bucket can beat them.
+ */
+static void lowmem_scan(void)
 {
 	struct task_struct *p;
+	struct hlist_node *pos;
 #ifdef ENHANCED_LMK_ROUTINE
 	struct task_struct *selected[LOWMEM_DEATHPENDING_DEPTH] = {NULL,};
 #else
 	struct task_struct *selected = NULL;
 #endif
-	int rem = 0;
 	int tasksize;
 	int i;
-	int min_adj = OOM_ADJUST_MAX + 1;
+	int adj;
+	int min_adj;
 #ifdef ENHANCED_LMK_ROUTINE
 	int selected_tasksize[LOWMEM_DEATHPENDING_DEPTH] = {0,};
 	int selected_oom_adj[LOWMEM_DEATHPENDING_DEPTH] = {OOM_ADJUST_MAX,};
@@ -152,59 +209,28 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 	int selected_tasksize = 0;
 	int selected_oom_adj;
 #endif
-	int array_size = ARRAY_SIZE(lowmem_adj);
-#ifndef CONFIG_DMA_CMA
-	int other_free = global_page_state(NR_FREE_PAGES);
-#else
-	int other_free = global_page_state(NR_FREE_PAGES) -
-					global_page_state(NR_FREE_CMA_PAGES);
-#endif
-	int other_file = global_page_state(NR_FILE_PAGES) -
-						global_page_state(NR_SHMEM);
 
 	/*
 	 * If we already have a death outstanding, then
-	 * bail out right away; indicating to vmscan
-	 * that we have nothing further to offer on
-	 * this pass.
-	 *
+	 * bail out right away; the memory is on its way.
 	 */
 #ifdef ENHANCED_LMK_ROUTINE
 	for (i = 0; i < LOWMEM_DEATHPENDING_DEPTH; i++) {
 		if (lowmem_deathpending[i] &&
 			time_before_eq(jiffies, lowmem_deathpending_timeout))
-			return 0;
+			return;
 	}
 #else
 	if (lowmem_deathpending &&
 	    time_before_eq(jiffies, lowmem_deathpending_timeout))
-		return 0;
+		return;
 #endif
 
-	if (lowmem_adj_size < array_size)
-		array_size = lowmem_adj_size;
-	if (lowmem_minfree_size < array_size)
-		array_size = lowmem_minfree_size;
-	for (i = 0; i < array_size; i++) {
-		if (other_free < lowmem_minfree[i] &&
-		    other_file < lowmem_minfree[i]) {
-			min_adj = lowmem_adj[i];
-			break;
-		}
-	}
-	if (sc->nr_to_scan > 0)
-		lowmem_print(3, "lowmem_shrink %lu, %x, ofree %d %d, ma %d\n",
-			     sc->nr_to_scan, sc->gfp_mask, other_free, other_file,
-			     min_adj);
-	rem = global_page_state(NR_ACTIVE_ANON) +
-		global_page_state(NR_ACTIVE_FILE) +
-		global_page_state(NR_INACTIVE_ANON) +
-		global_page_state(NR_INACTIVE_FILE);
-	if (sc->nr_to_scan <= 0 || min_adj == OOM_ADJUST_MAX + 1) {
-		lowmem_print(5, "lowmem_shrink %lu, %x, return %d\n",
-			     sc->nr_to_scan, sc->gfp_mask, rem);
-		return rem;
-	}
+	min_adj = lowmem_min_adj();
+	if (min_adj == OOM_ADJUST_MAX + 1)
+		return;
+
+	lowmem_scan_count++;
 
 #ifdef ENHANCED_LMK_ROUTINE
 	for (i = 0; i < LOWMEM_DEATHPENDING_DEPTH; i++)
@@ -214,81 +240,93 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 #endif
 
 	read_lock(&tasklist_lock);
-	for_each_process(p) {
-		struct mm_struct *mm;
-		struct signal_struct *sig;
-		int oom_adj;
+	spin_lock_irq(&oom_adj_bucket_lock);
+	for (adj = OOM_ADJUST_MAX; adj >= min_adj; adj--) {
 #ifdef ENHANCED_LMK_ROUTINE
-		int is_exist_oom_task = 0;
+		if (all_selected_oom == LOWMEM_DEATHPENDING_DEPTH)
+			break;
+#else
+		if (selected)
+			break;
 #endif
-		task_lock(p);
-		mm = p->mm;
-		sig = p->signal;
-		if (!mm || !sig) {
-			task_unlock(p);
-			continue;
-		}
-		oom_adj = sig->oom_adj;
-		if (oom_adj < min_adj) {
-			task_unlock(p);
-			continue;
-		}
-		tasksize = get_mm_rss(mm);
-		task_unlock(p);
-		if (tasksize <= 0)
-			continue;
-
-#ifdef ENHANCED_LMK_ROUTINE
-		if (all_selected_oom < LOWMEM_DEATHPENDING_DEPTH) {
-			for (i = 0; i < LOWMEM_DEATHPENDING_DEPTH; i++) {
-				if (!selected[i]) {
-					is_exist_oom_task = 1;
-					max_selected_oom_idx = i;
-					break;
-				}
+		for_each_oom_adj_bucket_task(p, pos, adj) {
+			struct mm_struct *mm;
+			struct signal_struct *sig;
+			int oom_adj;
+	#ifdef ENHANCED_LMK_ROUTINE
+			int is_exist_oom_task = 0;
+	#endif
+			lowmem_tasks_scanned++;
+			task_lock(p);
+			mm = p->mm;
+			sig = p->signal;
+			if (!mm || !sig) {
+				task_unlock(p);
+				continue;
 			}
-		} else if (selected_oom_adj[max_selected_oom_idx] < oom_adj ||
-			(selected_oom_adj[max_selected_oom_idx] == oom_adj &&
-			selected_tasksize[max_selected_oom_idx] < tasksize)) {
-			is_exist_oom_task = 1;
-		}
-
-		if (is_exist_oom_task) {
-			selected[max_selected_oom_idx] = p;
-			selected_tasksize[max_selected_oom_idx] = tasksize;
-			selected_oom_adj[max_selected_oom_idx] = oom_adj;
-
-			if (all_selected_oom < LOWMEM_DEATHPENDING_DEPTH)
-				all_selected_oom++;
+			oom_adj = sig->oom_adj;
+			if (oom_adj < min_adj) {
+				task_unlock(p);
+				continue;
+			}
+			tasksize = get_mm_rss(mm);
+			task_unlock(p);
+			if (tasksize <= 0)
+				continue;
 
-			if (all_selected_oom == LOWMEM_DEATHPENDING_DEPTH) {
+	#ifdef ENHANCED_LMK_ROUTINE
+			if (all_selected_oom < LOWMEM_DEATHPENDING_DEPTH) {
 				for (i = 0; i < LOWMEM_DEATHPENDING_DEPTH; i++) {
-					if (selected_oom_adj[i] < selected_oom_adj[max_selected_oom_idx])
-						max_selected_oom_idx = i;
-					else if (selected_oom_adj[i] == selected_oom_adj[max_selected_oom_idx] &&
-						selected_tasksize[i] < selected_tasksize[max_selected_oom_idx])
+					if (!selected[i]) {
+						is_exist_oom_task = 1;
 						max_selected_oom_idx = i;
+						break;
+					}
 				}
+			} else if (selected_oom_adj[max_selected_oom_idx] < oom_adj ||
+				(selected_oom_adj[max_selected_oom_idx] == oom_adj &&
+				selected_tasksize[max_selected_oom_idx] < tasksize)) {
+				is_exist_oom_task = 1;
 			}
 
+			if (is_exist_oom_task) {
+				selected[max_selected_oom_idx] = p;
+				selected_tasksize[max_selected_oom_idx] = tasksize;
+				selected_oom_adj[max_selected_oom_idx] = oom_adj;
+
+				if (all_selected_oom < LOWMEM_DEATHPENDING_DEPTH)
+					all_selected_oom++;
+
+				if (all_selected_oom == LOWMEM_DEATHPENDING_DEPTH) {
+					for (i = 0; i < LOWMEM_DEATHPENDING_DEPTH; i++) {
+						if (selected_oom_adj[i] < selected_oom_adj[max_selected_oom_idx])
+							max_selected_oom_idx = i;
+						else if (selected_oom_adj[i] == selected_oom_adj[max_selected_oom_idx] &&
+							selected_tasksize[i] < selected_tasksize[max_selected_oom_idx])
+							max_selected_oom_idx = i;
+					}
+				}
+
+				lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
+					p->pid, p->comm, oom_adj, tasksize);
+			}
+	#else
+			if (selected) {
+				if (oom_adj < selected_oom_adj)
+					continue;
+				if (oom_adj == selected_oom_adj &&
+				    tasksize <= selected_tasksize)
+					continue;
+			}
+			selected = p;
+			selected_tasksize = tasksize;
+			selected_oom_adj = oom_adj;
 			lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
-				p->pid, p->comm, oom_adj, tasksize);
-		}
-#else
-		if (selected) {
-			if (oom_adj < selected_oom_adj)
-				continue;
-			if (oom_adj == selected_oom_adj &&
-			    tasksize <= selected_tasksize)
-				continue;
+				     p->pid, p->comm, oom_adj, tasksize);
+	#endif
 		}
-		selected = p;
-		selected_tasksize = tasksize;
-		selected_oom_adj = oom_adj;
-		lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
-			     p->pid, p->comm, oom_adj, tasksize);
-#endif
 	}
+	spin_unlock_irq(&oom_adj_bucket_lock);
 #ifdef ENHANCED_LMK_ROUTINE
 	for (i = 0; i < LOWMEM_DEATHPENDING_DEPTH; i++) {
 		if (selected[i]) {
@@ -298,7 +336,7 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 			lowmem_deathpending[i] = selected[i];
 			lowmem_deathpending_timeout = jiffies + HZ;
 			force_sig(SIGKILL, selected[i]);
-			rem -= selected_tasksize[i];
+			lowmem_kill_count++;
 		}
 	}
 #else
@@ -309,18 +347,24 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 		lowmem_deathpending = selected;
 		lowmem_deathpending_timeout = jiffies + HZ;
 		force_sig(SIGKILL, selected);
-		rem -= selected_tasksize;
+		lowmem_kill_count++;
 	}
 #endif
-	lowmem_print(4, "lowmem_shrink %lu, %x, return %d\n",
-		     sc->nr_to_scan, sc->gfp_mask, rem);
 	read_unlock(&tasklist_lock);
-	return rem;
 }
 
-static struct shrinker lowmem_shrinker = {
-	.shrink = lowmem_shrink,
-	.seeks = DEFAULT_SEEKS * 16
+static int lowmem_vmpressure_notify(struct notifier_block *self,
+				    unsigned long pressure, void *data)
+{
+	lowmem_print(5, "lowmem_vmpressure %lu\n", pressure);
+	lowmem_event_count++;
+	if (pressure >= lowmem_vmpressure_min)
+		lowmem_scan();
+	return NOTIFY_OK;
+}
+
+static struct notifier_block lowmem_vmpressure_nb = {
+	.notifier_call	= lowmem_vmpressure_notify,
 };
 
 #ifdef CONFIG_ZRAM_FOR_ANDROID
@@ -521,7 +565,7 @@ static int __init lowmem_init(void)
 	unsigned int low_wmark = 0;
 #endif
 	task_free_register(&task_nb);
-	register_shrinker(&lowmem_shrinker);
+	vmpressure_notifier_register(&lowmem_vmpressure_nb);
 
 #ifdef CONFIG_ZRAM_FOR_ANDROID
 	for_each_zone(zone) {
@@ -555,16 +599,21 @@ static int __init lowmem_init(void)
 
 static void __exit lowmem_exit(void)
 {
-	unregister_shrinker(&lowmem_shrinker);
+	vmpressure_notifier_unregister(&lowmem_vmpressure_nb);
 	task_free_unregister(&task_nb);
 }
 
-module_param_named(cost, lowmem_shrinker.seeks, int, S_IRUGO | S_IWUSR);
 module_param_array_named(adj, lowmem_adj, int, &lowmem_adj_size,
 			 S_IRUGO | S_IWUSR);
 module_param_array_named(minfree, lowmem_minfree, uint, &lowmem_minfree_size,
 			 S_IRUGO | S_IWUSR);
 module_param_named(debug_level, lowmem_debug_level, uint, S_IRUGO | S_IWUSR);
+module_param_named(vmpressure_min, lowmem_vmpressure_min, uint,
+		   S_IRUGO | S_IWUSR);
+module_param_named(events, lowmem_event_count, uint, S_IRUGO);
+module_param_named(scans, lowmem_scan_count, uint, S_IRUGO);
+module_param_named(tasks_scanned, lowmem_tasks_scanned, uint, S_IRUGO);
+module_param_named(kills, lowmem_kill_count, uint, S_IRUGO);
 
 module_init(lowmem_init);
 module_exit(lowmem_exit);
@@ -0,0 +1,300 @@
+/*
+ * Compressed RAM block device - compression streams
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/err.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/crypto.h>
+
+#include "zcomp.h"
+
+/*
+ * Backends zram knows how to drive. All of them are plain crypto API
+ * "compress" algorithms; a backend is only offered if the crypto
+ * layer can actually instantiate it.
+ */
+static const char * const backends[] = {
+	"lzo",
+	"lz4",
+	"deflate",
+	NULL
+};
+
+static const char *zcomp_find_backend(const char *comp)
+{
+	int i;
+
+	for (i = 0; backends[i]; i++) {
+		if (sysfs_streq(comp, backends[i]))
+			return backends[i];
+	}
+
+	return NULL;
+}
+
+bool zcomp_available_algorithm(const char *comp)
+{
+	const char *name = zcomp_find_backend(comp);
+
+	return name && crypto_has_comp(name, 0, 0);
+}
+
+/* show available backends, with the current one in [brackets] */
+ssize_t zcomp_available_show(const char *comp, char *buf)
+{
+	ssize_t sz = 0;
+	int i;
+
+	for (i = 0; backends[i]; i++) {
+		if (!crypto_has_comp(backends[i], 0, 0))
+			continue;
+		if (!strcmp(comp, backends[i]))
+			sz += scnprintf(buf + sz, PAGE_SIZE - sz - 2,
+					"[%s] ", backends[i]);
+		else
+			sz += scnprintf(buf + sz, PAGE_SIZE - sz - 2,
+					"%s ", backends[i]);
+	}
+	sz += scnprintf(buf + sz, PAGE_SIZE - sz, "\n");
+
+	return sz;
+}
+
+static void zcomp_strm_free(struct zcomp_strm *zstrm)
+{
+	if (!IS_ERR_OR_NULL(zstrm->tfm))
+		crypto_free_comp(zstrm->tfm);
+	free_pages((unsigned long)zstrm->buffer, 1);
+	kfree(zstrm);
+}
+
+/*
+ * Allocate a new compression stream. The buffer is two pages long
+ * since the compressor may expand incompressible input beyond
+ * PAGE_SIZE.
+ *
+ * The crypto layer allocates transforms with GFP_KERNEL, so streams
+ * are only ever allocated from process context outside of the I/O
+ * path (device init and the max_comp_streams sysfs node).
+ */
+static struct zcomp_strm *zcomp_strm_alloc(struct zcomp *comp)
+{
+	struct zcomp_strm *zstrm;
+
+	zstrm = kzalloc(sizeof(*zstrm), GFP_KERNEL);
+	if (!zstrm)
+		return NULL;
+
+	zstrm->tfm = crypto_alloc_comp(comp->name, 0, 0);
+	zstrm->buffer = (void *)__get_free_pages(GFP_KERNEL | __GFP_ZERO, 1);
+	if (IS_ERR(zstrm->tfm) || !zstrm->buffer) {
+		zcomp_strm_free(zstrm);
+		return NULL;
+	}
+
+	return zstrm;
+}
+
+/*
+ * Get an idle stream, or sleep until another user releases its
+ * stream.
+ */
+struct zcomp_strm *zcomp_strm_find(struct zcomp *comp)
+{
+	struct zcomp_strm *zstrm;
+
+	while (1) {
+		spin_lock(&comp->strm_lock);
+		if (!list_empty(&comp->idle_strm)) {
+			zstrm = list_entry(comp->idle_strm.next,
+					struct zcomp_strm, list);
+			list_del(&zstrm->list);
+			spin_unlock(&comp->strm_lock);
+			return zstrm;
+		}
+
+		comp->waits++;
+		spin_unlock(&comp->strm_lock);
+		wait_event(comp->strm_wait, !list_empty(&comp->idle_strm));
+	}
+}
+
+/*
+ * Put a stream back on the idle list, or free it if the stream
+ * limit was lowered while it was in use.
+ */
+void zcomp_strm_release(struct zcomp *comp, struct zcomp_strm *zstrm)
+{
+	spin_lock(&comp->strm_lock);
+	if (comp->avail_strm <= comp->max_strm) {
+		list_add(&zstrm->list, &comp->idle_strm);
+		spin_unlock(&comp->strm_lock);
+		wake_up(&comp->strm_wait);
+		return;
+	}
+
+	comp->avail_strm--;
+	spin_unlock(&comp->strm_lock);
+	zcomp_strm_free(zstrm);
+}
+
+int zcomp_compress(struct zcomp *comp, struct zcomp_strm *zstrm,
+		const unsigned char *src, size_t *dst_len)
+{
+	int ret;
+	unsigned int dlen = 2 * PAGE_SIZE;
+
+	ret = crypto_comp_compress(zstrm->tfm, src, PAGE_SIZE,
+			zstrm->buffer, &dlen);
+	*dst_len = dlen;
+
+	return ret;
+}
+
+int zcomp_decompress(struct zcomp *comp, struct zcomp_strm *zstrm,
+		const unsigned char *src, size_t src_len, unsigned char *dst)
+{
+	unsigned int dst_len = PAGE_SIZE;
+
+	return crypto_comp_decompress(zstrm->tfm, src, src_len,
+			dst, &dst_len);
+}
+
+/*
+ * Change the stream limit. Raising it allocates the new streams
+ * immediately; lowering it frees idle streams now and busy ones
+ * when they are released.
+ */
+int zcomp_set_max_streams(struct zcomp *comp, int num_strm)
+{
+	struct zcomp_strm *zstrm;
+	LIST_HEAD(free_list);
+
+	if (num_strm < 1)
+		return -EINVAL;
+
+	while (1) {
+		spin_lock(&comp->strm_lock);
+		if (comp->avail_strm >= num_strm) {
+			spin_unlock(&comp->strm_lock);
+			break;
+		}
+		spin_unlock(&comp->strm_lock);
+
+		zstrm = zcomp_strm_alloc(comp);
+		if (!zstrm)
+			return -ENOMEM;
+
+		spin_lock(&comp->strm_lock);
+		comp->avail_strm++;
+		list_add(&zstrm->list, &comp->idle_strm);
+		spin_unlock(&comp->strm_lock);
+		wake_up(&comp->strm_wait);
+	}
+
+	spin_lock(&comp->strm_lock);
+	comp->max_strm = num_strm;
+	/*
+	 * Free idle streams above the new limit; busy ones are freed
+	 * by zcomp_strm_release().
+	 */
+	while (comp->avail_strm > num_strm &&
+			!list_empty(&comp->idle_strm)) {
+		zstrm = list_entry(comp->idle_strm.next,
+				struct zcomp_strm, list);
+		list_move(&zstrm->list, &free_list);
+		comp->avail_strm--;
+	}
+	spin_unlock(&comp->strm_lock);
+
+	while (!list_empty(&free_list)) {
+		zstrm = list_entry(free_list.next, struct zcomp_strm, list);
+		list_del(&zstrm->list);
+		zcomp_strm_free(zstrm);
+	}
+
+	return 0;
+}
+
+int zcomp_get_max_streams(struct zcomp *comp)
+{
+	return comp->max_strm;
+}
+
+int zcomp_get_avail_streams(struct zcomp *comp)
+{
+	int avail;
+
+	spin_lock(&comp->strm_lock);
+	avail = comp->avail_strm;
+	spin_unlock(&comp->strm_lock);
+
+	return avail;
+}
+
+u64 zcomp_get_waits(struct zcomp *comp)
+{
+	u64 waits;
+
+	spin_lock(&comp->strm_lock);
+	waits = comp->waits;
+	spin_unlock(&comp->strm_lock);
+
+	return waits;
+}
+
+void zcomp_destroy(struct zcomp *comp)
+{
+	struct zcomp_strm *zstrm;
+
+	while (!list_empty(&comp->idle_strm)) {
+		zstrm = list_entry(comp->idle_strm.next,
+				struct zcomp_strm, list);
+		list_del(&zstrm->list);
+		zcomp_strm_free(zstrm);
+	}
+	kfree(comp);
+}
+
+/*
+ * Create a pool of @max_strm streams using backend @compress. All
+ * streams are allocated upfront: the crypto layer cannot allocate
+ * transforms with GFP_NOIO, so doing it from the I/O path could
+ * deadlock under memory pressure.
+ */
+struct zcomp *zcomp_create(const char *compress, int max_strm)
+{
+	struct zcomp *comp;
+	const char *name;
+
+	name = zcomp_find_backend(compress);
+	if (!name || max_strm < 1)
+		return NULL;
+
+	comp = kzalloc(sizeof(*comp), GFP_KERNEL);
+	if (!comp)
+		return NULL;
+
+	comp->name = name;
+	spin_lock_init(&comp->strm_lock);
+	INIT_LIST_HEAD(&comp->idle_strm);
+	init_waitqueue_head(&comp->strm_wait);
+
+	if (zcomp_set_max_streams(comp, max_strm)) {
+		zcomp_destroy(comp);
+		return NULL;
+	}
+
+	return comp;
+}
@@ -0,0 +1,80 @@
+/*
+ * Compressed RAM block device - compression streams
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZCOMP_H_
+#define _ZCOMP_H_
+
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/crypto.h>
+
+/* Backend used unless another one is selected via sysfs */
+#define ZCOMP_DEFAULT_BACKEND	"lzo"
+
+/*
+ * A compression stream bundles the working memory needed by the
+ * compressor with a destination buffer large enough to hold the
+ * output of any single page. Writers grab an idle stream, compress
+ * into it and copy the result out before releasing it again, so
+ * up to max_strm pages can be compressed in parallel.
+ *
+ * The compressor itself is a crypto API "compress" transform; some
+ * backends (deflate) keep state in the transform even when
+ * decompressing, so readers use a stream as well.
+ */
+struct zcomp_strm {
+	/* compression/decompression buffer */
+	void *buffer;
+	/* backend transform holding the compressor working memory */
+	struct crypto_comp *tfm;
+	/* entry in zcomp->idle_strm */
+	struct list_head list;
+};
+
+struct zcomp {
+	/* crypto API name of the backend, e.g. "lzo" */
+	const char *name;
+	/* protects idle_strm, avail_strm, max_strm and waits */
+	spinlock_t strm_lock;
+	/* list of idle streams */
+	struct list_head idle_strm;
+	/* number of allocated (idle + in use) streams */
+	int avail_strm;
+	/* upper bound on avail_strm */
+	int max_strm;
+	/* users wait here when all streams are busy */
+	wait_queue_head_t strm_wait;
+	/* no. of times a user had to wait for a stream */
+	u64 waits;
+};
+
+bool zcomp_available_algorithm(const char *comp);
+ssize_t zcomp_available_show(const char *comp, char *buf);
+
+struct zcomp *zcomp_create(const char *comp, int max_strm);
+void zcomp_destroy(struct zcomp *comp);
+
+struct zcomp_strm *zcomp_strm_find(struct zcomp *comp);
+void zcomp_strm_release(struct zcomp *comp, struct zcomp_strm *zstrm);
+
+int zcomp_compress(struct zcomp *comp, struct zcomp_strm *zstrm,
+		const unsigned char *src, size_t *dst_len);
+int zcomp_decompress(struct zcomp *comp, struct zcomp_strm *zstrm,
+		const unsigned char *src, size_t src_len, unsigned char *dst);
+
+int zcomp_set_max_streams(struct zcomp *comp, int num_strm);
+int zcomp_get_max_streams(struct zcomp *comp);
+int zcomp_get_avail_streams(struct zcomp *comp);
+u64 zcomp_get_waits(struct zcomp *comp);
+
+#endif
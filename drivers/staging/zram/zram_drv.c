@@ -29,9 +29,9 @@
 #include <linux/genhd.h>
 #include <linux/highmem.h>
 #include <linux/slab.h>
-#include <linux/lzo.h>
 #include <linux/string.h>
 #include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 #ifdef CONFIG_ZRAM_FOR_ANDROID
 #include <linux/swap.h>
 #endif /* CONFIG_ZRAM_FOR_ANDROID */
@@ -93,21 +93,43 @@ static void zram_clear_flag(struct zram *zram, u32 index,
 	zram->table[index].flags &= ~BIT(flag);
 }
 
-static int page_zero_filled(void *ptr)
+static int page_same_filled(void *ptr, unsigned long *element)
 {
 	unsigned int pos;
 	unsigned long *page;
 
 	page = (unsigned long *)ptr;
 
-	for (pos = 0; pos != PAGE_SIZE / sizeof(*page); pos++) {
-		if (page[pos])
+	for (pos = 1; pos != PAGE_SIZE / sizeof(*page); pos++) {
+		if (page[pos] != page[0])
 			return 0;
 	}
 
+	*element = page[0];
 	return 1;
 }
 
+static void zram_fill_page(void *ptr, unsigned long value)
+{
+	unsigned int pos;
+	unsigned long *page;
+
+	if (!value) {
+		memset(ptr, 0, PAGE_SIZE);
+		return;
+	}
+
+	page = (unsigned long *)ptr;
+
+	for (pos = 0; pos != PAGE_SIZE / sizeof(*page); pos++)
+		page[pos] = value;
+}
+
+static int is_partial_io(struct bio_vec *bvec)
+{
+	return bvec->bv_len != PAGE_SIZE;
+}
+
 static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 {
 	if (!zram->disksize) {
@@ -153,270 +175,717 @@ static void setup_swap_header(struct zram *zram, union swap_header *s)
 }
 #endif /* CONFIG_ZRAM_FOR_ANDROID */
 
-static void zram_free_page(struct zram *zram, size_t index)
+#ifdef CONFIG_ZRAM_WRITEBACK
+static u32 zram_now(void)
 {
-	u32 clen;
-	void *obj;
+	struct timespec ts;
 
-	struct page *page = zram->table[index].page;
-	u32 offset = zram->table[index].offset;
+	get_monotonic_boottime(&ts);
+	return ts.tv_sec;
+}
 
-	if (unlikely(!page)) {
-		/*
-		 * No memory is allocated for zero filled pages.
-		 * Simply clear zero page flag.
-		 */
-		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-			zram_clear_flag(zram, index, ZRAM_ZERO);
-			zram_stat_dec(&zram->stats.pages_zero);
-		}
-		return;
-	}
+static void zram_accessed(struct zram *zram, u32 index)
+{
+	zram->table[index].ac_time = zram_now();
+}
 
-	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
-		clen = PAGE_SIZE;
-		__free_page(page);
-		zram_clear_flag(zram, index, ZRAM_UNCOMPRESSED);
-		zram_stat_dec(&zram->stats.pages_expand);
-		goto out;
-	}
+/* Returns zram->nr_pages if the backing device is full */
+static unsigned long alloc_block_bdev(struct zram *zram)
+{
+	unsigned long blk;
 
-	obj = kmap_atomic(page, KM_USER0) + offset;
-	clen = xv_get_object_size(obj) - sizeof(struct zobj_header);
-	kunmap_atomic(obj, KM_USER0);
+	spin_lock(&zram->bitmap_lock);
+	blk = find_first_zero_bit(zram->bitmap, zram->nr_pages);
+	if (blk < zram->nr_pages)
+		__set_bit(blk, zram->bitmap);
+	spin_unlock(&zram->bitmap_lock);
 
-	xv_free(zram->mem_pool, page, offset);
-	if (clen <= PAGE_SIZE / 2)
-		zram_stat_dec(&zram->stats.good_compress);
+	return blk;
+}
 
-out:
-	zram_stat64_sub(zram, &zram->stats.compr_size, clen);
-	zram_stat_dec(&zram->stats.pages_stored);
+static void free_block_bdev(struct zram *zram, unsigned long blk)
+{
+	spin_lock(&zram->bitmap_lock);
+	WARN_ON(!test_bit(blk, zram->bitmap));
+	__clear_bit(blk, zram->bitmap);
+	spin_unlock(&zram->bitmap_lock);
+}
 
-	zram->table[index].page = NULL;
-	zram->table[index].offset = 0;
+static void zram_bdev_end_io(struct bio *bio, int err)
+{
+	complete(bio->bi_private);
 }
 
-static void handle_zero_page(struct page *page)
+/* Synchronously read or write @page at backing device block @blk */
+static int zram_bdev_rw(struct zram *zram, struct page *page,
+			unsigned long blk, int rw)
 {
-	void *user_mem;
+	DECLARE_COMPLETION_ONSTACK(done);
+	struct bio *bio;
+	int ret;
 
-	user_mem = kmap_atomic(page, KM_USER0);
-	memset(user_mem, 0, PAGE_SIZE);
-	kunmap_atomic(user_mem, KM_USER0);
+	bio = bio_alloc(GFP_NOIO, 1);
+	if (!bio)
+		return -ENOMEM;
+
+	bio->bi_bdev = zram->bdev;
+	bio->bi_sector = (sector_t)blk << SECTORS_PER_PAGE_SHIFT;
+	bio->bi_end_io = zram_bdev_end_io;
+	bio->bi_private = &done;
+	if (!bio_add_page(bio, page, PAGE_SIZE, 0)) {
+		bio_put(bio);
+		return -EIO;
+	}
 
-	flush_dcache_page(page);
+	submit_bio(rw == READ ? READ_SYNC : WRITE_SYNC, bio);
+	wait_for_completion(&done);
+
+	ret = test_bit(BIO_UPTODATE, &bio->bi_flags) ? 0 : -EIO;
+	bio_put(bio);
+
+	return ret;
 }
 
-static void handle_uncompressed_page(struct zram *zram,
-				struct page *page, u32 index)
-{
-	unsigned char *user_mem, *cmem;
+struct zram_bdev_work {
+	struct work_struct work;
+	struct zram *zram;
+	struct page *page;
+	unsigned long blk;
+	int ret;
+};
 
-	user_mem = kmap_atomic(page, KM_USER0);
-	cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-			zram->table[index].offset;
+static void zram_bdev_read_work(struct work_struct *work)
+{
+	struct zram_bdev_work *w =
+		container_of(work, struct zram_bdev_work, work);
 
-	memcpy(user_mem, cmem, PAGE_SIZE);
-	kunmap_atomic(user_mem, KM_USER0);
-	kunmap_atomic(cmem, KM_USER1);
+	w->ret = zram_bdev_rw(w->zram, w->page, w->blk, READ);
+}
 
-	flush_dcache_page(page);
+/*
+ * Bios submitted from a make_request function are only issued once it
+ * returns, so waiting for one there would never end. Have a worker
+ * do the read instead.
+ */
+static int zram_bdev_read(struct zram *zram, struct page *page,
+			  unsigned long blk)
+{
+	struct zram_bdev_work w = {
+		.zram = zram,
+		.page = page,
+		.blk = blk,
+	};
+
+	INIT_WORK_ONSTACK(&w.work, zram_bdev_read_work);
+	queue_work(system_unbound_wq, &w.work);
+	flush_work(&w.work);
+	destroy_work_on_stack(&w.work);
+
+	zram_stat64_inc(zram, &zram->stats.bd_reads);
+	return w.ret;
 }
 
-static void zram_read(struct zram *zram, struct bio *bio)
+static int zram_wb_candidate(struct zram *zram, u32 index, int mode, u32 now)
 {
+	struct table *entry = &zram->table[index];
 
-	int i;
-	u32 index;
-	struct bio_vec *bvec;
+	if (!entry->handle || entry->flags & (BIT(ZRAM_SAME) |
+			BIT(ZRAM_WB) | BIT(ZRAM_UNDER_WB)))
+		return 0;
 
-	zram_stat64_inc(zram, &zram->stats.num_reads);
-	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
+	if (mode == ZRAM_WB_HUGE)
+		return zram_test_flag(zram, index, ZRAM_UNCOMPRESSED);
 
-	bio_for_each_segment(bvec, bio, i) {
-		int ret;
-		size_t clen;
-		struct page *page;
-		struct zobj_header *zheader;
-		unsigned char *user_mem, *cmem;
+	return now - entry->ac_time >= zram->idle_age;
+}
 
-		page = bvec->bv_page;
+static void zram_free_page(struct zram *zram, size_t index);
+static int zram_decompress_page(struct zram *zram, struct zcomp_strm *zstrm,
+				unsigned char *mem, u32 index);
 
-		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-			handle_zero_page(page);
-			index++;
+/*
+ * Move pages to the backing device and free the memory they used:
+ * incompressible ones for ZRAM_WB_HUGE, those not read or written for
+ * zram->idle_age seconds for ZRAM_WB_IDLE. Returns the number of pages
+ * written back or a negative error.
+ */
+int zram_writeback(struct zram *zram, int mode)
+{
+	unsigned long index, blk, nr_pages = zram->disksize >> PAGE_SHIFT;
+	struct zcomp_strm *zstrm;
+	struct page *page;
+	unsigned char *mem;
+	u32 now = zram_now();
+	int ret = 0, count = 0, candidate;
+
+	if (!zram->bdev)
+		return -ENODEV;
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page)
+		return -ENOMEM;
+
+	for (index = 0; index < nr_pages; index++) {
+		read_lock(&zram->tb_lock);
+		candidate = zram_wb_candidate(zram, index, mode, now);
+		read_unlock(&zram->tb_lock);
+		if (!candidate)
 			continue;
+
+		blk = alloc_block_bdev(zram);
+		if (blk >= zram->nr_pages) {
+			ret = -ENOSPC;
+			break;
 		}
 
-		/* Requested page is not present in compressed area */
-		if (unlikely(!zram->table[index].page)) {
-			pr_debug("Read before write: sector=%lu, size=%u",
-				(ulong)(bio->bi_sector), bio->bi_size);
-			handle_zero_page(page);
-			index++;
+		zstrm = zcomp_strm_find(zram->comp);
+		write_lock(&zram->tb_lock);
+		if (!zram_wb_candidate(zram, index, mode, now)) {
+			write_unlock(&zram->tb_lock);
+			zcomp_strm_release(zram->comp, zstrm);
+			free_block_bdev(zram, blk);
 			continue;
 		}
+		mem = kmap_atomic(page, KM_USER0);
+		ret = zram_decompress_page(zram, zstrm, mem, index);
+		kunmap_atomic(mem, KM_USER0);
+		if (!ret)
+			zram_set_flag(zram, index, ZRAM_UNDER_WB);
+		write_unlock(&zram->tb_lock);
+		zcomp_strm_release(zram->comp, zstrm);
+
+		if (!ret) {
+			ret = zram_bdev_rw(zram, page, blk, WRITE);
+			zram_stat64_inc(zram, &zram->stats.bd_writes);
+		}
 
-		/* Page is stored uncompressed since it's incompressible */
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
-			handle_uncompressed_page(zram, page, index);
-			index++;
+		write_lock(&zram->tb_lock);
+		/* Rewritten or freed while it was being written back */
+		if (ret || !zram_test_flag(zram, index, ZRAM_UNDER_WB)) {
+			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+			write_unlock(&zram->tb_lock);
+			free_block_bdev(zram, blk);
+			if (ret)
+				break;
 			continue;
 		}
+		zram_free_page(zram, index);
+		zram->table[index].handle = blk;
+		zram_set_flag(zram, index, ZRAM_WB);
+		zram_stat_inc(&zram->stats.bd_count);
+		write_unlock(&zram->tb_lock);
+
+		count++;
+		cond_resched();
+	}
 
-		user_mem = kmap_atomic(page, KM_USER0);
-		clen = PAGE_SIZE;
+	__free_page(page);
 
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
+	return count ? count : ret;
+}
 
-		ret = lzo1x_decompress_safe(
-			cmem + sizeof(*zheader),
-			xv_get_object_size(cmem) - sizeof(*zheader),
-			user_mem, &clen);
+/*
+ * Open the block device at @path as backing device. Must be called
+ * before the device is initialised, with zram->init_lock held.
+ */
+int zram_set_backing_dev(struct zram *zram, const char *path)
+{
+	struct block_device *bdev;
+	unsigned long nr_pages, *bitmap;
+	char *name;
+
+	name = kstrdup(path, GFP_KERNEL);
+	if (!name)
+		return -ENOMEM;
+
+	bdev = blkdev_get_by_path(name, FMODE_READ | FMODE_WRITE | FMODE_EXCL,
+				  zram);
+	if (IS_ERR(bdev)) {
+		kfree(name);
+		return PTR_ERR(bdev);
+	}
 
-		kunmap_atomic(user_mem, KM_USER0);
-		kunmap_atomic(cmem, KM_USER1);
+	nr_pages = i_size_read(bdev->bd_inode) >> PAGE_SHIFT;
+	bitmap = vzalloc(BITS_TO_LONGS(nr_pages) * sizeof(long));
+	if (!nr_pages || !bitmap) {
+		vfree(bitmap);
+		blkdev_put(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+		kfree(name);
+		return nr_pages ? -ENOMEM : -EINVAL;
+	}
 
-		/* Should NEVER happen. Return bio error if it does. */
-		if (unlikely(ret != LZO_E_OK)) {
-			pr_err("Decompression failed! err=%d, page=%u\n",
-				ret, index);
-			zram_stat64_inc(zram, &zram->stats.failed_reads);
-			goto out;
-		}
+	zram_reset_backing_dev(zram);
+	zram->bdev = bdev;
+	zram->backing_dev = name;
+	zram->nr_pages = nr_pages;
+	zram->bitmap = bitmap;
 
-		flush_dcache_page(page);
-		index++;
+	pr_info("%s: backing device %s, %lu pages\n",
+		zram->disk->disk_name, name, nr_pages);
+	return 0;
+}
+
+void zram_reset_backing_dev(struct zram *zram)
+{
+	if (!zram->bdev)
+		return;
+
+	blkdev_put(zram->bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+	vfree(zram->bitmap);
+	kfree(zram->backing_dev);
+	zram->bdev = NULL;
+	zram->backing_dev = NULL;
+	zram->bitmap = NULL;
+	zram->nr_pages = 0;
+}
+#else
+static inline void zram_accessed(struct zram *zram, u32 index) { }
+#endif /* CONFIG_ZRAM_WRITEBACK */
+
+/*
+ * Release the memory backing table entry @index.
+ * Called with zram->tb_lock held for writing.
+ */
+static void zram_free_page(struct zram *zram, size_t index)
+{
+	unsigned long handle = zram->table[index].handle;
+	u16 clen = zram->table[index].size;
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+	/* Tells a writeback in progress that its copy is stale */
+	zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+
+	/* The handle is the backing device block holding the page */
+	if (zram_test_flag(zram, index, ZRAM_WB)) {
+		zram_clear_flag(zram, index, ZRAM_WB);
+		free_block_bdev(zram, handle);
+		zram_stat_dec(&zram->stats.bd_count);
+		zram->table[index].handle = 0;
+		return;
 	}
+#endif
 
-	set_bit(BIO_UPTODATE, &bio->bi_flags);
-	bio_endio(bio, 0);
-	return;
+	/*
+	 * No memory is allocated for same filled pages, the handle
+	 * holds the value they are filled with.
+	 */
+	if (zram_test_flag(zram, index, ZRAM_SAME)) {
+		zram_clear_flag(zram, index, ZRAM_SAME);
+		if (!handle)
+			zram_stat_dec(&zram->stats.pages_zero);
+		zram_stat_dec(&zram->stats.pages_same);
+		zram->table[index].handle = 0;
+		return;
+	}
+
+	if (unlikely(!handle))
+		return;
+
+	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
+		__free_page((struct page *)handle);
+		zram_clear_flag(zram, index, ZRAM_UNCOMPRESSED);
+		zram_stat_dec(&zram->stats.pages_expand);
+		goto out;
+	}
+
+	zs_free(zram->mem_pool, handle);
+	if (clen <= PAGE_SIZE / 2)
+		zram_stat_dec(&zram->stats.good_compress);
 
 out:
-	bio_io_error(bio);
+	zram_stat64_sub(zram, &zram->stats.compr_size, clen);
+	zram_stat_dec(&zram->stats.pages_stored);
+
+	zram->table[index].handle = 0;
+	zram->table[index].size = 0;
 }
 
-static void zram_write(struct zram *zram, struct bio *bio)
+/*
+ * Fill @mem with the PAGE_SIZE of data stored at @index.
+ * Called with zram->tb_lock held for reading.
+ */
+static int zram_decompress_page(struct zram *zram, struct zcomp_strm *zstrm,
+				unsigned char *mem, u32 index)
 {
-	int i;
-	u32 index;
-	struct bio_vec *bvec;
+	int ret;
+	unsigned long handle = zram->table[index].handle;
+	unsigned char *cmem;
 
-	zram_stat64_inc(zram, &zram->stats.num_writes);
-	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
+	if (zram_test_flag(zram, index, ZRAM_SAME)) {
+		zram_fill_page(mem, handle);
+		return 0;
+	}
 
-	bio_for_each_segment(bvec, bio, i) {
-		int ret;
-		u32 offset;
-		size_t clen;
-		struct zobj_header *zheader;
-		struct page *page, *page_store;
-		unsigned char *user_mem, *cmem, *src;
+	/* Requested page is not present in compressed area */
+	if (unlikely(!handle)) {
+		pr_debug("Read before write: page=%u\n", index);
+		memset(mem, 0, PAGE_SIZE);
+		return 0;
+	}
 
-		page = bvec->bv_page;
-		src = zram->compress_buffer;
+	/* Page is stored uncompressed since it's incompressible */
+	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
+		cmem = kmap_atomic((struct page *)handle, KM_USER1);
+		memcpy(mem, cmem, PAGE_SIZE);
+		kunmap_atomic(cmem, KM_USER1);
+		return 0;
+	}
 
-		/*
-		 * System overwrites unused sectors. Free memory associated
-		 * with this sector now.
-		 */
-		if (zram->table[index].page ||
-				zram_test_flag(zram, index, ZRAM_ZERO))
-			zram_free_page(zram, index);
+	cmem = zs_map_object(zram->mem_pool, handle, ZS_MM_RO);
+	ret = zcomp_decompress(zram->comp, zstrm, cmem,
+		zram->table[index].size, mem);
+	zs_unmap_object(zram->mem_pool, handle);
 
-		mutex_lock(&zram->lock);
+	return ret;
+}
 
-		user_mem = kmap_atomic(page, KM_USER0);
-		if (page_zero_filled(user_mem)) {
-			kunmap_atomic(user_mem, KM_USER0);
-			mutex_unlock(&zram->lock);
-			zram_stat_inc(&zram->stats.pages_zero);
-			zram_set_flag(zram, index, ZRAM_ZERO);
-			index++;
-			continue;
+/* Whether the page at @index is compressed in the zsmalloc pool */
+static bool zram_is_compressed(struct zram *zram, u32 index)
+{
+	struct table *entry = &zram->table[index];
+
+	return entry->handle && !(entry->flags & (BIT(ZRAM_SAME) |
+			BIT(ZRAM_UNCOMPRESSED) | BIT(ZRAM_WB)));
+}
+
+/*
+ * Fill @page with the data stored at @index, reading it back from the
+ * backing device if it was written there.
+ */
+static int zram_read_page(struct zram *zram, struct page *page, u32 index)
+{
+	int ret;
+	unsigned char *mem;
+	struct zcomp_strm *zstrm = NULL;
+
+again:
+	read_lock(&zram->tb_lock);
+	/*
+	 * Only compressed pages need a stream. Since we may have to sleep
+	 * for one it is taken without tb_lock, and the page looked at
+	 * again as it may have changed meanwhile.
+	 */
+	if (!zstrm && zram_is_compressed(zram, index)) {
+		read_unlock(&zram->tb_lock);
+		zstrm = zcomp_strm_find(zram->comp);
+		goto again;
+	}
+
+	zram_accessed(zram, index);
+#ifdef CONFIG_ZRAM_WRITEBACK
+	if (zram_test_flag(zram, index, ZRAM_WB)) {
+		unsigned long blk = zram->table[index].handle;
+
+		read_unlock(&zram->tb_lock);
+		if (zstrm)
+			zcomp_strm_release(zram->comp, zstrm);
+		return zram_bdev_read(zram, page, blk);
+	}
+#endif
+	mem = kmap_atomic(page, KM_USER0);
+	ret = zram_decompress_page(zram, zstrm, mem, index);
+	kunmap_atomic(mem, KM_USER0);
+	read_unlock(&zram->tb_lock);
+
+	if (zstrm)
+		zcomp_strm_release(zram->comp, zstrm);
+	return ret;
+}
+
+static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
+			  u32 index, int offset)
+{
+	int ret;
+	struct page *page, *bounce = NULL;
+	unsigned char *user_mem;
+
+	page = bvec->bv_page;
+
+	if (is_partial_io(bvec)) {
+		/* Use a temporary buffer to decompress the page */
+		bounce = alloc_page(GFP_NOIO);
+		if (!bounce) {
+			pr_info("Error allocating temp memory!\n");
+			return -ENOMEM;
 		}
+	}
 
-		ret = lzo1x_1_compress(user_mem, PAGE_SIZE, src, &clen,
-					zram->compress_workmem);
+	ret = zram_read_page(zram, bounce ? bounce : page, index);
 
+	if (bounce && !ret) {
+		user_mem = kmap_atomic(page, KM_USER0);
+		memcpy(user_mem + bvec->bv_offset,
+		       (unsigned char *)page_address(bounce) + offset,
+		       bvec->bv_len);
 		kunmap_atomic(user_mem, KM_USER0);
+	}
+	if (bounce)
+		__free_page(bounce);
+
+	/* Should NEVER happen. Return bio error if it does. */
+	if (unlikely(ret)) {
+		pr_err("Read failed! err=%d, page=%u\n", ret, index);
+		zram_stat64_inc(zram, &zram->stats.failed_reads);
+		return ret;
+	}
+
+	flush_dcache_page(page);
+	return 0;
+}
 
-		if (unlikely(ret != LZO_E_OK)) {
-			mutex_unlock(&zram->lock);
-			pr_err("Compression failed! err=%d\n", ret);
-			zram_stat64_inc(zram, &zram->stats.failed_writes);
+static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
+			   u32 index, int offset)
+{
+	int ret;
+	size_t clen;
+	unsigned long handle, element;
+	struct zcomp_strm *zstrm;
+	struct page *page, *page_store, *bounce = NULL;
+	unsigned char *user_mem, *cmem, *src, *uncmem = NULL;
+
+	page = bvec->bv_page;
+
+	if (is_partial_io(bvec)) {
+		/*
+		 * This is a partial IO. We need to read the full page
+		 * before to write the changes.
+		 */
+		bounce = alloc_page(GFP_NOIO);
+		if (!bounce) {
+			pr_info("Error allocating temp memory!\n");
+			ret = -ENOMEM;
 			goto out;
 		}
+		uncmem = page_address(bounce);
 
 		/*
-		 * Page is incompressible. Store it as-is (uncompressed)
-		 * since we do not want to return too many disk write
-		 * errors which has side effect of hanging the system.
+		 * Writes to different sectors of one page must not
+		 * lose each other's changes.
 		 */
-		if (unlikely(clen > max_zpage_size)) {
-			clen = PAGE_SIZE;
-			page_store = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
-			if (unlikely(!page_store)) {
-				mutex_unlock(&zram->lock);
-				pr_info("Error allocating memory for "
-					"incompressible page: %u\n", index);
-				zram_stat64_inc(zram,
-					&zram->stats.failed_writes);
-				goto out;
-			}
-
-			offset = 0;
-			zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
-			zram_stat_inc(&zram->stats.pages_expand);
-			zram->table[index].page = page_store;
-			src = kmap_atomic(page, KM_USER0);
-			goto memstore;
-		}
+		mutex_lock(&zram->partial_lock);
 
-		if (xv_malloc(zram->mem_pool, clen + sizeof(*zheader),
-				&zram->table[index].page, &offset,
-				GFP_NOIO | __GFP_HIGHMEM)) {
-			mutex_unlock(&zram->lock);
-			pr_info("Error allocating memory for compressed "
-				"page: %u, size=%zu\n", index, clen);
-			zram_stat64_inc(zram, &zram->stats.failed_writes);
-			goto out;
+		ret = zram_read_page(zram, bounce, index);
+		if (unlikely(ret)) {
+			pr_err("Read failed! err=%d, page=%u\n", ret, index);
+			goto out_unlock;
 		}
 
-memstore:
-		zram->table[index].offset = offset;
+		user_mem = kmap_atomic(page, KM_USER0);
+		memcpy(uncmem + offset, user_mem + bvec->bv_offset,
+		       bvec->bv_len);
+		kunmap_atomic(user_mem, KM_USER0);
+	}
+
+	/*
+	 * Compression runs without any device-wide lock held;
+	 * concurrent writers only contend when all streams
+	 * are busy. Grab the stream before mapping the page
+	 * since we may have to sleep for it.
+	 */
+	zstrm = zcomp_strm_find(zram->comp);
+
+	src = uncmem ? uncmem : kmap_atomic(page, KM_USER0);
+
+	if (page_same_filled(src, &element)) {
+		if (!uncmem)
+			kunmap_atomic(src, KM_USER0);
+		zcomp_strm_release(zram->comp, zstrm);
+		write_lock(&zram->tb_lock);
+		/*
+		 * System overwrites unused sectors. Free memory
+		 * associated with this sector now.
+		 */
+		zram_free_page(zram, index);
+		zram->table[index].handle = element;
+		zram_set_flag(zram, index, ZRAM_SAME);
+		zram_accessed(zram, index);
+		zram_stat_inc(&zram->stats.pages_same);
+		if (!element)
+			zram_stat_inc(&zram->stats.pages_zero);
+		write_unlock(&zram->tb_lock);
+		ret = 0;
+		goto out_unlock;
+	}
+
+	ret = zcomp_compress(zram->comp, zstrm, src, &clen);
 
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
+	if (!uncmem)
+		kunmap_atomic(src, KM_USER0);
 
-#if 0
-		/* Back-reference needed for memory defragmentation */
-		if (!zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
-			zheader = (struct zobj_header *)cmem;
-			zheader->table_idx = index;
-			cmem += sizeof(*zheader);
+	if (unlikely(ret)) {
+		pr_err("Compression failed! err=%d\n", ret);
+		goto out_release;
+	}
+
+	/*
+	 * Page is incompressible. Store it as-is (uncompressed)
+	 * since we do not want to return too many disk write
+	 * errors which has side effect of hanging the system.
+	 */
+	if (unlikely(clen > max_zpage_size)) {
+		clen = PAGE_SIZE;
+		page_store = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
+		if (unlikely(!page_store)) {
+			pr_info("Error allocating memory for "
+				"incompressible page: %u\n", index);
+			ret = -ENOMEM;
+			goto out_release;
 		}
-#endif
 
+		handle = (unsigned long)page_store;
+		src = uncmem ? uncmem : kmap_atomic(page, KM_USER0);
+		cmem = kmap_atomic(page_store, KM_USER1);
 		memcpy(cmem, src, clen);
-
 		kunmap_atomic(cmem, KM_USER1);
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
+		if (!uncmem)
 			kunmap_atomic(src, KM_USER0);
+		goto memstore;
+	}
 
-		/* Update stats */
-		zram_stat64_add(zram, &zram->stats.compr_size, clen);
-		zram_stat_inc(&zram->stats.pages_stored);
-		if (clen <= PAGE_SIZE / 2)
-			zram_stat_inc(&zram->stats.good_compress);
+	handle = zs_malloc(zram->mem_pool, clen);
+	if (!handle) {
+		pr_info("Error allocating memory for compressed "
+			"page: %u, size=%zu\n", index, clen);
+		ret = -ENOMEM;
+		goto out_release;
+	}
+
+	cmem = zs_map_object(zram->mem_pool, handle, ZS_MM_WO);
+	memcpy(cmem, zstrm->buffer, clen);
+	zs_unmap_object(zram->mem_pool, handle);
+
+memstore:
+	zcomp_strm_release(zram->comp, zstrm);
+
+	/*
+	 * Free the old object and publish the new one. Only this
+	 * short window is serialized between writers.
+	 */
+	write_lock(&zram->tb_lock);
+	zram_free_page(zram, index);
 
-		mutex_unlock(&zram->lock);
+	zram->table[index].handle = handle;
+	zram->table[index].size = clen;
+	zram_accessed(zram, index);
+	if (unlikely(clen == PAGE_SIZE)) {
+		zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
+		zram_stat_inc(&zram->stats.pages_expand);
+	}
+
+	/* Update stats */
+	zram_stat64_add(zram, &zram->stats.compr_size, clen);
+	zram_stat_inc(&zram->stats.pages_stored);
+	if (clen <= PAGE_SIZE / 2)
+		zram_stat_inc(&zram->stats.good_compress);
+
+	write_unlock(&zram->tb_lock);
+	goto out_unlock;
+
+out_release:
+	zcomp_strm_release(zram->comp, zstrm);
+out_unlock:
+	if (bounce) {
+		mutex_unlock(&zram->partial_lock);
+		__free_page(bounce);
+	}
+out:
+	if (ret)
+		zram_stat64_inc(zram, &zram->stats.failed_writes);
+	return ret;
+}
+
+static int zram_bvec_rw(struct zram *zram, struct bio_vec *bvec, u32 index,
+			int offset, int rw)
+{
+	if (rw == READ)
+		return zram_bvec_read(zram, bvec, index, offset);
+
+	return zram_bvec_write(zram, bvec, index, offset);
+}
+
+static void update_position(u32 *index, int *offset, struct bio_vec *bvec)
+{
+	if (*offset + bvec->bv_len >= PAGE_SIZE)
+		(*index)++;
+	*offset = (*offset + bvec->bv_len) % PAGE_SIZE;
+}
+
+/*
+ * Free the pages a discard request fully covers. Parts of pages at
+ * either end are left alone, so discarded data does not read back as
+ * zeroes.
+ */
+static void zram_bio_discard(struct zram *zram, u32 index, int offset,
+			     struct bio *bio)
+{
+	size_t n = bio->bi_size;
+
+	if (offset) {
+		if (n <= PAGE_SIZE - offset)
+			return;
+
+		n -= PAGE_SIZE - offset;
 		index++;
 	}
 
+	while (n >= PAGE_SIZE) {
+		write_lock(&zram->tb_lock);
+		zram_free_page(zram, index);
+		write_unlock(&zram->tb_lock);
+		zram_stat64_inc(zram, &zram->stats.num_discards);
+		index++;
+		n -= PAGE_SIZE;
+	}
+}
+
+static void __zram_make_request(struct zram *zram, struct bio *bio, int rw)
+{
+	int i, offset;
+	u32 index;
+	struct bio_vec *bvec;
+
+	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
+	offset = (bio->bi_sector & (SECTORS_PER_PAGE - 1)) << SECTOR_SHIFT;
+
+	if (unlikely(bio->bi_rw & REQ_DISCARD)) {
+		zram_bio_discard(zram, index, offset, bio);
+		bio_endio(bio, 0);
+		return;
+	}
+
+	if (rw == READ)
+		zram_stat64_inc(zram, &zram->stats.num_reads);
+	else
+		zram_stat64_inc(zram, &zram->stats.num_writes);
+
+	bio_for_each_segment(bvec, bio, i) {
+		int max_transfer_size = PAGE_SIZE - offset;
+
+		if (bvec->bv_len > max_transfer_size) {
+			/*
+			 * zram_bvec_rw() can only make operation on a
+			 * single zram page. Split the bio vector.
+			 */
+			struct bio_vec bv;
+
+			bv.bv_page = bvec->bv_page;
+			bv.bv_len = max_transfer_size;
+			bv.bv_offset = bvec->bv_offset;
+
+			if (zram_bvec_rw(zram, &bv, index, offset, rw) < 0)
+				goto out;
+
+			bv.bv_len = bvec->bv_len - max_transfer_size;
+			bv.bv_offset += max_transfer_size;
+			if (zram_bvec_rw(zram, &bv, index + 1, 0, rw) < 0)
+				goto out;
+		} else
+			if (zram_bvec_rw(zram, bvec, index, offset, rw) < 0)
+				goto out;
+
+		update_position(&index, &offset, bvec);
+	}
+
 	set_bit(BIO_UPTODATE, &bio->bi_flags);
 	bio_endio(bio, 0);
 	return;
@@ -426,17 +895,25 @@ out:
 }
 
 /*
- * Check if request is within bounds and page aligned.
+ * Check if request is within bounds and aligned on zram logical blocks.
  */
 static inline int valid_io_request(struct zram *zram, struct bio *bio)
 {
-	if (unlikely(
-		(bio->bi_sector >= (zram->disksize >> SECTOR_SHIFT)) ||
-		(bio->bi_sector & (SECTORS_PER_PAGE - 1)) ||
-		(bio->bi_size & (PAGE_SIZE - 1)))) {
+	u64 start, end, bound;
 
+	/* unaligned request */
+	if (unlikely(bio->bi_sector &
+		     (ZRAM_SECTOR_PER_LOGICAL_BLOCK - 1)))
+		return 0;
+	if (unlikely(bio->bi_size & (ZRAM_LOGICAL_BLOCK_SIZE - 1)))
+		return 0;
+
+	start = bio->bi_sector;
+	end = start + (bio->bi_size >> SECTOR_SHIFT);
+	bound = zram->disksize >> SECTOR_SHIFT;
+	/* out of range */
+	if (unlikely(start >= bound || end > bound || start > end))
 		return 0;
-	}
 
 	/* I/O request is valid */
 	return 1;
@@ -449,26 +926,19 @@ static int zram_make_request(struct request_queue *queue, struct bio *bio)
 {
 	struct zram *zram = queue->queuedata;
 
-	if (!valid_io_request(zram, bio)) {
-		zram_stat64_inc(zram, &zram->stats.invalid_io);
+	/* The device is set up by writing its disksize, never from here */
+	if (unlikely(!zram->init_done)) {
 		bio_io_error(bio);
 		return 0;
 	}
 
-	if (unlikely(!zram->init_done) && zram_init_device(zram)) {
+	if (!valid_io_request(zram, bio)) {
+		zram_stat64_inc(zram, &zram->stats.invalid_io);
 		bio_io_error(bio);
 		return 0;
 	}
 
-	switch (bio_data_dir(bio)) {
-	case READ:
-		zram_read(zram, bio);
-		break;
-
-	case WRITE:
-		zram_write(zram, bio);
-		break;
-	}
+	__zram_make_request(zram, bio, bio_data_dir(bio));
 
 	return 0;
 }
@@ -480,36 +950,39 @@ void zram_reset_device(struct zram *zram)
 	mutex_lock(&zram->init_lock);
 	zram->init_done = 0;
 
-	/* Free various per-device buffers */
-	kfree(zram->compress_workmem);
-	free_pages((unsigned long)zram->compress_buffer, 1);
-
-	zram->compress_workmem = NULL;
-	zram->compress_buffer = NULL;
+	/* Free compression streams */
+	if (zram->comp)
+		zcomp_destroy(zram->comp);
+	zram->comp = NULL;
 
 	/* Free all pages that are still in this zram device */
 	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
-		struct page *page;
-		u16 offset;
-
-		page = zram->table[index].page;
-		offset = zram->table[index].offset;
+		unsigned long handle = zram->table[index].handle;
 
-		if (!page)
+		if (!handle || zram_test_flag(zram, index, ZRAM_SAME))
 			continue;
+#ifdef CONFIG_ZRAM_WRITEBACK
+		if (zram_test_flag(zram, index, ZRAM_WB))
+			continue;
+#endif
 
 		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			__free_page(page);
+			__free_page((struct page *)handle);
 		else
-			xv_free(zram->mem_pool, page, offset);
+			zs_free(zram->mem_pool, handle);
 	}
 
 	vfree(zram->table);
 	zram->table = NULL;
 
-	xv_destroy_pool(zram->mem_pool);
+	if (zram->mem_pool)
+		zs_destroy_pool(zram->mem_pool);
 	zram->mem_pool = NULL;
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+	zram_reset_backing_dev(zram);
+#endif
+
 	/* Reset stats */
 	memset(&zram->stats, 0, sizeof(zram->stats));
 
@@ -535,16 +1008,10 @@ int zram_init_device(struct zram *zram)
 
 	zram_set_disksize(zram, totalram_pages << PAGE_SHIFT);
 
-	zram->compress_workmem = kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
-	if (!zram->compress_workmem) {
-		pr_err("Error allocating compressor working memory!\n");
-		ret = -ENOMEM;
-		goto fail;
-	}
-
-	zram->compress_buffer = (void *)__get_free_pages(__GFP_ZERO, 1);
-	if (!zram->compress_buffer) {
-		pr_err("Error allocating compressor buffer space\n");
+	zram->comp = zcomp_create(zram->compressor, zram->max_comp_streams);
+	if (!zram->comp) {
+		pr_err("Error allocating %s compression streams\n",
+			zram->compressor);
 		ret = -ENOMEM;
 		goto fail;
 	}
@@ -566,7 +1033,8 @@ int zram_init_device(struct zram *zram)
 		ret = -ENOMEM;
 		goto fail;
 	}
-	zram->table[0].page = page;
+	zram->table[0].handle = (unsigned long)page;
+	zram->table[0].size = PAGE_SIZE;
 	zram_set_flag(zram, 0, ZRAM_UNCOMPRESSED);
 	swap_header = kmap(page);
 	setup_swap_header(zram, swap_header);
@@ -577,7 +1045,8 @@ int zram_init_device(struct zram *zram)
 	/* zram devices sort of resembles non-rotational disks */
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, zram->disk->queue);
 
-	zram->mem_pool = xv_create_pool();
+	zram->mem_pool = zs_create_pool(zram->disk->disk_name,
+					GFP_NOIO | __GFP_HIGHMEM);
 	if (!zram->mem_pool) {
 		pr_err("Error creating memory pool\n");
 		ret = -ENOMEM;
@@ -603,7 +1072,9 @@ void zram_slot_free_notify(struct block_device *bdev, unsigned long index)
 	struct zram *zram;
 
 	zram = bdev->bd_disk->private_data;
+	write_lock(&zram->tb_lock);
 	zram_free_page(zram, index);
+	write_unlock(&zram->tb_lock);
 	zram_stat64_inc(zram, &zram->stats.notify_free);
 }
 
@@ -616,9 +1087,19 @@ static int create_device(struct zram *zram, int device_id)
 {
 	int ret = 0;
 
-	mutex_init(&zram->lock);
 	mutex_init(&zram->init_lock);
+	mutex_init(&zram->partial_lock);
 	spin_lock_init(&zram->stat64_lock);
+#ifdef CONFIG_ZRAM_WRITEBACK
+	spin_lock_init(&zram->bitmap_lock);
+	zram->idle_age = default_idle_age;
+#endif
+	rwlock_init(&zram->tb_lock);
+
+	/* Allow one concurrent compression per CPU by default */
+	zram->max_comp_streams = num_online_cpus();
+	strlcpy(zram->compressor, ZCOMP_DEFAULT_BACKEND,
+		sizeof(zram->compressor));
 
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
 	if (!zram->queue) {
@@ -652,8 +1133,9 @@ static int create_device(struct zram *zram, int device_id)
 	set_capacity(zram->disk, 0);
 
 	/*
-	 * To ensure that we always get PAGE_SIZE aligned
-	 * and n*PAGE_SIZED sized I/O requests.
+	 * Sector sized I/O works but each partial page costs a read,
+	 * modify and write of the whole page; tell users who care to
+	 * issue PAGE_SIZE aligned and n*PAGE_SIZED sized requests.
 	 */
 	blk_queue_physical_block_size(zram->disk->queue, PAGE_SIZE);
 	blk_queue_logical_block_size(zram->disk->queue,
@@ -661,6 +1143,16 @@ static int create_device(struct zram *zram, int device_id)
 	blk_queue_io_min(zram->disk->queue, PAGE_SIZE);
 	blk_queue_io_opt(zram->disk->queue, PAGE_SIZE);
 
+	/*
+	 * Discard frees the pages a request fully covers. Partially
+	 * covered pages keep their data, so discarded sectors are not
+	 * guaranteed to read back as zeroes.
+	 */
+	zram->disk->queue->limits.discard_granularity = PAGE_SIZE;
+	blk_queue_max_discard_sectors(zram->disk->queue, UINT_MAX);
+	zram->disk->queue->limits.discard_zeroes_data = 0;
+	queue_flag_set_unlocked(QUEUE_FLAG_DISCARD, zram->disk->queue);
+
 	add_disk(zram->disk);
 
 	ret = sysfs_create_group(&disk_to_dev(zram->disk)->kobj,
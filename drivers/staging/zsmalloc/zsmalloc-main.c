@@ -0,0 +1,927 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * Copyright (C) 2011  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the license that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+/*
+ * This allocator is designed for use with zram and zcache. Objects
+ * are grouped by size class; each class carves its objects out of
+ * 'zspages', i.e. a small number of discontiguous 0-order pages, and
+ * objects are allowed to span a page boundary. This keeps internal
+ * fragmentation low without ever needing higher-order allocations.
+ *
+ * Users get an opaque handle instead of an address. The handle
+ * points to a word holding the current location of the object, so
+ * zs_compact() can move objects out of sparsely used zspages and
+ * give the pages back to the system. Objects must be mapped with
+ * zs_map_object() before being accessed; while mapped they are
+ * pinned and compaction skips them.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/bitops.h>
+#include <linux/bit_spinlock.h>
+#include <linux/errno.h>
+#include <linux/highmem.h>
+#include <linux/init.h>
+#include <linux/string.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/percpu.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+#include "zsmalloc.h"
+#include "zsmalloc_int.h"
+
+static struct kmem_cache *handle_cachep;
+static DEFINE_PER_CPU(struct mapping_area, zs_map_area);
+
+/*
+ * Handle helpers. The handle itself is the address of a word
+ * allocated from handle_cachep.
+ */
+static unsigned long cache_alloc_handle(struct zs_pool *pool)
+{
+	return (unsigned long)kmem_cache_alloc(handle_cachep,
+			pool->flags & ~(__GFP_HIGHMEM | __GFP_MOVABLE));
+}
+
+static void cache_free_handle(unsigned long handle)
+{
+	kmem_cache_free(handle_cachep, (void *)handle);
+}
+
+static void pin_tag(unsigned long handle)
+{
+	bit_spin_lock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
+
+static int trypin_tag(unsigned long handle)
+{
+	return bit_spin_trylock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
+
+static void unpin_tag(unsigned long handle)
+{
+	bit_spin_unlock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
+
+/* Store a location in a handle, preserving its pin bit */
+static void record_obj(unsigned long handle, unsigned long obj)
+{
+	unsigned long *word = (unsigned long *)handle;
+
+	*word = (obj << OBJ_TAG_BITS) | (*word & BIT(HANDLE_PIN_BIT));
+}
+
+static unsigned long handle_to_obj(unsigned long handle)
+{
+	return *(unsigned long *)handle >> OBJ_TAG_BITS;
+}
+
+/*
+ * Encode <first page of zspage, obj_idx> as a single value.
+ */
+static unsigned long location_to_obj(struct zspage *zspage,
+				unsigned int obj_idx)
+{
+	return (page_to_pfn(zspage->pages[0]) << OBJ_INDEX_BITS) |
+		(obj_idx & OBJ_INDEX_MASK);
+}
+
+static struct zspage *obj_to_location(unsigned long obj,
+				unsigned int *obj_idx)
+{
+	struct page *first_page = pfn_to_page(obj >> OBJ_INDEX_BITS);
+
+	*obj_idx = obj & OBJ_INDEX_MASK;
+	return (struct zspage *)page_private(first_page);
+}
+
+/*
+ * Header word of object @obj_idx. Headers are aligned to the size
+ * class delta so they never span pages.
+ */
+static unsigned long *map_obj_header(struct size_class *class,
+				struct zspage *zspage, unsigned int obj_idx)
+{
+	unsigned long off = (unsigned long)obj_idx * class->size;
+	void *addr;
+
+	addr = kmap_atomic(zspage->pages[off >> PAGE_SHIFT], KM_USER0);
+	return addr + (off & ~PAGE_MASK);
+}
+
+static void unmap_obj_header(unsigned long *header)
+{
+	kunmap_atomic(header, KM_USER0);
+}
+
+/*
+ * Copy @len bytes between @buf and a zspage starting at byte @off,
+ * possibly crossing page boundaries.
+ */
+static void zspage_rw(struct zspage *zspage, unsigned long off,
+			void *buf, size_t len, bool write)
+{
+	while (len) {
+		struct page *page = zspage->pages[off >> PAGE_SHIFT];
+		size_t poff = off & ~PAGE_MASK;
+		size_t n = min_t(size_t, len, PAGE_SIZE - poff);
+		void *addr = kmap_atomic(page, KM_USER1);
+
+		if (write)
+			memcpy(addr + poff, buf, n);
+		else
+			memcpy(buf, addr + poff, n);
+		kunmap_atomic(addr, KM_USER1);
+
+		off += n;
+		buf += n;
+		len -= n;
+	}
+}
+
+/* Copy @len bytes from one zspage location to another */
+static void zspage_copy(struct zspage *dst, unsigned long dst_off,
+			struct zspage *src, unsigned long src_off, size_t len)
+{
+	while (len) {
+		size_t s_poff = src_off & ~PAGE_MASK;
+		size_t d_poff = dst_off & ~PAGE_MASK;
+		size_t n = min_t(size_t, len, PAGE_SIZE - s_poff);
+		void *s_addr, *d_addr;
+
+		n = min_t(size_t, n, PAGE_SIZE - d_poff);
+		s_addr = kmap_atomic(src->pages[src_off >> PAGE_SHIFT],
+				KM_USER0);
+		d_addr = kmap_atomic(dst->pages[dst_off >> PAGE_SHIFT],
+				KM_USER1);
+		memcpy(d_addr + d_poff, s_addr + s_poff, n);
+		kunmap_atomic(d_addr, KM_USER1);
+		kunmap_atomic(s_addr, KM_USER0);
+
+		src_off += n;
+		dst_off += n;
+		len -= n;
+	}
+}
+
+static int get_size_class_index(int size)
+{
+	int idx = 0;
+
+	if (likely(size > ZS_MIN_ALLOC_SIZE))
+		idx = DIV_ROUND_UP(size - ZS_MIN_ALLOC_SIZE,
+				ZS_SIZE_CLASS_DELTA);
+
+	return idx;
+}
+
+static enum fullness_group get_fullness_group(struct size_class *class,
+				struct zspage *zspage)
+{
+	unsigned int inuse = zspage->inuse;
+	unsigned int max_objects = class->objs_per_zspage;
+
+	if (inuse == 0)
+		return ZS_EMPTY;
+	if (inuse == max_objects)
+		return ZS_FULL;
+	if (inuse <= max_objects * (fullness_threshold_frac - 1) /
+			fullness_threshold_frac)
+		return ZS_ALMOST_EMPTY;
+
+	return ZS_ALMOST_FULL;
+}
+
+/*
+ * Move zspage to the list matching its current fullness. Empty
+ * zspages are taken off all lists; the caller frees them.
+ */
+static enum fullness_group fix_fullness_group(struct size_class *class,
+				struct zspage *zspage)
+{
+	enum fullness_group newfg;
+
+	newfg = get_fullness_group(class, zspage);
+	if (newfg == zspage->fullness)
+		goto out;
+
+	if (zspage->fullness != ZS_EMPTY)
+		list_del_init(&zspage->list);
+	if (newfg != ZS_EMPTY)
+		list_add(&zspage->list, &class->fullness_list[newfg]);
+	zspage->fullness = newfg;
+
+out:
+	return newfg;
+}
+
+/*
+ * We have to decide on how many pages to link together
+ * to form a zspage for each size class. This is important
+ * to reduce wastage due to unusable space left at end of
+ * each zspage which is given as:
+ *	wastage = Zp - Zp % size_class
+ * where Zp = zspage size = k * PAGE_SIZE where k = 1, 2, ...
+ *
+ * For example, for size class of 3/8 * PAGE_SIZE, we should
+ * link together 3 PAGE_SIZE sized pages to form a zspage
+ * since then we can perfectly fit in 8 such objects.
+ */
+static int get_pages_per_zspage(int class_size)
+{
+	int i, max_usedpc = 0;
+	/* zspage order which gives maximum used size per KB */
+	int max_usedpc_order = 1;
+
+	for (i = 1; i <= ZS_MAX_PAGES_PER_ZSPAGE; i++) {
+		int zspage_size;
+		int waste, usedpc;
+
+		zspage_size = i * PAGE_SIZE;
+		waste = zspage_size % class_size;
+		usedpc = (zspage_size - waste) * 100 / zspage_size;
+
+		if (usedpc > max_usedpc) {
+			max_usedpc = usedpc;
+			max_usedpc_order = i;
+		}
+	}
+
+	return max_usedpc_order;
+}
+
+static void free_zspage(struct zs_pool *pool, struct size_class *class,
+			struct zspage *zspage)
+{
+	int i;
+
+	BUG_ON(zspage->inuse);
+
+	for (i = 0; i < class->pages_per_zspage; i++) {
+		set_page_private(zspage->pages[i], 0);
+		__free_page(zspage->pages[i]);
+	}
+	kfree(zspage);
+
+	atomic_long_sub(class->pages_per_zspage, &pool->pages_allocated);
+}
+
+/*
+ * Allocate a zspage for the given size class and link all of its
+ * objects into the free list.
+ */
+static struct zspage *alloc_zspage(struct zs_pool *pool,
+				struct size_class *class)
+{
+	int i;
+	struct zspage *zspage;
+
+	zspage = kzalloc(sizeof(*zspage),
+			pool->flags & ~(__GFP_HIGHMEM | __GFP_MOVABLE));
+	if (!zspage)
+		return NULL;
+
+	for (i = 0; i < class->pages_per_zspage; i++) {
+		zspage->pages[i] = alloc_page(pool->flags);
+		if (!zspage->pages[i])
+			goto cleanup;
+	}
+
+	INIT_LIST_HEAD(&zspage->list);
+	zspage->class_idx = class->index;
+	zspage->fullness = ZS_EMPTY;
+	zspage->freeobj = 0;
+	set_page_private(zspage->pages[0], (unsigned long)zspage);
+
+	/*
+	 * A free object's header holds (next free index + 1), shifted
+	 * past the allocated tag; zero terminates the list.
+	 */
+	for (i = 0; i < class->objs_per_zspage; i++) {
+		unsigned long *header = map_obj_header(class, zspage, i);
+
+		if (i + 1 < class->objs_per_zspage)
+			*header = (unsigned long)(i + 2) << OBJ_TAG_BITS;
+		else
+			*header = 0;
+		unmap_obj_header(header);
+	}
+
+	atomic_long_add(class->pages_per_zspage, &pool->pages_allocated);
+	return zspage;
+
+cleanup:
+	while (--i >= 0)
+		__free_page(zspage->pages[i]);
+	kfree(zspage);
+	return NULL;
+}
+
+static struct zspage *find_get_zspage(struct size_class *class)
+{
+	int i;
+
+	for (i = ZS_ALMOST_FULL; i >= ZS_ALMOST_EMPTY; i--) {
+		if (!list_empty(&class->fullness_list[i]))
+			return list_first_entry(&class->fullness_list[i],
+					struct zspage, list);
+	}
+
+	return NULL;
+}
+
+/*
+ * Take the first free object of @zspage for @handle. Called with
+ * class->lock held.
+ */
+static unsigned int obj_malloc(struct size_class *class,
+			struct zspage *zspage, unsigned long handle)
+{
+	unsigned int obj_idx = zspage->freeobj;
+	unsigned long *header;
+
+	BUG_ON(zspage->freeobj == ZS_NO_FREE_OBJ);
+
+	header = map_obj_header(class, zspage, obj_idx);
+	zspage->freeobj = (int)(*header >> OBJ_TAG_BITS) - 1;
+	*header = handle | OBJ_ALLOCATED_TAG;
+	unmap_obj_header(header);
+
+	zspage->inuse++;
+	class->objs_inuse++;
+
+	return obj_idx;
+}
+
+/* Put object @obj_idx back on the free list. Called with class->lock */
+static void obj_free(struct size_class *class, struct zspage *zspage,
+			unsigned int obj_idx)
+{
+	unsigned long *header;
+
+	header = map_obj_header(class, zspage, obj_idx);
+	*header = (unsigned long)(zspage->freeobj + 1) << OBJ_TAG_BITS;
+	unmap_obj_header(header);
+
+	zspage->freeobj = obj_idx;
+	zspage->inuse--;
+	class->objs_inuse--;
+}
+
+/**
+ * zs_malloc - Allocate block of given size from pool.
+ * @pool: pool to allocate from
+ * @size: size of block to allocate
+ *
+ * On success, handle to the allocated object is returned,
+ * otherwise 0.
+ * Allocation requests with size > ZS_MAX_ALLOC_SIZE will fail.
+ */
+unsigned long zs_malloc(struct zs_pool *pool, size_t size)
+{
+	unsigned long handle;
+	unsigned int obj_idx;
+	struct size_class *class;
+	struct zspage *zspage;
+
+	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE))
+		return 0;
+
+	handle = cache_alloc_handle(pool);
+	if (!handle)
+		return 0;
+	/* clear the pin bit */
+	*(unsigned long *)handle = 0;
+
+	class = &pool->size_class[get_size_class_index(size + ZS_HANDLE_SIZE)];
+
+	spin_lock(&class->lock);
+	zspage = find_get_zspage(class);
+	if (!zspage) {
+		spin_unlock(&class->lock);
+		zspage = alloc_zspage(pool, class);
+		if (unlikely(!zspage)) {
+			cache_free_handle(handle);
+			return 0;
+		}
+		spin_lock(&class->lock);
+		class->zspages++;
+	}
+
+	obj_idx = obj_malloc(class, zspage, handle);
+	/* publish the location before compaction can see the object */
+	record_obj(handle, location_to_obj(zspage, obj_idx));
+	fix_fullness_group(class, zspage);
+	spin_unlock(&class->lock);
+
+	return handle;
+}
+EXPORT_SYMBOL_GPL(zs_malloc);
+
+void zs_free(struct zs_pool *pool, unsigned long handle)
+{
+	unsigned int obj_idx;
+	struct size_class *class;
+	struct zspage *zspage;
+	enum fullness_group fullness;
+
+	if (unlikely(!handle))
+		return;
+
+	pin_tag(handle);
+	zspage = obj_to_location(handle_to_obj(handle), &obj_idx);
+	class = &pool->size_class[zspage->class_idx];
+
+	spin_lock(&class->lock);
+	obj_free(class, zspage, obj_idx);
+	fullness = fix_fullness_group(class, zspage);
+	if (fullness == ZS_EMPTY)
+		class->zspages--;
+	spin_unlock(&class->lock);
+	unpin_tag(handle);
+
+	if (fullness == ZS_EMPTY)
+		free_zspage(pool, class, zspage);
+
+	cache_free_handle(handle);
+}
+EXPORT_SYMBOL_GPL(zs_free);
+
+/**
+ * zs_map_object - get address of allocated object from handle.
+ * @pool: pool from which the object was allocated
+ * @handle: handle returned from zs_malloc
+ * @mm: mapping mode to use
+ *
+ * Before using an object allocated from zs_malloc, it must be mapped
+ * using this function. When done with the object, it must be unmapped
+ * using zs_unmap_object.
+ *
+ * Only one object can be mapped per cpu at a time. There is no
+ * protection against nested mappings.
+ *
+ * This function returns with preemption and page faults disabled.
+ */
+void *zs_map_object(struct zs_pool *pool, unsigned long handle,
+			enum zs_mapmode mm)
+{
+	unsigned int obj_idx;
+	unsigned long off;
+	size_t len;
+	struct zspage *zspage;
+	struct size_class *class;
+	struct mapping_area *area;
+
+	BUG_ON(!handle);
+
+	/* compaction must not move the object while it is mapped */
+	pin_tag(handle);
+
+	zspage = obj_to_location(handle_to_obj(handle), &obj_idx);
+	class = &pool->size_class[zspage->class_idx];
+	off = (unsigned long)obj_idx * class->size + ZS_HANDLE_SIZE;
+	/* the largest class is rounded up past ZS_MAX_ALLOC_SIZE */
+	len = min_t(size_t, class->size - ZS_HANDLE_SIZE, ZS_MAX_ALLOC_SIZE);
+
+	area = &get_cpu_var(zs_map_area);
+	area->vm_mm = mm;
+	if ((off & ~PAGE_MASK) + len <= PAGE_SIZE) {
+		/* this object is contained entirely within a page */
+		area->zspage = NULL;
+		area->vm_addr = kmap_atomic(zspage->pages[off >> PAGE_SHIFT],
+					KM_USER0);
+		return area->vm_addr + (off & ~PAGE_MASK);
+	}
+
+	/* this object spans two pages */
+	area->zspage = zspage;
+	area->offset = off;
+	area->len = len;
+	if (mm != ZS_MM_WO)
+		zspage_rw(zspage, off, area->vm_buf, len, false);
+
+	return area->vm_buf;
+}
+EXPORT_SYMBOL_GPL(zs_map_object);
+
+void zs_unmap_object(struct zs_pool *pool, unsigned long handle)
+{
+	struct mapping_area *area;
+
+	BUG_ON(!handle);
+
+	area = &__get_cpu_var(zs_map_area);
+	if (!area->zspage)
+		kunmap_atomic(area->vm_addr, KM_USER0);
+	else if (area->vm_mm != ZS_MM_RO)
+		zspage_rw(area->zspage, area->offset, area->vm_buf,
+			area->len, true);
+	put_cpu_var(zs_map_area);
+
+	unpin_tag(handle);
+}
+EXPORT_SYMBOL_GPL(zs_unmap_object);
+
+/*
+ * Number of zspages compaction could free in this class if objects
+ * were packed perfectly.
+ */
+static unsigned long zs_can_compact(struct size_class *class)
+{
+	unsigned long obj_wasted;
+
+	obj_wasted = class->zspages * class->objs_per_zspage -
+			class->objs_inuse;
+
+	return obj_wasted / class->objs_per_zspage;
+}
+
+/*
+ * Move every unpinned object out of @src into other zspages of the
+ * same class. Returns true if @src ended up empty. Called with
+ * class->lock held and @src off all fullness lists.
+ */
+static bool migrate_zspage(struct zs_pool *pool, struct size_class *class,
+			struct zspage *src)
+{
+	unsigned int obj_idx;
+	unsigned long handle, *header;
+	struct zspage *dst;
+
+	for (obj_idx = 0; obj_idx < class->objs_per_zspage && src->inuse;
+			obj_idx++) {
+		unsigned int new_idx;
+
+		header = map_obj_header(class, src, obj_idx);
+		handle = *header;
+		unmap_obj_header(header);
+
+		if (!(handle & OBJ_ALLOCATED_TAG))
+			continue;
+		handle &= ~OBJ_ALLOCATED_TAG;
+
+		dst = find_get_zspage(class);
+		if (!dst)
+			break;
+
+		/* mapped or being freed right now: leave it alone */
+		if (!trypin_tag(handle))
+			continue;
+
+		new_idx = obj_malloc(class, dst, handle);
+		zspage_copy(dst, (unsigned long)new_idx * class->size +
+					ZS_HANDLE_SIZE,
+			src, (unsigned long)obj_idx * class->size +
+					ZS_HANDLE_SIZE,
+			class->size - ZS_HANDLE_SIZE);
+		record_obj(handle, location_to_obj(dst, new_idx));
+		obj_free(class, src, obj_idx);
+		fix_fullness_group(class, dst);
+		unpin_tag(handle);
+
+		atomic_long_inc(&pool->objs_migrated);
+	}
+
+	return src->inuse == 0;
+}
+
+static unsigned long zs_compact_class(struct zs_pool *pool,
+			struct size_class *class)
+{
+	unsigned long pages_freed = 0;
+	struct zspage *src;
+	bool emptied;
+
+	spin_lock(&class->lock);
+	while (zs_can_compact(class)) {
+		struct list_head *head = &class->fullness_list[ZS_ALMOST_EMPTY];
+
+		if (list_empty(head))
+			break;
+
+		/* the least used zspages tend to be at the tail */
+		src = list_entry(head->prev, struct zspage, list);
+		list_del_init(&src->list);
+		src->fullness = ZS_EMPTY;
+
+		emptied = migrate_zspage(pool, class, src);
+		if (!emptied) {
+			/* put it back; some objects are pinned or no room */
+			fix_fullness_group(class, src);
+			break;
+		}
+
+		class->zspages--;
+		spin_unlock(&class->lock);
+		free_zspage(pool, class, src);
+		pages_freed += class->pages_per_zspage;
+		cond_resched();
+		spin_lock(&class->lock);
+	}
+	spin_unlock(&class->lock);
+
+	return pages_freed;
+}
+
+/**
+ * zs_compact - move objects to free sparsely used zspages
+ * @pool: pool to compact
+ *
+ * Returns the number of pages released back to the system. Objects
+ * that are mapped while compaction runs are skipped.
+ */
+unsigned long zs_compact(struct zs_pool *pool)
+{
+	int i;
+	unsigned long pages_freed = 0;
+
+	for (i = ZS_SIZE_CLASSES - 1; i >= 0; i--)
+		pages_freed += zs_compact_class(pool, &pool->size_class[i]);
+
+	atomic_long_add(pages_freed, &pool->pages_compacted);
+
+	return pages_freed;
+}
+EXPORT_SYMBOL_GPL(zs_compact);
+
+unsigned long zs_get_total_pages(struct zs_pool *pool)
+{
+	return atomic_long_read(&pool->pages_allocated);
+}
+EXPORT_SYMBOL_GPL(zs_get_total_pages);
+
+void zs_pool_stats(struct zs_pool *pool, struct zs_pool_stats *stats)
+{
+	int i;
+
+	memset(stats, 0, sizeof(*stats));
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+		unsigned long objs_allocated, objs_inuse;
+
+		spin_lock(&class->lock);
+		objs_allocated = class->zspages * class->objs_per_zspage;
+		objs_inuse = class->objs_inuse;
+		spin_unlock(&class->lock);
+
+		stats->objs_bytes += (u64)objs_inuse * class->size;
+		stats->wasted_bytes += (u64)(objs_allocated - objs_inuse) *
+					class->size;
+	}
+
+	stats->pages_allocated = atomic_long_read(&pool->pages_allocated);
+	stats->pages_compacted = atomic_long_read(&pool->pages_compacted);
+	stats->objs_migrated = atomic_long_read(&pool->objs_migrated);
+}
+EXPORT_SYMBOL_GPL(zs_pool_stats);
+
+#ifdef CONFIG_DEBUG_FS
+static struct dentry *zs_stat_root;
+
+static int zs_stats_size_show(struct seq_file *s, void *v)
+{
+	int i;
+	struct zs_pool *pool = s->private;
+	unsigned long total_objs = 0, total_used_objs = 0, total_pages = 0;
+	unsigned long total_freeable = 0;
+
+	seq_printf(s, " %5s %5s %11s %12s %13s %10s %10s %16s\n",
+			"class", "size", "almost_full", "almost_empty",
+			"obj_allocated", "obj_used", "pages_used",
+			"pages_per_zspage");
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+		unsigned long class_almost_full = 0, class_almost_empty = 0;
+		unsigned long obj_allocated, obj_used, pages_used, freeable;
+		struct list_head *pos;
+
+		spin_lock(&class->lock);
+		list_for_each(pos, &class->fullness_list[ZS_ALMOST_FULL])
+			class_almost_full++;
+		list_for_each(pos, &class->fullness_list[ZS_ALMOST_EMPTY])
+			class_almost_empty++;
+		obj_allocated = class->zspages * class->objs_per_zspage;
+		obj_used = class->objs_inuse;
+		freeable = zs_can_compact(class);
+		spin_unlock(&class->lock);
+
+		if (!obj_allocated)
+			continue;
+
+		pages_used = obj_allocated / class->objs_per_zspage *
+				class->pages_per_zspage;
+
+		seq_printf(s, " %5u %5u %11lu %12lu %13lu %10lu %10lu %16d\n",
+			i, class->size, class_almost_full, class_almost_empty,
+			obj_allocated, obj_used, pages_used,
+			class->pages_per_zspage);
+
+		total_objs += obj_allocated;
+		total_used_objs += obj_used;
+		total_pages += pages_used;
+		total_freeable += freeable * class->pages_per_zspage;
+	}
+
+	seq_puts(s, "\n");
+	seq_printf(s, " %5s %5s %11s %12s %13lu %10lu %10lu\n",
+			"Total", "", "", "",
+			total_objs, total_used_objs, total_pages);
+	seq_printf(s, "\nfreeable by compaction: %lu pages\n"
+			"compacted: %ld pages, %ld objects moved\n",
+			total_freeable,
+			atomic_long_read(&pool->pages_compacted),
+			atomic_long_read(&pool->objs_migrated));
+
+	return 0;
+}
+
+static int zs_stats_size_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, zs_stats_size_show, inode->i_private);
+}
+
+static const struct file_operations zs_stat_size_ops = {
+	.open		= zs_stats_size_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void zs_stat_init(void)
+{
+	zs_stat_root = debugfs_create_dir("zsmalloc", NULL);
+	if (!zs_stat_root)
+		pr_warning("zsmalloc: debugfs 'zsmalloc' stat dir creation "
+			"failed\n");
+}
+
+static void zs_stat_exit(void)
+{
+	debugfs_remove_recursive(zs_stat_root);
+}
+
+static void zs_pool_stat_create(struct zs_pool *pool)
+{
+	if (!zs_stat_root)
+		return;
+
+	pool->stat_dentry = debugfs_create_file(pool->name, S_IRUGO,
+					zs_stat_root, pool, &zs_stat_size_ops);
+}
+
+static void zs_pool_stat_destroy(struct zs_pool *pool)
+{
+	debugfs_remove(pool->stat_dentry);
+}
+#else
+static inline void zs_stat_init(void)
+{
+}
+
+static inline void zs_stat_exit(void)
+{
+}
+
+static inline void zs_pool_stat_create(struct zs_pool *pool)
+{
+}
+
+static inline void zs_pool_stat_destroy(struct zs_pool *pool)
+{
+}
+#endif
+
+/**
+ * zs_create_pool - Creates an allocation pool to work from.
+ * @name: name of the pool, used for the debugfs statistics file
+ * @flags: allocation flags used to allocate pool pages
+ *
+ * This function must be called before anything when using
+ * the zsmalloc allocator.
+ *
+ * On success, a pointer to the newly created pool is returned,
+ * otherwise NULL.
+ */
+struct zs_pool *zs_create_pool(const char *name, gfp_t flags)
+{
+	int i;
+	struct zs_pool *pool;
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	pool->name = kstrdup(name, GFP_KERNEL);
+	if (!pool->name) {
+		kfree(pool);
+		return NULL;
+	}
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		int fg;
+		struct size_class *class = &pool->size_class[i];
+
+		class->size = ZS_MIN_ALLOC_SIZE + i * ZS_SIZE_CLASS_DELTA;
+		class->index = i;
+		spin_lock_init(&class->lock);
+		class->pages_per_zspage = get_pages_per_zspage(class->size);
+		class->objs_per_zspage = class->pages_per_zspage *
+					PAGE_SIZE / class->size;
+		for (fg = 0; fg < _ZS_NR_FULLNESS_GROUPS; fg++)
+			INIT_LIST_HEAD(&class->fullness_list[fg]);
+	}
+
+	pool->flags = flags;
+	zs_pool_stat_create(pool);
+
+	return pool;
+}
+EXPORT_SYMBOL_GPL(zs_create_pool);
+
+void zs_destroy_pool(struct zs_pool *pool)
+{
+	int i;
+
+	zs_pool_stat_destroy(pool);
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		int fg;
+		struct size_class *class = &pool->size_class[i];
+
+		for (fg = ZS_ALMOST_EMPTY; fg < _ZS_NR_FULLNESS_GROUPS; fg++) {
+			if (list_empty(&class->fullness_list[fg]))
+				continue;
+
+			pr_info("Freeing non-empty class with size %db, "
+				"fullness group %d\n", class->size, fg);
+		}
+	}
+
+	kfree(pool->name);
+	kfree(pool);
+}
+EXPORT_SYMBOL_GPL(zs_destroy_pool);
+
+static void zs_free_map_areas(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct mapping_area *area = &per_cpu(zs_map_area, cpu);
+
+		kfree(area->vm_buf);
+		area->vm_buf = NULL;
+	}
+}
+
+static int __init zs_init(void)
+{
+	int cpu;
+
+	handle_cachep = kmem_cache_create("zs_handle", ZS_HANDLE_SIZE,
+					0, 0, NULL);
+	if (!handle_cachep)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct mapping_area *area = &per_cpu(zs_map_area, cpu);
+
+		area->vm_buf = kmalloc(ZS_MAX_ALLOC_SIZE, GFP_KERNEL);
+		if (!area->vm_buf) {
+			zs_free_map_areas();
+			kmem_cache_destroy(handle_cachep);
+			return -ENOMEM;
+		}
+	}
+
+	zs_stat_init();
+
+	return 0;
+}
+
+static void __exit zs_exit(void)
+{
+	zs_stat_exit();
+	zs_free_map_areas();
+	kmem_cache_destroy(handle_cachep);
+}
+
+module_init(zs_init);
+module_exit(zs_exit);
+
+MODULE_LICENSE("Dual BSD/GPL");
+MODULE_AUTHOR("Nitin Gupta <ngupta@vflare.org>");
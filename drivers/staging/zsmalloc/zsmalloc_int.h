@@ -0,0 +1,149 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * Copyright (C) 2011  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the license that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZS_MALLOC_INT_H_
+#define _ZS_MALLOC_INT_H_
+
+#include <linux/kernel.h>
+#include <linux/const.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+
+/*
+ * A single 'zspage' is composed of up to 2^N discontiguous 0-order
+ * (i.e. single) pages. This value is chosen so that the largest
+ * objects waste little space while a zspage stays cheap to allocate.
+ */
+#define ZS_MAX_ZSPAGE_ORDER	2
+#define ZS_MAX_PAGES_PER_ZSPAGE	(_AC(1, UL) << ZS_MAX_ZSPAGE_ORDER)
+
+/*
+ * Every object is preceded by a header word. While the object is
+ * allocated it holds the handle pointing to the object (tagged with
+ * OBJ_ALLOCATED_TAG); this back-reference is what lets compaction
+ * move objects and fix up their handles. While the object is free it
+ * links to the next free object of the zspage.
+ */
+#define ZS_HANDLE_SIZE		(sizeof(unsigned long))
+
+#define ZS_MIN_ALLOC_SHIFT	5
+#define ZS_MIN_ALLOC_SIZE	(1 << ZS_MIN_ALLOC_SHIFT)
+#define ZS_MAX_ALLOC_SIZE	PAGE_SIZE
+
+/*
+ * Object location (<PFN of first page>, <obj_idx>) is encoded as
+ * a single (unsigned long) value which is stored in the handle,
+ * shifted left by OBJ_TAG_BITS. The low bit of a handle's value is
+ * the pin bit, taken while the object is mapped or being freed so
+ * that compaction leaves it alone.
+ */
+#define OBJ_TAG_BITS		1
+#define OBJ_ALLOCATED_TAG	1
+#define HANDLE_PIN_BIT		0
+
+#define OBJ_INDEX_BITS	(ZS_MAX_ZSPAGE_ORDER + PAGE_SHIFT - ZS_MIN_ALLOC_SHIFT)
+#define OBJ_INDEX_MASK	((_AC(1, UL) << OBJ_INDEX_BITS) - 1)
+
+/*
+ * Size classes are ZS_SIZE_CLASS_DELTA apart. Object size includes
+ * the header word, so the largest class holds a full page of data.
+ */
+#define ZS_SIZE_CLASS_DELTA	(PAGE_SIZE >> 8)
+#define ZS_SIZE_CLASSES	(DIV_ROUND_UP(ZS_MAX_ALLOC_SIZE + ZS_HANDLE_SIZE - \
+				ZS_MIN_ALLOC_SIZE, ZS_SIZE_CLASS_DELTA) + 1)
+
+/*
+ * We do not maintain any list for completely empty zspages since
+ * they are freed immediately. ALMOST_EMPTY zspages are the sources
+ * for compaction, ALMOST_FULL ones are preferred for allocation.
+ */
+enum fullness_group {
+	ZS_EMPTY,
+	ZS_ALMOST_EMPTY,
+	ZS_ALMOST_FULL,
+	ZS_FULL,
+	_ZS_NR_FULLNESS_GROUPS,
+};
+
+/*
+ * A zspage is considered almost empty once it is no more than
+ * (100 / fullness_threshold_frac)% full.
+ */
+static const int fullness_threshold_frac = 4;
+
+/* No free object in a zspage */
+#define ZS_NO_FREE_OBJ		(-1)
+
+struct zspage {
+	/* entry in size_class->fullness_list */
+	struct list_head list;
+	/* component pages, first_page->private points back here */
+	struct page *pages[ZS_MAX_PAGES_PER_ZSPAGE];
+	/* index of first free object, or ZS_NO_FREE_OBJ */
+	int freeobj;
+	/* no. of allocated objects */
+	unsigned int inuse;
+	u8 class_idx;
+	u8 fullness;
+};
+
+struct size_class {
+	/* protects everything below and all zspages of this class */
+	spinlock_t lock;
+	struct list_head fullness_list[_ZS_NR_FULLNESS_GROUPS];
+	/*
+	 * Size of objects stored in this class, header included. Always
+	 * a multiple of ZS_SIZE_CLASS_DELTA so that object headers never
+	 * span pages.
+	 */
+	int size;
+	unsigned int index;
+
+	/* Number of PAGE_SIZE sized pages to combine to form a 'zspage' */
+	int pages_per_zspage;
+	int objs_per_zspage;
+
+	/* stats */
+	unsigned long zspages;
+	unsigned long objs_inuse;
+};
+
+struct zs_pool {
+	const char *name;
+
+	struct size_class size_class[ZS_SIZE_CLASSES];
+
+	gfp_t flags;	/* allocation flags used when growing pool */
+	atomic_long_t pages_allocated;
+	atomic_long_t pages_compacted;
+	atomic_long_t objs_migrated;
+
+#ifdef CONFIG_DEBUG_FS
+	struct dentry *stat_dentry;
+#endif
+};
+
+/*
+ * Per-cpu area used to access objects that span two pages: the
+ * object is copied in and out of 'vm_buf'.
+ */
+struct mapping_area {
+	char *vm_buf;		/* copy buffer for objects that span pages */
+	char *vm_addr;		/* address of kmap_atomic()'ed page */
+	struct zspage *zspage;	/* zspage of a spanning object */
+	unsigned long offset;	/* offset of a spanning object in zspage */
+	size_t len;		/* payload size of a spanning object */
+	enum zs_mapmode vm_mm;	/* mapping mode */
+};
+
+#endif
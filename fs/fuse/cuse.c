@@ -491,13 +491,16 @@ static int cuse_channel_open(struct inode *inode, struct file *file)
 	cc->fc.release = cuse_fc_release;
 
 	cc->fc.connected = 1;
+	cc->fc.queue.connected = 1;
+	cc->fc.queue.readers = 1;
 	cc->fc.blocked = 0;
 	rc = cuse_send_init(cc);
 	if (rc) {
 		fuse_conn_put(&cc->fc);
 		return rc;
 	}
-	file->private_data = &cc->fc;	/* channel owns base reference to cc */
+	/* channel owns base reference to cc */
+	file->private_data = &cc->fc.queue;
 
 	return 0;
 }
@@ -515,7 +518,8 @@ static int cuse_channel_open(struct inode *inode, struct file *file)
  */
 static int cuse_channel_release(struct inode *inode, struct file *file)
 {
-	struct cuse_conn *cc = fc_to_cc(file->private_data);
+	struct fuse_queue *fq = file->private_data;
+	struct cuse_conn *cc = fc_to_cc(fq->fc);
 	int rc;
 
 	/* remove from the conntbl, no more access from this point on */
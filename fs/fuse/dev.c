@@ -22,17 +22,20 @@
 #include <linux/iocontext.h>
 #include <linux/ioprio.h>
 #include <linux/freezer.h>
+#include <linux/cpumask.h>
+#include <linux/uaccess.h>
 
 MODULE_ALIAS_MISCDEV(FUSE_MINOR);
 MODULE_ALIAS("devname:fuse");
 
 static struct kmem_cache *fuse_req_cachep;
 
-static struct fuse_conn *fuse_get_conn(struct file *file)
+static struct fuse_queue *fuse_get_queue(struct file *file)
 {
 	/*
 	 * Lockless access is OK, because file->private data is set
-	 * once during mount and is valid until the file is released.
+	 * once during mount or clone and is valid until the file is
+	 * released.
 	 */
 	return file->private_data;
 }
@@ -230,14 +233,14 @@ static unsigned len_args(unsigned numargs, struct fuse_arg *args)
 	return nbytes;
 }
 
-static u64 fuse_get_unique(struct fuse_conn *fc)
+/*
+ * IDs are interleaved over the queues of a connection, so they stay
+ * unique whichever queue a request went through.  Zero is special,
+ * the first one is nr_cpu_ids + 1.
+ */
+static u64 fuse_get_unique(struct fuse_queue *fq)
 {
-	fc->reqctr++;
-	/* zero is special */
-	if (fc->reqctr == 0)
-		fc->reqctr = 1;
-
-	return fc->reqctr;
+	return ++fq->reqctr * (nr_cpu_ids + 1) + fq->id;
 }
 
 static inline int is_rt(struct fuse_conn *fc)
@@ -264,49 +267,121 @@ static inline int is_rt(struct fuse_conn *fc)
 	return ret;
 }
 
-static void queue_request(struct fuse_conn *fc, struct fuse_req *req)
+/* Queue @i of the connection, 0 being the shared one, or NULL */
+static struct fuse_queue *fuse_queue_of(struct fuse_conn *fc, int i)
+{
+	struct fuse_queue **cpu_queues;
+	struct fuse_queue *fq;
+
+	if (!i)
+		return &fc->queue;
+
+	cpu_queues = ACCESS_ONCE(fc->cpu_queues);
+	if (!cpu_queues)
+		return NULL;
+	smp_read_barrier_depends();
+	fq = ACCESS_ONCE(cpu_queues[i - 1]);
+	smp_read_barrier_depends();
+
+	return fq;
+}
+
+/*
+ * Lock the queue for a request submitted on this CPU: its own if a
+ * device file was cloned for it, the shared one otherwise.  A CPU
+ * queue is disconnected under its lock when its last reader goes away,
+ * hence the check after locking it.
+ */
+static struct fuse_queue *fuse_lock_queue(struct fuse_conn *fc)
+{
+	struct fuse_queue *fq;
+
+	fq = fuse_queue_of(fc, raw_smp_processor_id() + 1);
+	if (fq && fq->connected) {
+		spin_lock(&fq->lock);
+		if (fq->connected)
+			return fq;
+		spin_unlock(&fq->lock);
+	}
+
+	fq = &fc->queue;
+	spin_lock(&fq->lock);
+	return fq;
+}
+
+/*
+ * Lock the queue of a request after having dropped its lock.  Pending
+ * requests of a CPU queue losing its last reader are moved to the
+ * shared queue, so req->fq may have changed meanwhile.
+ */
+static void lock_req_queue(struct fuse_req *req)
+__acquires(req->fq->lock)
 {
+	struct fuse_queue *fq;
+
+	for (;;) {
+		fq = ACCESS_ONCE(req->fq);
+		spin_lock(&fq->lock);
+		if (fq == req->fq)
+			return;
+		spin_unlock(&fq->lock);
+	}
+}
+
+/* Called with fq->lock */
+static void queue_request(struct fuse_conn *fc, struct fuse_queue *fq,
+			  struct fuse_req *req)
+{
+	int rt = is_rt(fc);
+
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
-	list_add_tail(&req->list, &fc->pending[is_rt(fc)]);
+	req->fq = fq;
+	list_add_tail(&req->list, &fq->pending[rt]);
 	req->state = FUSE_REQ_PENDING;
 	if (!req->waiting) {
 		req->waiting = 1;
 		atomic_inc(&fc->num_waiting);
 	}
-	wake_up(&fc->waitq[is_rt(fc)]);
-	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	wake_up(&fq->waitq[rt]);
+	kill_fasync(&fq->fasync, SIGIO, POLL_IN);
 }
 
 void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 		       u64 nodeid, u64 nlookup)
 {
+	struct fuse_queue *fq;
+
 	forget->forget_one.nodeid = nodeid;
 	forget->forget_one.nlookup = nlookup;
 
-	spin_lock(&fc->lock);
-	if (fc->connected) {
-		fc->forget_list_tail->next = forget;
-		fc->forget_list_tail = forget;
-		wake_up(&fc->waitq[is_rt(fc)]);
-		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	fq = fuse_lock_queue(fc);
+	if (fc->connected && fq->connected) {
+		fq->forget_list_tail->next = forget;
+		fq->forget_list_tail = forget;
+		wake_up(&fq->waitq[is_rt(fc)]);
+		kill_fasync(&fq->fasync, SIGIO, POLL_IN);
 	} else {
 		kfree(forget);
 	}
-	spin_unlock(&fc->lock);
+	spin_unlock(&fq->lock);
 }
 
+/* Called with fc->lock */
 static void flush_bg_queue(struct fuse_conn *fc)
 {
 	while (fc->active_background < fc->max_background &&
 	       !list_empty(&fc->bg_queue)) {
+		struct fuse_queue *fq;
 		struct fuse_req *req;
 
 		req = list_entry(fc->bg_queue.next, struct fuse_req, list);
 		list_del(&req->list);
 		fc->active_background++;
-		req->in.h.unique = fuse_get_unique(fc);
-		queue_request(fc, req);
+		fq = fuse_lock_queue(fc);
+		req->in.h.unique = fuse_get_unique(fq);
+		queue_request(fc, fq, req);
+		spin_unlock(&fq->lock);
 	}
 }
 
@@ -318,17 +393,20 @@ static void flush_bg_queue(struct fuse_conn *fc)
  * the 'end' callback is called if given, else the reference to the
  * request is released
  *
- * Called with fc->lock, unlocks it
+ * Called with req->fq->lock, unlocks it.  Takes fc->lock for the
+ * accounting of background requests.
  */
 static void request_end(struct fuse_conn *fc, struct fuse_req *req)
-__releases(fc->lock)
+__releases(req->fq->lock)
 {
 	void (*end) (struct fuse_conn *, struct fuse_req *) = req->end;
 	req->end = NULL;
 	list_del(&req->list);
 	list_del(&req->intr_entry);
 	req->state = FUSE_REQ_FINISHED;
+	spin_unlock(&req->fq->lock);
 	if (req->background) {
+		spin_lock(&fc->lock);
 		if (fc->num_background == fc->max_background) {
 			fc->blocked = 0;
 			wake_up_all(&fc->blocked_waitq);
@@ -341,8 +419,8 @@ __releases(fc->lock)
 		fc->num_background--;
 		fc->active_background--;
 		flush_bg_queue(fc);
+		spin_unlock(&fc->lock);
 	}
-	spin_unlock(&fc->lock);
 	wake_up(&req->waitq);
 	if (end)
 		end(fc, req);
@@ -351,27 +429,30 @@ __releases(fc->lock)
 
 static void wait_answer_interruptible(struct fuse_conn *fc,
 				      struct fuse_req *req)
-__releases(fc->lock)
-__acquires(fc->lock)
+__releases(req->fq->lock)
+__acquires(req->fq->lock)
 {
 	if (signal_pending(current))
 		return;
 
-	spin_unlock(&fc->lock);
+	spin_unlock(&req->fq->lock);
 	wait_event_interruptible(req->waitq, req->state == FUSE_REQ_FINISHED);
-	spin_lock(&fc->lock);
+	lock_req_queue(req);
 }
 
+/* Called with req->fq->lock */
 static void queue_interrupt(struct fuse_conn *fc, struct fuse_req *req)
 {
-	list_add_tail(&req->intr_entry, &fc->interrupts[is_rt(fc)]);
-	wake_up(&fc->waitq[is_rt(fc)]);
-	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	struct fuse_queue *fq = req->fq;
+
+	list_add_tail(&req->intr_entry, &fq->interrupts[is_rt(fc)]);
+	wake_up(&fq->waitq[is_rt(fc)]);
+	kill_fasync(&fq->fasync, SIGIO, POLL_IN);
 }
 
 static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
-__releases(fc->lock)
-__acquires(fc->lock)
+__releases(req->fq->lock)
+__acquires(req->fq->lock)
 {
 	if (!fc->no_interrupt) {
 		/* Any signal may interrupt this */
@@ -413,12 +494,12 @@ __acquires(fc->lock)
 	 * Either request is already in userspace, or it was forced.
 	 * Wait it out.
 	 */
-	spin_unlock(&fc->lock);
+	spin_unlock(&req->fq->lock);
 
 	while (req->state != FUSE_REQ_FINISHED)
 		wait_event_freezable(req->waitq,
 				     req->state == FUSE_REQ_FINISHED);
-	spin_lock(&fc->lock);
+	lock_req_queue(req);
 
 	if (!req->aborted)
 		return;
@@ -431,30 +512,34 @@ __acquires(fc->lock)
 		   locked state, there mustn't be any filesystem
 		   operation (e.g. page fault), since that could lead
 		   to deadlock */
-		spin_unlock(&fc->lock);
+		spin_unlock(&req->fq->lock);
 		wait_event(req->waitq, !req->locked);
-		spin_lock(&fc->lock);
+		lock_req_queue(req);
 	}
 }
 
 void fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 {
+	struct fuse_queue *fq;
+
 	req->isreply = 1;
-	spin_lock(&fc->lock);
-	if (!fc->connected)
+	fq = fuse_lock_queue(fc);
+	if (!fc->connected || !fq->connected)
 		req->out.h.error = -ENOTCONN;
 	else if (fc->conn_error)
 		req->out.h.error = -ECONNREFUSED;
 	else {
-		req->in.h.unique = fuse_get_unique(fc);
-		queue_request(fc, req);
+		req->in.h.unique = fuse_get_unique(fq);
+		queue_request(fc, fq, req);
 		/* acquire extra reference, since request is still needed
 		   after request_end() */
 		__fuse_get_request(req);
 
 		request_wait_answer(fc, req);
+		/* the request may have been moved to the shared queue */
+		fq = req->fq;
 	}
-	spin_unlock(&fc->lock);
+	spin_unlock(&fq->lock);
 }
 EXPORT_SYMBOL_GPL(fuse_request_send);
 
@@ -481,7 +566,11 @@ static void fuse_request_send_nowait(struct fuse_conn *fc, struct fuse_req *req)
 		fuse_request_send_nowait_locked(fc, req);
 		spin_unlock(&fc->lock);
 	} else {
+		spin_unlock(&fc->lock);
 		req->out.h.error = -ENOTCONN;
+		/* request_end() wants the lock of a queue */
+		req->fq = &fc->queue;
+		spin_lock(&req->fq->lock);
 		request_end(fc, req);
 	}
 }
@@ -496,16 +585,17 @@ EXPORT_SYMBOL_GPL(fuse_request_send_background);
 static int fuse_request_send_notify_reply(struct fuse_conn *fc,
 					  struct fuse_req *req, u64 unique)
 {
+	struct fuse_queue *fq;
 	int err = -ENODEV;
 
 	req->isreply = 0;
 	req->in.h.unique = unique;
-	spin_lock(&fc->lock);
-	if (fc->connected) {
-		queue_request(fc, req);
+	fq = fuse_lock_queue(fc);
+	if (fc->connected && fq->connected) {
+		queue_request(fc, fq, req);
 		err = 0;
 	}
-	spin_unlock(&fc->lock);
+	spin_unlock(&fq->lock);
 
 	return err;
 }
@@ -531,12 +621,12 @@ static int lock_request(struct fuse_conn *fc, struct fuse_req *req)
 {
 	int err = 0;
 	if (req) {
-		spin_lock(&fc->lock);
+		spin_lock(&req->fq->lock);
 		if (req->aborted)
 			err = -ENOENT;
 		else
 			req->locked = 1;
-		spin_unlock(&fc->lock);
+		spin_unlock(&req->fq->lock);
 	}
 	return err;
 }
@@ -549,11 +639,11 @@ static int lock_request(struct fuse_conn *fc, struct fuse_req *req)
 static void unlock_request(struct fuse_conn *fc, struct fuse_req *req)
 {
 	if (req) {
-		spin_lock(&fc->lock);
+		spin_lock(&req->fq->lock);
 		req->locked = 0;
 		if (req->aborted)
 			wake_up(&req->waitq);
-		spin_unlock(&fc->lock);
+		spin_unlock(&req->fq->lock);
 	}
 }
 
@@ -783,12 +873,12 @@ static int fuse_try_move_page(struct fuse_copy_state *cs, struct page **pagep)
 		lru_cache_add_file(newpage);
 
 	err = 0;
-	spin_lock(&cs->fc->lock);
+	spin_lock(&cs->req->fq->lock);
 	if (cs->req->aborted)
 		err = -ENOENT;
 	else
 		*pagep = newpage;
-	spin_unlock(&cs->fc->lock);
+	spin_unlock(&cs->req->fq->lock);
 
 	if (err) {
 		unlock_page(newpage);
@@ -936,36 +1026,36 @@ static int fuse_copy_args(struct fuse_copy_state *cs, unsigned numargs,
 	return err;
 }
 
-static int forget_pending(struct fuse_conn *fc)
+static int forget_pending(struct fuse_queue *fq)
 {
-	return fc->forget_list_head.next != NULL;
+	return fq->forget_list_head.next != NULL;
 }
 
-static int request_pending(struct fuse_conn *fc)
+static int request_pending(struct fuse_conn *fc, struct fuse_queue *fq)
 {
-	return !list_empty(&fc->pending[is_rt(fc)]) ||
-		!list_empty(&fc->interrupts[is_rt(fc)]) || forget_pending(fc);
+	return !list_empty(&fq->pending[is_rt(fc)]) ||
+		!list_empty(&fq->interrupts[is_rt(fc)]) || forget_pending(fq);
 }
 
 /* Wait until a request is available on the pending list */
-static void request_wait(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void request_wait(struct fuse_conn *fc, struct fuse_queue *fq)
+__releases(fq->lock)
+__acquires(fq->lock)
 {
 	DECLARE_WAITQUEUE(wait, current);
 
-	add_wait_queue_exclusive(&fc->waitq[is_rt(fc)], &wait);
-	while (fc->connected && !request_pending(fc)) {
+	add_wait_queue_exclusive(&fq->waitq[is_rt(fc)], &wait);
+	while (fc->connected && fq->connected && !request_pending(fc, fq)) {
 		set_current_state(TASK_INTERRUPTIBLE);
 		if (signal_pending(current))
 			break;
 
-		spin_unlock(&fc->lock);
+		spin_unlock(&fq->lock);
 		schedule();
-		spin_lock(&fc->lock);
+		spin_lock(&fq->lock);
 	}
 	set_current_state(TASK_RUNNING);
-	remove_wait_queue(&fc->waitq[is_rt(fc)], &wait);
+	remove_wait_queue(&fq->waitq[is_rt(fc)], &wait);
 }
 
 /*
@@ -974,11 +1064,12 @@ __acquires(fc->lock)
  * Unlike other requests this is assembled on demand, without a need
  * to allocate a separate fuse_req structure.
  *
- * Called with fc->lock held, releases it
+ * Called with fq->lock held, releases it
  */
-static int fuse_read_interrupt(struct fuse_conn *fc, struct fuse_copy_state *cs,
+static int fuse_read_interrupt(struct fuse_queue *fq,
+			       struct fuse_copy_state *cs,
 			       size_t nbytes, struct fuse_req *req)
-__releases(fc->lock)
+__releases(fq->lock)
 {
 	struct fuse_in_header ih;
 	struct fuse_interrupt_in arg;
@@ -986,7 +1077,7 @@ __releases(fc->lock)
 	int err;
 
 	list_del_init(&req->intr_entry);
-	req->intr_unique = fuse_get_unique(fc);
+	req->intr_unique = fuse_get_unique(fq);
 	memset(&ih, 0, sizeof(ih));
 	memset(&arg, 0, sizeof(arg));
 	ih.len = reqsize;
@@ -994,7 +1085,7 @@ __releases(fc->lock)
 	ih.unique = req->intr_unique;
 	arg.unique = req->in.h.unique;
 
-	spin_unlock(&fc->lock);
+	spin_unlock(&fq->lock);
 	if (nbytes < reqsize)
 		return -EINVAL;
 
@@ -1006,21 +1097,21 @@ __releases(fc->lock)
 	return err ? err : reqsize;
 }
 
-static struct fuse_forget_link *dequeue_forget(struct fuse_conn *fc,
+static struct fuse_forget_link *dequeue_forget(struct fuse_queue *fq,
 					       unsigned max,
 					       unsigned *countp)
 {
-	struct fuse_forget_link *head = fc->forget_list_head.next;
+	struct fuse_forget_link *head = fq->forget_list_head.next;
 	struct fuse_forget_link **newhead = &head;
 	unsigned count;
 
 	for (count = 0; *newhead != NULL && count < max; count++)
 		newhead = &(*newhead)->next;
 
-	fc->forget_list_head.next = *newhead;
+	fq->forget_list_head.next = *newhead;
 	*newhead = NULL;
-	if (fc->forget_list_head.next == NULL)
-		fc->forget_list_tail = &fc->forget_list_head;
+	if (fq->forget_list_head.next == NULL)
+		fq->forget_list_tail = &fq->forget_list_head;
 
 	if (countp != NULL)
 		*countp = count;
@@ -1028,24 +1119,24 @@ static struct fuse_forget_link *dequeue_forget(struct fuse_conn *fc,
 	return head;
 }
 
-static int fuse_read_single_forget(struct fuse_conn *fc,
+static int fuse_read_single_forget(struct fuse_queue *fq,
 				   struct fuse_copy_state *cs,
 				   size_t nbytes)
-__releases(fc->lock)
+__releases(fq->lock)
 {
 	int err;
-	struct fuse_forget_link *forget = dequeue_forget(fc, 1, NULL);
+	struct fuse_forget_link *forget = dequeue_forget(fq, 1, NULL);
 	struct fuse_forget_in arg = {
 		.nlookup = forget->forget_one.nlookup,
 	};
 	struct fuse_in_header ih = {
 		.opcode = FUSE_FORGET,
 		.nodeid = forget->forget_one.nodeid,
-		.unique = fuse_get_unique(fc),
+		.unique = fuse_get_unique(fq),
 		.len = sizeof(ih) + sizeof(arg),
 	};
 
-	spin_unlock(&fc->lock);
+	spin_unlock(&fq->lock);
 	kfree(forget);
 	if (nbytes < ih.len)
 		return -EINVAL;
@@ -1061,9 +1152,9 @@ __releases(fc->lock)
 	return ih.len;
 }
 
-static int fuse_read_batch_forget(struct fuse_conn *fc,
+static int fuse_read_batch_forget(struct fuse_queue *fq,
 				   struct fuse_copy_state *cs, size_t nbytes)
-__releases(fc->lock)
+__releases(fq->lock)
 {
 	int err;
 	unsigned max_forgets;
@@ -1072,18 +1163,18 @@ __releases(fc->lock)
 	struct fuse_batch_forget_in arg = { .count = 0 };
 	struct fuse_in_header ih = {
 		.opcode = FUSE_BATCH_FORGET,
-		.unique = fuse_get_unique(fc),
+		.unique = fuse_get_unique(fq),
 		.len = sizeof(ih) + sizeof(arg),
 	};
 
 	if (nbytes < ih.len) {
-		spin_unlock(&fc->lock);
+		spin_unlock(&fq->lock);
 		return -EINVAL;
 	}
 
 	max_forgets = (nbytes - ih.len) / sizeof(struct fuse_forget_one);
-	head = dequeue_forget(fc, max_forgets, &count);
-	spin_unlock(&fc->lock);
+	head = dequeue_forget(fq, max_forgets, &count);
+	spin_unlock(&fq->lock);
 
 	arg.count = count;
 	ih.len += count * sizeof(struct fuse_forget_one);
@@ -1110,14 +1201,14 @@ __releases(fc->lock)
 	return ih.len;
 }
 
-static int fuse_read_forget(struct fuse_conn *fc, struct fuse_copy_state *cs,
-			    size_t nbytes)
-__releases(fc->lock)
+static int fuse_read_forget(struct fuse_conn *fc, struct fuse_queue *fq,
+			    struct fuse_copy_state *cs, size_t nbytes)
+__releases(fq->lock)
 {
-	if (fc->minor < 16 || fc->forget_list_head.next->next == NULL)
-		return fuse_read_single_forget(fc, cs, nbytes);
+	if (fc->minor < 16 || fq->forget_list_head.next->next == NULL)
+		return fuse_read_single_forget(fq, cs, nbytes);
 	else
-		return fuse_read_batch_forget(fc, cs, nbytes);
+		return fuse_read_batch_forget(fq, cs, nbytes);
 }
 
 /*
@@ -1129,47 +1220,48 @@ __releases(fc->lock)
  * request_end().  Otherwise add it to the processing list, and set
  * the 'sent' flag.
  */
-static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
+static ssize_t fuse_dev_do_read(struct fuse_queue *fq, struct file *file,
 				struct fuse_copy_state *cs, size_t nbytes)
 {
 	int err;
+	struct fuse_conn *fc = fq->fc;
 	struct fuse_req *req;
 	struct fuse_in *in;
 	unsigned reqsize;
 
  restart:
-	spin_lock(&fc->lock);
+	spin_lock(&fq->lock);
 	err = -EAGAIN;
-	if ((file->f_flags & O_NONBLOCK) && fc->connected &&
-	    !request_pending(fc))
+	if ((file->f_flags & O_NONBLOCK) && fc->connected && fq->connected &&
+	    !request_pending(fc, fq))
 		goto err_unlock;
 
-	request_wait(fc);
+	request_wait(fc, fq);
 	err = -ENODEV;
-	if (!fc->connected)
+	if (!fc->connected || !fq->connected)
 		goto err_unlock;
 	err = -ERESTARTSYS;
-	if (!request_pending(fc))
+	if (!request_pending(fc, fq))
 		goto err_unlock;
 
-	if (!list_empty(&fc->interrupts[is_rt(fc)])) {
-		req = list_entry(fc->interrupts[is_rt(fc)].next,
+	if (!list_empty(&fq->interrupts[is_rt(fc)])) {
+		req = list_entry(fq->interrupts[is_rt(fc)].next,
 				struct fuse_req, intr_entry);
-		return fuse_read_interrupt(fc, cs, nbytes, req);
+		return fuse_read_interrupt(fq, cs, nbytes, req);
 	}
 
-	if (forget_pending(fc)) {
-		if (list_empty(&fc->pending[is_rt(fc)]) ||
-			fc->forget_batch-- > 0)
-			return fuse_read_forget(fc, cs, nbytes);
+	if (forget_pending(fq)) {
+		if (list_empty(&fq->pending[is_rt(fc)]) ||
+			fq->forget_batch-- > 0)
+			return fuse_read_forget(fc, fq, cs, nbytes);
 
-		if (fc->forget_batch <= -8)
-			fc->forget_batch = 16;
+		if (fq->forget_batch <= -8)
+			fq->forget_batch = 16;
 	}
 
-	req = list_entry(fc->pending[is_rt(fc)].next, struct fuse_req, list);
+	req = list_entry(fq->pending[is_rt(fc)].next, struct fuse_req, list);
 	req->state = FUSE_REQ_READING;
-	list_move(&req->list, &fc->io);
+	list_move(&req->list, &fq->io);
 
 	in = &req->in;
 	reqsize = in->h.len;
@@ -1182,14 +1274,14 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 		request_end(fc, req);
 		goto restart;
 	}
-	spin_unlock(&fc->lock);
+	spin_unlock(&fq->lock);
 	cs->req = req;
 	err = fuse_copy_one(cs, &in->h, sizeof(in->h));
 	if (!err)
 		err = fuse_copy_args(cs, in->numargs, in->argpages,
 				     (struct fuse_arg *) in->args, 0);
 	fuse_copy_finish(cs);
-	spin_lock(&fc->lock);
+	spin_lock(&fq->lock);
 	req->locked = 0;
 	if (req->aborted) {
 		request_end(fc, req);
@@ -1204,15 +1296,15 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 		request_end(fc, req);
 	else {
 		req->state = FUSE_REQ_SENT;
-		list_move_tail(&req->list, &fc->processing);
+		list_move_tail(&req->list, &fq->processing);
 		if (req->interrupted)
 			queue_interrupt(fc, req);
-		spin_unlock(&fc->lock);
+		spin_unlock(&fq->lock);
 	}
 	return reqsize;
 
  err_unlock:
-	spin_unlock(&fc->lock);
+	spin_unlock(&fq->lock);
 	return err;
 }
 
@@ -1221,13 +1313,13 @@ static ssize_t fuse_dev_read(struct kiocb *iocb, const struct iovec *iov,
 {
 	struct fuse_copy_state cs;
 	struct file *file = iocb->ki_filp;
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_queue *fq = fuse_get_queue(file);
+	if (!fq)
 		return -EPERM;
 
-	fuse_copy_init(&cs, fc, 1, iov, nr_segs);
+	fuse_copy_init(&cs, fq->fc, 1, iov, nr_segs);
 
-	return fuse_dev_do_read(fc, file, &cs, iov_length(iov, nr_segs));
+	return fuse_dev_do_read(fq, file, &cs, iov_length(iov, nr_segs));
 }
 
 static int fuse_dev_pipe_buf_steal(struct pipe_inode_info *pipe,
@@ -1255,18 +1347,18 @@ static ssize_t fuse_dev_splice_read(struct file *in, loff_t *ppos,
 	int do_wakeup = 0;
 	struct pipe_buffer *bufs;
 	struct fuse_copy_state cs;
-	struct fuse_conn *fc = fuse_get_conn(in);
-	if (!fc)
+	struct fuse_queue *fq = fuse_get_queue(in);
+	if (!fq)
 		return -EPERM;
 
 	bufs = kmalloc(pipe->buffers * sizeof(struct pipe_buffer), GFP_KERNEL);
 	if (!bufs)
 		return -ENOMEM;
 
-	fuse_copy_init(&cs, fc, 1, NULL, 0);
+	fuse_copy_init(&cs, fq->fc, 1, NULL, 0);
 	cs.pipebufs = bufs;
 	cs.pipe = pipe;
-	ret = fuse_dev_do_read(fc, in, &cs, len);
+	ret = fuse_dev_do_read(fq, in, &cs, len);
 	if (ret < 0)
 		goto out;
 
@@ -1636,11 +1728,11 @@ static int fuse_notify(struct fuse_conn *fc, enum fuse_notify_code code,
 }
 
 /* Look up request on processing list by unique ID */
-static struct fuse_req *request_find(struct fuse_conn *fc, u64 unique)
+static struct fuse_req *request_find(struct fuse_queue *fq, u64 unique)
 {
 	struct list_head *entry;
 
-	list_for_each(entry, &fc->processing) {
+	list_for_each(entry, &fq->processing) {
 		struct fuse_req *req;
 		req = list_entry(entry, struct fuse_req, list);
 		if (req->in.h.unique == unique || req->intr_unique == unique)
@@ -1678,11 +1770,16 @@ static int copy_out_args(struct fuse_copy_state *cs, struct fuse_out *out,
  * list by the unique ID found in the header.  If found, then remove
  * it from the list and copy the rest of the buffer to the request.
  * The request is finished by calling request_end()
+ *
+ * Replies are looked up on the queue the device file reads, so they
+ * have to be written to the file the request was read from, or to
+ * another one reading the same queue.
  */
-static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
+static ssize_t fuse_dev_do_write(struct fuse_queue *fq,
 				 struct fuse_copy_state *cs, size_t nbytes)
 {
 	int err;
+	struct fuse_conn *fc = fq->fc;
 	struct fuse_req *req;
 	struct fuse_out_header oh;
 
@@ -1710,19 +1807,19 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 	if (oh.error <= -1000 || oh.error > 0)
 		goto err_finish;
 
-	spin_lock(&fc->lock);
+	spin_lock(&fq->lock);
 	err = -ENOENT;
 	if (!fc->connected)
 		goto err_unlock;
 
-	req = request_find(fc, oh.unique);
+	req = request_find(fq, oh.unique);
 	if (!req)
 		goto err_unlock;
 
 	if (req->aborted) {
-		spin_unlock(&fc->lock);
+		spin_unlock(&fq->lock);
 		fuse_copy_finish(cs);
-		spin_lock(&fc->lock);
+		spin_lock(&fq->lock);
 		request_end(fc, req);
 		return -ENOENT;
 	}
@@ -1737,24 +1834,24 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 		else if (oh.error == -EAGAIN)
 			queue_interrupt(fc, req);
 
-		spin_unlock(&fc->lock);
+		spin_unlock(&fq->lock);
 		fuse_copy_finish(cs);
 		return nbytes;
 	}
 
 	req->state = FUSE_REQ_WRITING;
-	list_move(&req->list, &fc->io);
+	list_move(&req->list, &fq->io);
 	req->out.h = oh;
 	req->locked = 1;
 	cs->req = req;
 	if (!req->out.page_replace)
 		cs->move_pages = 0;
-	spin_unlock(&fc->lock);
+	spin_unlock(&fq->lock);
 
 	err = copy_out_args(cs, &req->out, nbytes);
 	fuse_copy_finish(cs);
 
-	spin_lock(&fc->lock);
+	spin_lock(&fq->lock);
 	req->locked = 0;
 	if (!err) {
 		if (req->aborted)
@@ -1766,7 +1863,7 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 	return err ? err : nbytes;
 
  err_unlock:
-	spin_unlock(&fc->lock);
+	spin_unlock(&fq->lock);
  err_finish:
 	fuse_copy_finish(cs);
 	return err;
@@ -1776,13 +1873,13 @@ static ssize_t fuse_dev_write(struct kiocb *iocb, const struct iovec *iov,
 			      unsigned long nr_segs, loff_t pos)
 {
 	struct fuse_copy_state cs;
-	struct fuse_conn *fc = fuse_get_conn(iocb->ki_filp);
-	if (!fc)
+	struct fuse_queue *fq = fuse_get_queue(iocb->ki_filp);
+	if (!fq)
 		return -EPERM;
 
-	fuse_copy_init(&cs, fc, 0, iov, nr_segs);
+	fuse_copy_init(&cs, fq->fc, 0, iov, nr_segs);
 
-	return fuse_dev_do_write(fc, &cs, iov_length(iov, nr_segs));
+	return fuse_dev_do_write(fq, &cs, iov_length(iov, nr_segs));
 }
 
 static ssize_t fuse_dev_splice_write(struct pipe_inode_info *pipe,
@@ -1793,12 +1890,12 @@ static ssize_t fuse_dev_splice_write(struct pipe_inode_info *pipe,
 	unsigned idx;
 	struct pipe_buffer *bufs;
 	struct fuse_copy_state cs;
-	struct fuse_conn *fc;
+	struct fuse_queue *fq;
 	size_t rem;
 	ssize_t ret;
 
-	fc = fuse_get_conn(out);
-	if (!fc)
+	fq = fuse_get_queue(out);
+	if (!fq)
 		return -EPERM;
 
 	bufs = kmalloc(pipe->buffers * sizeof(struct pipe_buffer), GFP_KERNEL);
@@ -1845,14 +1942,14 @@ static ssize_t fuse_dev_splice_write(struct pipe_inode_info *pipe,
 	}
 	pipe_unlock(pipe);
 
-	fuse_copy_init(&cs, fc, 0, NULL, nbuf);
+	fuse_copy_init(&cs, fq->fc, 0, NULL, nbuf);
 	cs.pipebufs = bufs;
 	cs.pipe = pipe;
 
 	if (flags & SPLICE_F_MOVE)
 		cs.move_pages = 1;
 
-	ret = fuse_dev_do_write(fc, &cs, len);
+	ret = fuse_dev_do_write(fq, &cs, len);
 
 	for (idx = 0; idx < nbuf; idx++) {
 		struct pipe_buffer *buf = &bufs[idx];
@@ -1866,18 +1963,20 @@ out:
 static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 {
 	unsigned mask = POLLOUT | POLLWRNORM;
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_queue *fq = fuse_get_queue(file);
+	struct fuse_conn *fc;
+	if (!fq)
 		return POLLERR;
 
-	poll_wait(file, &fc->waitq[is_rt(fc)], wait);
+	fc = fq->fc;
+	poll_wait(file, &fq->waitq[is_rt(fc)], wait);
 
-	spin_lock(&fc->lock);
-	if (!fc->connected)
+	spin_lock(&fq->lock);
+	if (!fc->connected || !fq->connected)
 		mask = POLLERR;
-	else if (request_pending(fc))
+	else if (request_pending(fc, fq))
 		mask |= POLLIN | POLLRDNORM;
-	spin_unlock(&fc->lock);
+	spin_unlock(&fq->lock);
 
 	return mask;
 }
@@ -1885,18 +1984,19 @@ static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 /*
  * Abort all requests on the given list (pending or processing)
  *
- * This function releases and reacquires fc->lock
+ * This function releases and reacquires fq->lock
  */
-static void end_requests(struct fuse_conn *fc, struct list_head *head)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void end_requests(struct fuse_conn *fc, struct fuse_queue *fq,
+			 struct list_head *head)
+__releases(fq->lock)
+__acquires(fq->lock)
 {
 	while (!list_empty(head)) {
 		struct fuse_req *req;
 		req = list_entry(head->next, struct fuse_req, list);
 		req->out.h.error = -ECONNABORTED;
 		request_end(fc, req);
-		spin_lock(&fc->lock);
+		spin_lock(&fq->lock);
 	}
 }
 
@@ -1911,13 +2011,13 @@ __acquires(fc->lock)
  * called after waiting for the request to be unlocked (if it was
  * locked).
  */
-static void end_io_requests(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void end_io_requests(struct fuse_conn *fc, struct fuse_queue *fq)
+__releases(fq->lock)
+__acquires(fq->lock)
 {
-	while (!list_empty(&fc->io)) {
+	while (!list_empty(&fq->io)) {
 		struct fuse_req *req =
-			list_entry(fc->io.next, struct fuse_req, list);
+			list_entry(fq->io.next, struct fuse_req, list);
 		void (*end) (struct fuse_conn *, struct fuse_req *) = req->end;
 
 		req->aborted = 1;
@@ -1928,26 +2028,24 @@ __acquires(fc->lock)
 		if (end) {
 			req->end = NULL;
 			__fuse_get_request(req);
-			spin_unlock(&fc->lock);
+			spin_unlock(&fq->lock);
 			wait_event(req->waitq, !req->locked);
 			end(fc, req);
 			fuse_put_request(fc, req);
-			spin_lock(&fc->lock);
+			spin_lock(&fq->lock);
 		}
 	}
 }
 
-static void end_queued_requests(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void end_queued_requests(struct fuse_conn *fc, struct fuse_queue *fq)
+__releases(fq->lock)
+__acquires(fq->lock)
 {
-	fc->max_background = UINT_MAX;
-	flush_bg_queue(fc);
-	end_requests(fc, &fc->pending[0]);
-	end_requests(fc, &fc->pending[1]);
-	end_requests(fc, &fc->processing);
-	while (forget_pending(fc))
-		kfree(dequeue_forget(fc, 1, NULL));
+	end_requests(fc, fq, &fq->pending[0]);
+	end_requests(fc, fq, &fq->pending[1]);
+	end_requests(fc, fq, &fq->processing);
+	while (forget_pending(fq))
+		kfree(dequeue_forget(fq, 1, NULL));
 }
 
 static void end_polls(struct fuse_conn *fc)
@@ -1965,6 +2063,52 @@ static void end_polls(struct fuse_conn *fc)
 	}
 }
 
+/*
+ * Disconnect and end all requests of all queues.
+ *
+ * Requests set aside in the background are queued first, so they are
+ * ended together with the rest.  Once its queue is disconnected no
+ * request can progress onto the pending list anymore.
+ *
+ * Called with fc->lock, unlocks it
+ */
+static void end_conn(struct fuse_conn *fc)
+__releases(fc->lock)
+{
+	struct fuse_queue *fq;
+	int i;
+
+	fc->connected = 0;
+	fc->blocked = 0;
+	fc->max_background = UINT_MAX;
+	flush_bg_queue(fc);
+	for (i = 0; i <= nr_cpu_ids; i++) {
+		fq = fuse_queue_of(fc, i);
+		if (fq) {
+			spin_lock(&fq->lock);
+			fq->connected = 0;
+			spin_unlock(&fq->lock);
+		}
+	}
+	end_polls(fc);
+	spin_unlock(&fc->lock);
+
+	for (i = 0; i <= nr_cpu_ids; i++) {
+		fq = fuse_queue_of(fc, i);
+		if (!fq)
+			continue;
+
+		spin_lock(&fq->lock);
+		end_io_requests(fc, fq);
+		end_queued_requests(fc, fq);
+		wake_up_all(&fq->waitq[0]);
+		wake_up_all(&fq->waitq[1]);
+		spin_unlock(&fq->lock);
+		kill_fasync(&fq->fasync, SIGIO, POLL_IN);
+	}
+	wake_up_all(&fc->blocked_waitq);
+}
+
 /*
  * Abort all requests.
  *
@@ -1978,7 +2122,7 @@ static void end_polls(struct fuse_conn *fc)
  *
  * During the aborting, progression of requests from the pending and
  * processing lists onto the io list, and progression of new requests
- * onto the pending list is prevented by req->connected being false.
+ * onto the pending list is prevented by fq->connected being false.
  *
  * Progression of requests under I/O to the processing list is
  * prevented by the req->aborted flag being true for these requests.
@@ -1987,32 +2131,83 @@ static void end_polls(struct fuse_conn *fc)
 void fuse_abort_conn(struct fuse_conn *fc)
 {
 	spin_lock(&fc->lock);
-	if (fc->connected) {
-		fc->connected = 0;
-		fc->blocked = 0;
-		end_io_requests(fc);
-		end_queued_requests(fc);
-		end_polls(fc);
-		wake_up_all(&fc->waitq[0]);
-		wake_up_all(&fc->waitq[1]);
-		wake_up_all(&fc->blocked_waitq);
-		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	if (fc->connected)
+		end_conn(fc);
+	else
+		spin_unlock(&fc->lock);
+}
+EXPORT_SYMBOL_GPL(fuse_abort_conn);
+
+/*
+ * The last reader of a CPU queue went away.  Requests not read yet are
+ * moved to the shared queue, which takes the new ones as well from now
+ * on.  Those read but not answered never will be and are failed.
+ *
+ * Once the connection has ended, the shared queue may already have been
+ * emptied by end_conn(), so everything is ended here instead.
+ *
+ * Called with fc->lock, unlocks it
+ */
+static void unbind_queue(struct fuse_conn *fc, struct fuse_queue *fq)
+__releases(fc->lock)
+{
+	struct fuse_queue *shared = &fc->queue;
+	struct fuse_req *req;
+	LIST_HEAD(unanswered);
+	int rt;
+
+	spin_lock(&fq->lock);
+	fq->connected = 0;
+	if (!fc->connected) {
+		spin_unlock(&fc->lock);
+		end_io_requests(fc, fq);
+		end_queued_requests(fc, fq);
+		spin_unlock(&fq->lock);
+		return;
+	}
+	spin_lock_nested(&shared->lock, SINGLE_DEPTH_NESTING);
+	for (rt = 0; rt < 2; rt++) {
+		list_for_each_entry(req, &fq->pending[rt], list)
+			req->fq = shared;
+		list_splice_tail_init(&fq->pending[rt], &shared->pending[rt]);
 	}
+	if (forget_pending(fq)) {
+		shared->forget_list_tail->next = fq->forget_list_head.next;
+		shared->forget_list_tail = fq->forget_list_tail;
+		fq->forget_list_head.next = NULL;
+		fq->forget_list_tail = &fq->forget_list_head;
+	}
+	wake_up_all(&shared->waitq[0]);
+	wake_up_all(&shared->waitq[1]);
+	kill_fasync(&shared->fasync, SIGIO, POLL_IN);
+	spin_unlock(&shared->lock);
+	list_splice_init(&fq->processing, &unanswered);
 	spin_unlock(&fc->lock);
+
+	end_requests(fc, fq, &unanswered);
+	spin_unlock(&fq->lock);
 }
-EXPORT_SYMBOL_GPL(fuse_abort_conn);
 
+/*
+ * The connection ends with the last reader of the shared queue, which
+ * at least the device file it was mounted with is until it is closed.
+ */
 int fuse_dev_release(struct inode *inode, struct file *file)
 {
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (fc) {
+	struct fuse_queue *fq = fuse_get_queue(file);
+	if (fq) {
+		struct fuse_conn *fc = fq->fc;
+
 		spin_lock(&fc->lock);
-		fc->connected = 0;
-		fc->blocked = 0;
-		end_queued_requests(fc);
-		end_polls(fc);
-		wake_up_all(&fc->blocked_waitq);
-		spin_unlock(&fc->lock);
+		spin_lock(&fq->lock);
+		fq->readers--;
+		spin_unlock(&fq->lock);
+		if (fq->readers)
+			spin_unlock(&fc->lock);
+		else if (fq == &fc->queue)
+			end_conn(fc);
+		else
+			unbind_queue(fc, fq);
 		fuse_conn_put(fc);
 	}
 
@@ -2022,13 +2217,183 @@ EXPORT_SYMBOL_GPL(fuse_dev_release);
 
 static int fuse_dev_fasync(int fd, struct file *file, int on)
 {
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_queue *fq = fuse_get_queue(file);
+	if (!fq)
 		return -EPERM;
 
 	/* No locking - fasync_helper does its own locking */
-	return fasync_helper(fd, file, on, &fc->fasync);
+	return fasync_helper(fd, file, on, &fq->fasync);
+}
+
+/* Called with fuse_mutex, the queue of @cpu is allocated on first use */
+static struct fuse_queue *fuse_get_cpu_queue(struct fuse_conn *fc, int cpu)
+{
+	struct fuse_queue **cpu_queues;
+	struct fuse_queue *fq;
+
+	if (!fc->cpu_queues) {
+		cpu_queues = kcalloc(nr_cpu_ids, sizeof(*cpu_queues),
+				     GFP_KERNEL);
+		if (!cpu_queues)
+			return NULL;
+
+		spin_lock(&fc->lock);
+		smp_wmb();
+		fc->cpu_queues = cpu_queues;
+		spin_unlock(&fc->lock);
+	}
+
+	if (!fc->cpu_queues[cpu]) {
+		fq = kzalloc(sizeof(*fq), GFP_KERNEL);
+		if (!fq)
+			return NULL;
+
+		fuse_queue_init(fq, fc, cpu + 1);
+		spin_lock(&fc->lock);
+		smp_wmb();
+		fc->cpu_queues[cpu] = fq;
+		spin_unlock(&fc->lock);
+	}
+
+	return fc->cpu_queues[cpu];
+}
+
+/*
+ * Make a newly opened device file read the requests of the connection
+ * @clone->fd belongs to: those submitted on @clone->cpu, or the ones
+ * going to the shared queue if that is -1.
+ */
+static int fuse_dev_clone(struct file *file, struct fuse_dev_clone *clone)
+{
+	struct fuse_queue *fq;
+	struct fuse_conn *fc;
+	struct file *old;
+	int err;
+
+	old = fget(clone->fd);
+	if (!old)
+		return -EBADF;
+
+	mutex_lock(&fuse_mutex);
+	err = -EINVAL;
+	if (old->f_op != &fuse_dev_operations || !fuse_get_queue(old) ||
+	    file->private_data)
+		goto out_unlock;
+
+	if (clone->cpu < -1 || clone->cpu >= (int)nr_cpu_ids ||
+	    (clone->cpu >= 0 && !cpu_possible(clone->cpu)))
+		goto out_unlock;
+
+	fc = fuse_get_queue(old)->fc;
+	fq = &fc->queue;
+	if (clone->cpu >= 0) {
+		err = -ENOMEM;
+		fq = fuse_get_cpu_queue(fc, clone->cpu);
+		if (!fq)
+			goto out_unlock;
+	}
+
+	spin_lock(&fc->lock);
+	err = -ENOTCONN;
+	if (fc->connected) {
+		spin_lock(&fq->lock);
+		fq->readers++;
+		fq->connected = 1;
+		spin_unlock(&fq->lock);
+		fuse_conn_get(fc);
+		file->private_data = fq;
+		err = 0;
+	}
+	spin_unlock(&fc->lock);
+
+ out_unlock:
+	mutex_unlock(&fuse_mutex);
+	fput(old);
+	return err;
+}
+
+static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
+			   unsigned long arg)
+{
+	struct fuse_dev_clone clone;
+	struct fuse_queue *fq;
+	u32 lower_fd;
+
+	switch (cmd) {
+	case FUSE_DEV_IOC_CLONE:
+		if (get_user(clone.fd, (u32 __user *)arg))
+			return -EFAULT;
+		clone.cpu = -1;
+		return fuse_dev_clone(file, &clone);
+
+	case FUSE_DEV_IOC_CLONE_CPU:
+		if (copy_from_user(&clone, (void __user *)arg, sizeof(clone)))
+			return -EFAULT;
+		return fuse_dev_clone(file, &clone);
+
+	case FUSE_DEV_IOC_PASSTHROUGH_OPEN:
+		fq = fuse_get_queue(file);
+		if (!fq)
+			return -EPERM;
+		if (get_user(lower_fd, (u32 __user *)arg))
+			return -EFAULT;
+		return fuse_passthrough_open(fq->fc, lower_fd);
+
+	default:
+		return -ENOTTY;
+	}
+}
+
+void fuse_queue_init(struct fuse_queue *fq, struct fuse_conn *fc,
+		     unsigned id)
+{
+	spin_lock_init(&fq->lock);
+	fq->fc = fc;
+	fq->id = id;
+	init_waitqueue_head(&fq->waitq[0]);
+	init_waitqueue_head(&fq->waitq[1]);
+	INIT_LIST_HEAD(&fq->pending[0]);
+	INIT_LIST_HEAD(&fq->pending[1]);
+	INIT_LIST_HEAD(&fq->processing);
+	INIT_LIST_HEAD(&fq->io);
+	INIT_LIST_HEAD(&fq->interrupts[0]);
+	INIT_LIST_HEAD(&fq->interrupts[1]);
+	fq->forget_list_tail = &fq->forget_list_head;
+}
+EXPORT_SYMBOL_GPL(fuse_queue_init);
+
+void fuse_free_queues(struct fuse_conn *fc)
+{
+	int cpu;
+
+	if (!fc->cpu_queues)
+		return;
+
+	for (cpu = 0; cpu < nr_cpu_ids; cpu++)
+		kfree(fc->cpu_queues[cpu]);
+	kfree(fc->cpu_queues);
+	fc->cpu_queues = NULL;
+}
+
+void fuse_wake_up_readers(struct fuse_conn *fc)
+{
+	struct fuse_queue *fq;
+	int i;
+
+	for (i = 0; i <= nr_cpu_ids; i++) {
+		fq = fuse_queue_of(fc, i);
+		if (!fq)
+			continue;
+
+		/* under the lock, for readers checking fc->connected */
+		spin_lock(&fq->lock);
+		wake_up_all(&fq->waitq[0]);
+		wake_up_all(&fq->waitq[1]);
+		spin_unlock(&fq->lock);
+		kill_fasync(&fq->fasync, SIGIO, POLL_IN);
+	}
 }
+EXPORT_SYMBOL_GPL(fuse_wake_up_readers);
 
 const struct file_operations fuse_dev_operations = {
 	.owner		= THIS_MODULE,
@@ -2042,6 +2407,8 @@ const struct file_operations fuse_dev_operations = {
 	.poll		= fuse_dev_poll,
 	.release	= fuse_dev_release,
 	.fasync		= fuse_dev_fasync,
+	.unlocked_ioctl	= fuse_dev_ioctl,
+	.compat_ioctl	= fuse_dev_ioctl,
 };
 EXPORT_SYMBOL_GPL(fuse_dev_operations);
 
@@ -22,6 +22,10 @@
 #include <linux/rbtree.h>
 #include <linux/poll.h>
 #include <linux/workqueue.h>
+#include <linux/idr.h>
+
+/** f_type of statfs, also tells FUSE files apart from others */
+#define FUSE_SUPER_MAGIC 0x65735546
 
 /** Max number of pages that can be used in a single read request */
 #define FUSE_MAX_PAGES_PER_REQ 32
@@ -65,6 +69,15 @@ struct fuse_forget_link {
 	struct fuse_forget_link *next;
 };
 
+/** Lower file serving the data of a FUSE file */
+struct fuse_passthrough {
+	/** The lower file, NULL if the daemon serves the data */
+	struct file *filp;
+
+	/** Credentials of the daemon used for accessing it */
+	const struct cred *cred;
+};
+
 /** FUSE inode */
 struct fuse_inode {
 	/** Inode data */
@@ -111,6 +124,7 @@ struct fuse_inode {
 };
 
 struct fuse_conn;
+struct fuse_queue;
 
 /** FUSE specific file data */
 struct fuse_file {
@@ -143,6 +157,9 @@ struct fuse_file {
 
 	/** Wait queue head for poll */
 	wait_queue_head_t poll_wait;
+
+	/** Lower file for passthrough */
+	struct fuse_passthrough passthrough;
 };
 
 /** One input argument of a request */
@@ -217,7 +234,7 @@ enum fuse_req_state {
  */
 struct fuse_req {
 	/** This can be on either pending processing or io lists in
-	    fuse_conn */
+	    fuse_queue */
 	struct list_head list;
 
 	/** Entry on the interrupts list  */
@@ -229,10 +246,13 @@ struct fuse_req {
 	/** Unique ID for the interrupt request */
 	u64 intr_unique;
 
+	/** Queue the request was submitted to, set when it is queued */
+	struct fuse_queue *fq;
+
 	/*
 	 * The following bitfields are either set once before the
 	 * request is queued or setting/clearing them is protected by
-	 * fuse_conn->lock
+	 * fq->lock
 	 */
 
 	/** True if the request has reply */
@@ -317,6 +337,62 @@ struct fuse_req {
 	struct file *stolen_file;
 };
 
+/**
+ * A queue of requests to userspace.
+ *
+ * Every connection has a shared queue, read through the device file
+ * the filesystem was mounted with.  Device files cloned for a CPU with
+ * FUSE_DEV_IOC_CLONE_CPU add a queue of its own for that CPU, which the
+ * requests submitted there go to for as long as it has readers.  This
+ * way neither the lock nor the wakeups are shared between CPUs.
+ */
+struct fuse_queue {
+	/** Lock protecting the lists and the requests on them */
+	spinlock_t lock;
+
+	/** The connection this queue belongs to */
+	struct fuse_conn *fc;
+
+	/** Taking requests.  Cleared on abort and when the last reader
+	    of a CPU queue goes away */
+	unsigned connected;
+
+	/** Number of device files reading this queue, changed under
+	    both fc->lock and lock */
+	unsigned readers;
+
+	/** 0 for the shared queue, CPU + 1 otherwise */
+	unsigned id;
+
+	/** Readers of the queue are waiting on this */
+	wait_queue_head_t waitq[2];
+
+	/** The list of pending requests */
+	struct list_head pending[2];
+
+	/** The list of requests being processed */
+	struct list_head processing;
+
+	/** The list of requests under I/O */
+	struct list_head io;
+
+	/** Pending interrupts */
+	struct list_head interrupts[2];
+
+	/** Queue of pending forgets */
+	struct fuse_forget_link forget_list_head;
+	struct fuse_forget_link *forget_list_tail;
+
+	/** Batching of FORGET requests (positive indicates FORGET batch) */
+	int forget_batch;
+
+	/** The next unique request id */
+	u64 reqctr;
+
+	/** O_ASYNC requests */
+	struct fasync_struct *fasync;
+} ____cacheline_aligned_in_smp;
+
 /**
  * A Fuse connection.
  *
@@ -349,17 +425,12 @@ struct fuse_conn {
 	/** Maximum write size */
 	unsigned max_write;
 
-	/** Readers of the connection are waiting on this */
-	wait_queue_head_t waitq[2];
+	/** The shared request queue */
+	struct fuse_queue queue;
 
-	/** The list of pending requests */
-	struct list_head pending[2];
-
-	/** The list of requests being processed */
-	struct list_head processing;
-
-	/** The list of requests under I/O */
-	struct list_head io;
+	/** Queues of CPUs that have a device file cloned for them,
+	    indexed by CPU and allocated on the first clone */
+	struct fuse_queue **cpu_queues;
 
 	/** The next unique kernel file handle */
 	u64 khctr;
@@ -367,6 +438,9 @@ struct fuse_conn {
 	/** rbtree of fuse_files waiting for poll events indexed by ph */
 	struct rb_root polled_files;
 
+	/** Registered lower files not yet used by an open, by id */
+	struct idr passthrough_req;
+
 	/** Maximum number of outstanding background requests */
 	unsigned max_background;
 
@@ -382,16 +456,6 @@ struct fuse_conn {
 	/** The list of background requests set aside for later queuing */
 	struct list_head bg_queue;
 
-	/** Pending interrupts */
-	struct list_head interrupts[2];
-
-	/** Queue of pending forgets */
-	struct fuse_forget_link forget_list_head;
-	struct fuse_forget_link *forget_list_tail;
-
-	/** Batching of FORGET requests (positive indicates FORGET batch) */
-	int forget_batch;
-
 	/** Flag indicating if connection is blocked.  This will be
 	    the case before the INIT reply is received, and if there
 	    are too many outstading backgrounds requests */
@@ -403,9 +467,6 @@ struct fuse_conn {
 	/** waitq for reserved requests */
 	wait_queue_head_t reserved_req_waitq;
 
-	/** The next unique request id */
-	u64 reqctr;
-
 	/** Connection established, cleared on umount, connection
 	    abort and device release */
 	unsigned connected;
@@ -480,6 +541,12 @@ struct fuse_conn {
 	/** Don't apply umask to creation modes */
 	unsigned dont_mask:1;
 
+	/** Are writes cached and written back in batches? */
+	unsigned writeback_cache:1;
+
+	/** May data I/O be passed through to lower files? */
+	unsigned passthrough:1;
+
 	/** The number of requests waiting for completion */
 	atomic_t num_waiting;
 
@@ -501,9 +568,6 @@ struct fuse_conn {
 	/** number of dentries used in the above array */
 	int ctl_ndents;
 
-	/** O_ASYNC requests */
-	struct fasync_struct *fasync;
-
 	/** Key for lock owner ID scrambling */
 	u32 scramble_key[4];
 
@@ -691,6 +755,22 @@ void fuse_request_send_background_locked(struct fuse_conn *fc,
 /* Abort all requests */
 void fuse_abort_conn(struct fuse_conn *fc);
 
+/**
+ * Initialize a request queue of a connection
+ */
+void fuse_queue_init(struct fuse_queue *fq, struct fuse_conn *fc,
+		     unsigned id);
+
+/**
+ * Free the CPU queues of a connection
+ */
+void fuse_free_queues(struct fuse_conn *fc);
+
+/**
+ * Wake up all readers of a connection, e.g. after it was disconnected
+ */
+void fuse_wake_up_readers(struct fuse_conn *fc);
+
 /**
  * Invalidate inode attributes
  */
@@ -771,4 +851,28 @@ int fuse_dev_release(struct inode *inode, struct file *file);
 
 void fuse_write_update_size(struct inode *inode, loff_t pos);
 
+/**
+ * Register a lower file for passthrough, returns its id
+ */
+int fuse_passthrough_open(struct fuse_conn *fc, int lower_fd);
+
+/**
+ * Make a file being opened use the lower file named in the open reply
+ */
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_file *ff,
+			    struct fuse_open_out *openarg);
+
+void fuse_passthrough_release(struct fuse_passthrough *passthrough);
+
+/**
+ * Drop the lower files the daemon registered but never used
+ */
+void fuse_passthrough_free_all(struct fuse_conn *fc);
+
+ssize_t fuse_passthrough_aio_read(struct kiocb *iocb, const struct iovec *iov,
+				  unsigned long nr_segs, loff_t pos);
+ssize_t fuse_passthrough_aio_write(struct kiocb *iocb, const struct iovec *iov,
+				   unsigned long nr_segs, loff_t pos);
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+
 #endif /* _FS_FUSE_I_H */
@@ -0,0 +1,248 @@
+/*
+  FUSE: Filesystem in Userspace
+
+  Passthrough of file data to a lower file opened by the daemon.
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+#include "fuse_i.h"
+
+#include <linux/aio.h>
+#include <linux/cred.h>
+#include <linux/file.h>
+#include <linux/fsnotify.h>
+#include <linux/pagemap.h>
+#include <linux/slab.h>
+#include <linux/uio.h>
+
+int fuse_passthrough_open(struct fuse_conn *fc, int lower_fd)
+{
+	struct fuse_passthrough *passthrough;
+	struct file *filp;
+	int id, err;
+
+	if (!fc->passthrough)
+		return -EPERM;
+
+	filp = fget(lower_fd);
+	if (!filp)
+		return -EBADF;
+
+	/* A lower file on FUSE could leave the daemon waiting for itself */
+	err = -EINVAL;
+	if (!S_ISREG(filp->f_dentry->d_inode->i_mode) ||
+	    filp->f_dentry->d_sb->s_magic == FUSE_SUPER_MAGIC ||
+	    !filp->f_op || !filp->f_op->aio_read || !filp->f_op->aio_write)
+		goto out_fput;
+
+	err = -ENOMEM;
+	passthrough = kmalloc(sizeof(*passthrough), GFP_KERNEL);
+	if (!passthrough)
+		goto out_fput;
+
+	passthrough->filp = filp;
+	passthrough->cred = get_current_cred();
+
+	do {
+		if (!idr_pre_get(&fc->passthrough_req, GFP_KERNEL)) {
+			err = -ENOMEM;
+			break;
+		}
+		spin_lock(&fc->lock);
+		err = idr_get_new_above(&fc->passthrough_req, passthrough, 1,
+					&id);
+		spin_unlock(&fc->lock);
+	} while (err == -EAGAIN);
+
+	if (err) {
+		put_cred(passthrough->cred);
+		kfree(passthrough);
+		goto out_fput;
+	}
+
+	return id;
+
+ out_fput:
+	fput(filp);
+	return err;
+}
+
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_file *ff,
+			    struct fuse_open_out *openarg)
+{
+	struct fuse_passthrough *passthrough;
+	u32 id = openarg->passthrough_fh;
+
+	if (!fc->passthrough || !id || id > INT_MAX)
+		return;
+
+	spin_lock(&fc->lock);
+	passthrough = idr_find(&fc->passthrough_req, id);
+	if (passthrough)
+		idr_remove(&fc->passthrough_req, id);
+	spin_unlock(&fc->lock);
+
+	/* An unknown id leaves the data to the daemon */
+	if (!passthrough)
+		return;
+
+	ff->passthrough = *passthrough;
+	kfree(passthrough);
+}
+
+void fuse_passthrough_release(struct fuse_passthrough *passthrough)
+{
+	if (passthrough->filp) {
+		fput(passthrough->filp);
+		put_cred(passthrough->cred);
+		passthrough->filp = NULL;
+		passthrough->cred = NULL;
+	}
+}
+
+static int fuse_passthrough_free_one(int id, void *p, void *data)
+{
+	fuse_passthrough_release(p);
+	kfree(p);
+	return 0;
+}
+
+void fuse_passthrough_free_all(struct fuse_conn *fc)
+{
+	idr_for_each(&fc->passthrough_req, fuse_passthrough_free_one, NULL);
+	idr_remove_all(&fc->passthrough_req);
+	idr_destroy(&fc->passthrough_req);
+}
+
+/*
+ * Like do_readv_writev() on the lower file, with the daemon's
+ * credentials.  The checks of the VFS have already been done on the
+ * FUSE file, the lower file gets its own access mode, mandatory lock
+ * and security checks.
+ */
+static ssize_t fuse_passthrough_rw(struct fuse_file *ff, int rw,
+				   const struct iovec *iov,
+				   unsigned long nr_segs, loff_t *ppos)
+{
+	struct file *filp = ff->passthrough.filp;
+	const struct cred *old_cred;
+	struct kiocb kiocb;
+	ssize_t ret;
+
+	if (!(filp->f_mode & (rw == WRITE ? FMODE_WRITE : FMODE_READ)))
+		return -EBADF;
+
+	old_cred = override_creds(ff->passthrough.cred);
+	ret = rw_verify_area(rw, filp, ppos, iov_length(iov, nr_segs));
+	if (ret < 0)
+		goto out;
+
+	init_sync_kiocb(&kiocb, filp);
+	kiocb.ki_pos = *ppos;
+	kiocb.ki_left = iov_length(iov, nr_segs);
+	kiocb.ki_nbytes = kiocb.ki_left;
+
+	if (rw == WRITE)
+		ret = filp->f_op->aio_write(&kiocb, iov, nr_segs,
+					    kiocb.ki_pos);
+	else
+		ret = filp->f_op->aio_read(&kiocb, iov, nr_segs,
+					   kiocb.ki_pos);
+	if (ret == -EIOCBQUEUED)
+		ret = wait_on_sync_kiocb(&kiocb);
+	*ppos = kiocb.ki_pos;
+ out:
+	revert_creds(old_cred);
+
+	if (ret > 0) {
+		if (rw == WRITE)
+			fsnotify_modify(filp);
+		else
+			fsnotify_access(filp);
+	}
+
+	return ret;
+}
+
+ssize_t fuse_passthrough_aio_read(struct kiocb *iocb, const struct iovec *iov,
+				  unsigned long nr_segs, loff_t pos)
+{
+	struct fuse_file *ff = iocb->ki_filp->private_data;
+	ssize_t ret;
+
+	ret = fuse_passthrough_rw(ff, READ, iov, nr_segs, &pos);
+	iocb->ki_pos = pos;
+
+	return ret;
+}
+
+ssize_t fuse_passthrough_aio_write(struct kiocb *iocb, const struct iovec *iov,
+				   unsigned long nr_segs, loff_t pos)
+{
+	struct file *file = iocb->ki_filp;
+	struct fuse_file *ff = file->private_data;
+	struct inode *inode = file->f_mapping->host;
+	struct inode *lower_inode = ff->passthrough.filp->f_mapping->host;
+	ssize_t ret;
+
+	mutex_lock(&inode->i_mutex);
+	if (file->f_flags & O_APPEND)
+		pos = i_size_read(lower_inode);
+
+	ret = fuse_passthrough_rw(ff, WRITE, iov, nr_segs, &pos);
+	if (ret > 0) {
+		/* Pages cached through opens without passthrough are stale */
+		if (inode->i_mapping->nrpages)
+			invalidate_inode_pages2_range(inode->i_mapping,
+					(pos - ret) >> PAGE_CACHE_SHIFT,
+					(pos - 1) >> PAGE_CACHE_SHIFT);
+		fuse_write_update_size(inode, pos);
+	}
+	fuse_invalidate_attr(inode);
+	mutex_unlock(&inode->i_mutex);
+
+	iocb->ki_pos = pos;
+	return ret;
+}
+
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fuse_file *ff = file->private_data;
+	struct file *filp = ff->passthrough.filp;
+	const struct cred *old_cred;
+	int err;
+
+	if (!filp->f_op->mmap)
+		return -ENODEV;
+
+	if (!(filp->f_mode & FMODE_READ))
+		return -EACCES;
+
+	/* Shared mappings must not write a lower file opened read-only */
+	if ((vma->vm_flags & VM_SHARED) && !(filp->f_mode & FMODE_WRITE)) {
+		if (vma->vm_flags & VM_WRITE)
+			return -EACCES;
+		vma->vm_flags &= ~VM_MAYWRITE;
+	}
+
+	/*
+	 * Map the lower file itself, so that faults never involve FUSE.
+	 * The reference mmap_region() took on @file for the vma is traded
+	 * for one on the lower file.
+	 */
+	get_file(filp);
+	vma->vm_file = filp;
+	old_cred = override_creds(ff->passthrough.cred);
+	err = filp->f_op->mmap(filp, vma);
+	revert_creds(old_cred);
+	if (err) {
+		vma->vm_file = file;
+		fput(filp);
+		return err;
+	}
+	fput(file);
+
+	return 0;
+}
@@ -40,6 +40,11 @@ typedef int (congested_fn)(void *, int);
 enum bdi_stat_item {
 	BDI_RECLAIMABLE,
 	BDI_WRITEBACK,
+#ifdef CONFIG_ADAPTIVE_READAHEAD
+	BDI_READAHEAD,
+	BDI_READAHEAD_USED,
+	BDI_READAHEAD_UNUSED,
+#endif
 	NR_BDI_STAT_ITEMS
 };
 
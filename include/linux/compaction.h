@@ -18,12 +18,24 @@ extern int sysctl_compaction_handler(struct ctl_table *table, int write,
 extern int sysctl_extfrag_threshold;
 extern int sysctl_extfrag_handler(struct ctl_table *table, int write,
 			void __user *buffer, size_t *length, loff_t *ppos);
+extern int sysctl_kcompactd_orders;
+extern int sysctl_kcompactd_interval_ms;
+extern int sysctl_kcompactd_budget_ms;
+
+/* Where kcompactd picks up a pass cut short, free_pfn == 0 starts anew */
+struct compact_cursor {
+	unsigned long migrate_pfn;
+	unsigned long free_pfn;
+};
 
 extern int fragmentation_index(struct zone *zone, unsigned int order);
 extern unsigned long try_to_compact_pages(struct zonelist *zonelist,
 			int order, gfp_t gfp_mask, nodemask_t *mask,
 			bool sync);
 extern unsigned long compaction_suitable(struct zone *zone, int order);
+extern unsigned long compact_zone_budget(struct zone *zone, int order,
+			struct compact_cursor *cursor, unsigned long deadline);
+extern void wakeup_kcompactd(struct zone *zone, int order);
 #ifndef CONFIG_DMA_CMA
 extern unsigned long compact_zone_order(struct zone *zone, int order,
 					gfp_t gfp_mask, bool sync);
@@ -86,6 +98,10 @@ static inline bool compaction_deferred(struct zone *zone)
 	return 1;
 }
 
+static inline void wakeup_kcompactd(struct zone *zone, int order)
+{
+}
+
 #endif /* CONFIG_COMPACTION */
 
 #if defined(CONFIG_COMPACTION) && defined(CONFIG_SYSFS) && defined(CONFIG_NUMA)
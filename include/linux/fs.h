@@ -924,6 +924,11 @@ struct file_ra_state {
 	unsigned int ra_pages;		/* Maximum readahead window */
 	unsigned int mmap_miss;		/* Cache miss stat for mmap accesses */
 	loff_t prev_pos;		/* Cache last read() position */
+#ifdef CONFIG_ADAPTIVE_READAHEAD
+	unsigned int nr_issued;		/* # of pages read ahead ... */
+	unsigned int nr_used;		/* ... and # of them accessed */
+	int scale;			/* log2 of max window / ra_pages */
+#endif
 };
 
 /*
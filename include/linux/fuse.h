@@ -53,6 +53,7 @@
 #define _LINUX_FUSE_H
 
 #include <linux/types.h>
+#include <linux/ioctl.h>
 
 /*
  * Version negotiation:
@@ -155,6 +156,13 @@ struct fuse_file_lock {
  *
  * FUSE_EXPORT_SUPPORT: filesystem handles lookups of "." and ".."
  * FUSE_DONT_MASK: don't apply umask to file mode on create operations
+ * FUSE_WRITEBACK_CACHE: cache writes and send them on writeback.  OPEN
+ *	and CREATE then ask for O_RDWR where the caller asked for O_WRONLY,
+ *	as a partial page write may have to READ the rest of the page
+ *	through the same handle.  The kernel has checked write access
+ *	only, a daemon that checks access itself must not refuse these
+ *	opens for lack of read permission.
+ * FUSE_PASSTHROUGH: filesystem may serve file data from a lower file
  */
 #define FUSE_ASYNC_READ		(1 << 0)
 #define FUSE_POSIX_LOCKS	(1 << 1)
@@ -163,6 +171,8 @@ struct fuse_file_lock {
 #define FUSE_EXPORT_SUPPORT	(1 << 4)
 #define FUSE_BIG_WRITES		(1 << 5)
 #define FUSE_DONT_MASK		(1 << 6)
+#define FUSE_WRITEBACK_CACHE	(1 << 16)
+#define FUSE_PASSTHROUGH	(1U << 31)
 
 /**
  * CUSE INIT request/reply flags
@@ -380,7 +390,7 @@ struct fuse_create_in {
 struct fuse_open_out {
 	__u64	fh;
 	__u32	open_flags;
-	__u32	padding;
+	__u32	passthrough_fh;
 };
 
 struct fuse_release_in {
@@ -624,4 +634,38 @@ struct fuse_notify_retrieve_in {
 	__u64	dummy4;
 };
 
+/* Device ioctls */
+#define FUSE_DEV_IOC_MAGIC		229
+
+/**
+ * Make a newly opened /dev/fuse read the shared queue of the connection
+ * that the device file with the __u32 fd argument belongs to.
+ */
+#define FUSE_DEV_IOC_CLONE		_IOR(FUSE_DEV_IOC_MAGIC, 0, __u32)
+
+/**
+ * Like FUSE_DEV_IOC_CLONE, but with cpu set to other than -1 requests
+ * submitted on that CPU go to a queue of their own for as long as a
+ * device file reads it.  Replies must be written to a device file
+ * reading the same queue.
+ */
+struct fuse_dev_clone {
+	__u32	fd;
+	__s32	cpu;
+};
+
+#define FUSE_DEV_IOC_CLONE_CPU		_IOW(FUSE_DEV_IOC_MAGIC, 128, \
+					     struct fuse_dev_clone)
+
+/**
+ * Register a file the daemon has open as the lower file of a FUSE file
+ * to be opened.  The argument is the file descriptor and the ioctl
+ * returns an id for it.  If FUSE_PASSTHROUGH was negotiated, an OPEN
+ * or CREATE reply with passthrough_fh set to that id makes read, write
+ * and mmap on the opened file go straight to the lower file, with the
+ * credentials of the caller of the ioctl.  Each id can only be used
+ * once; the ones never used are dropped with the connection.
+ */
+#define FUSE_DEV_IOC_PASSTHROUGH_OPEN	_IOW(FUSE_DEV_IOC_MAGIC, 1, __u32)
+
 #endif /* _LINUX_FUSE_H */
@@ -27,6 +27,8 @@ struct ion_handle;
  * @ION_HEAP_TYPE_CARVEOUT:	 memory allocated from a prereserved
  * 				 carveout heap, allocations are physically
  * 				 contiguous
+ * @ION_HEAP_TYPE_PAGE_POOL:	 memory allocated from pools of recycled,
+ *				 pre-zeroed pages of several orders
  * @ION_HEAP_END:		 helper for iterating over heaps
  */
 enum ion_heap_type {
@@ -40,12 +42,15 @@ enum ion_heap_type {
 	ION_HEAP_TYPE_EXYNOS,
 	ION_HEAP_TYPE_EXYNOS_USER,
 #endif
+	/* after the device specific heaps, so their masks don't move */
+	ION_HEAP_TYPE_PAGE_POOL,
 	ION_NUM_HEAPS,
 };
 
 #define ION_HEAP_SYSTEM_MASK		(1 << ION_HEAP_TYPE_SYSTEM)
 #define ION_HEAP_SYSTEM_CONTIG_MASK	(1 << ION_HEAP_TYPE_SYSTEM_CONTIG)
 #define ION_HEAP_CARVEOUT_MASK		(1 << ION_HEAP_TYPE_CARVEOUT)
+#define ION_HEAP_PAGE_POOL_MASK		(1 << ION_HEAP_TYPE_PAGE_POOL)
 
 #ifdef CONFIG_ION_EXYNOS
 #define ION_HEAP_EXYNOS_MASK		(1 << ION_HEAP_TYPE_EXYNOS)
@@ -0,0 +1,61 @@
+#ifndef __LZ4_H__
+#define __LZ4_H__
+/*
+ * LZ4 Kernel Interface
+ *
+ * Implementation of the LZ4 block format, a byte-oriented LZ77 variant
+ * designed for very fast decompression.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define LZ4_HASH_LOG		12
+#define LZ4_MEM_COMPRESS	((1 << LZ4_HASH_LOG) * sizeof(u32))
+
+/* Largest input a single call to lz4_compress() accepts */
+#define LZ4_MAX_INPUT_SIZE	0x7E000000
+
+/*
+ * lz4_compressbound()
+ * Provides the maximum size that LZ4 may output in a "worst case" scenario
+ * (input data not compressible)
+ */
+#define lz4_compressbound(isize)	((isize) + ((isize) / 255) + 16)
+
+/*
+ * lz4_compress()
+ *	src     : source address of the original data
+ *	src_len : size of the original data
+ *	dst	: output buffer address of the compressed data
+ *	dst_len : in: size of the output buffer
+ *		  out: is the actual size of the compressed data
+ *	wrkmem  : address of the working memory, LZ4_MEM_COMPRESS bytes
+ *	return  : Success if return 0
+ *		  Error if return (< 0)
+ *
+ * Output is bounds checked, so dst_len smaller than
+ * lz4_compressbound(src_len) is allowed; compression then fails
+ * once the buffer would overflow.
+ */
+int lz4_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem);
+
+/*
+ * lz4_decompress_unknownoutputsize()
+ *	src     : source address of the compressed data
+ *	src_len : is the input size, therefore the compressed size
+ *	dest	: output buffer address of the decompressed data
+ *	dest_len: in: the size of the output buffer
+ *		  out: the actual size of the decompressed data
+ *	return  : Success if return 0
+ *		  Error if return (< 0)
+ *
+ * Never writes beyond dest + dest_len nor reads beyond src + src_len,
+ * even on corrupted input.
+ */
+int lz4_decompress_unknownoutputsize(const unsigned char *src, size_t src_len,
+		unsigned char *dest, size_t *dest_len);
+
+#endif
@@ -1543,6 +1543,35 @@ unsigned long max_sane_readahead(unsigned long nr);
 unsigned long ra_submit(struct file_ra_state *ra,
 			struct address_space *mapping,
 			struct file *filp);
+unsigned long ra_mmap_pages(struct file_ra_state *ra);
+
+#ifdef CONFIG_ADAPTIVE_READAHEAD
+void __readahead_page_used(struct address_space *mapping,
+			   struct file_ra_state *ra, struct page *page);
+void readahead_page_evicted(struct address_space *mapping, struct page *page);
+#else
+static inline void __readahead_page_used(struct address_space *mapping,
+					 struct file_ra_state *ra,
+					 struct page *page)
+{
+}
+static inline void readahead_page_evicted(struct address_space *mapping,
+					  struct page *page)
+{
+}
+#endif
+
+/*
+ * Called by readers that found @page in the page cache, so that @ra
+ * learns how much of what it read ahead gets used.
+ */
+static inline void readahead_page_used(struct address_space *mapping,
+				       struct file_ra_state *ra,
+				       struct page *page)
+{
+	if (PageReadaheadUnused(page))
+		__readahead_page_used(mapping, ra, page);
+}
 
 /* Generic expand stack which grows the stack according to GROWS{UP,DOWN} */
 extern int expand_stack(struct vm_area_struct *vma, unsigned long address);
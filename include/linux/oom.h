@@ -70,6 +70,34 @@ extern unsigned long badness(struct task_struct *p, struct mem_cgroup *mem,
 
 extern struct task_struct *find_lock_task_mm(struct task_struct *p);
 
+#ifdef CONFIG_OOM_ADJ_BUCKETS
+/*
+ * Thread group leaders indexed by signal->oom_adj, so that a killer
+ * interested in high oom_adj values doesn't have to walk every process.
+ * Lock order: tasklist_lock -> oom_adj_bucket_lock -> task_lock.
+ */
+#define OOM_ADJ_BUCKETS		(OOM_ADJUST_MAX - OOM_DISABLE + 1)
+
+extern spinlock_t oom_adj_bucket_lock;
+extern struct hlist_head oom_adj_buckets[OOM_ADJ_BUCKETS];
+
+#define for_each_oom_adj_bucket_task(p, pos, adj)			\
+	hlist_for_each_entry(p, pos, &oom_adj_buckets[(adj) - OOM_DISABLE], \
+			     oom_adj_node)
+
+extern void oom_adj_bucket_add(struct task_struct *p);
+extern void oom_adj_bucket_del(struct task_struct *p);
+extern void oom_adj_bucket_replace(struct task_struct *old,
+				   struct task_struct *new);
+extern void oom_adj_bucket_update(struct task_struct *p);
+#else
+static inline void oom_adj_bucket_add(struct task_struct *p) { }
+static inline void oom_adj_bucket_del(struct task_struct *p) { }
+static inline void oom_adj_bucket_replace(struct task_struct *old,
+					  struct task_struct *new) { }
+static inline void oom_adj_bucket_update(struct task_struct *p) { }
+#endif
+
 /* sysctls */
 extern int sysctl_oom_dump_tasks;
 extern int sysctl_oom_kill_allocating_task;
@@ -106,6 +106,9 @@ enum pageflags {
 #endif
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 	PG_compound_lock,
+#endif
+#ifdef CONFIG_ADAPTIVE_READAHEAD
+	PG_readahead_unused,	/* Read ahead and not accessed since */
 #endif
 	__NR_PAGEFLAGS,
 
@@ -328,6 +331,14 @@ PAGEFLAG_FALSE(HWPoison)
 #define __PG_HWPOISON 0
 #endif
 
+#ifdef CONFIG_ADAPTIVE_READAHEAD
+PAGEFLAG(ReadaheadUnused, readahead_unused)
+	TESTCLEARFLAG(ReadaheadUnused, readahead_unused)
+#else
+PAGEFLAG_FALSE(ReadaheadUnused) SETPAGEFLAG_NOOP(ReadaheadUnused)
+	TESTCLEARFLAG_FALSE(ReadaheadUnused)
+#endif
+
 u64 stable_page_flags(struct page *page);
 
 static inline int PageUptodate(struct page *page)
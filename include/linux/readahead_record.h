@@ -0,0 +1,45 @@
+#ifndef _LINUX_READAHEAD_RECORD_H
+#define _LINUX_READAHEAD_RECORD_H
+
+#include <linux/types.h>
+
+/*
+ * An entry of /sys/kernel/mm/readahead_record/trace: the page cache of
+ * inode @ino on device @dev, encoded as by new_encode_dev(), was missed
+ * for @nr_pages pages from page @index on.  Entries are in the order of
+ * the first miss they cover.
+ */
+struct readahead_record {
+	__u64	ino;
+	__u64	index;
+	__u32	dev;
+	__u32	nr_pages;
+};
+
+#ifdef __KERNEL__
+
+struct address_space;
+
+#ifdef CONFIG_READAHEAD_RECORD
+extern bool readahead_recording;
+
+void __readahead_record_miss(struct address_space *mapping, pgoff_t index,
+			     unsigned long nr_pages);
+
+/* Called where a reader did not find page @index of @mapping cached */
+static inline void readahead_record_miss(struct address_space *mapping,
+					 pgoff_t index, unsigned long nr_pages)
+{
+	if (unlikely(readahead_recording))
+		__readahead_record_miss(mapping, index, nr_pages);
+}
+#else
+static inline void readahead_record_miss(struct address_space *mapping,
+					 pgoff_t index, unsigned long nr_pages)
+{
+}
+#endif
+
+#endif /* __KERNEL__ */
+
+#endif /* _LINUX_READAHEAD_RECORD_H */
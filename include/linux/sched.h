@@ -143,6 +143,20 @@ extern unsigned long nr_iowait(void);
 extern unsigned long nr_iowait_cpu(int cpu);
 extern unsigned long this_cpu_load(void);
 
+struct notifier_block;
+
+#ifdef CONFIG_SCHED_NR_RUNNING_AVG
+extern void sched_update_nr_prod(int cpu, unsigned long nr_running, bool inc);
+extern void sched_nr_running_tick(int cpu, unsigned long nr_running);
+extern unsigned int sched_get_nr_running_avg(void);
+extern int register_sched_nr_running_notifier(struct notifier_block *nb);
+extern int unregister_sched_nr_running_notifier(struct notifier_block *nb);
+#else
+static inline void sched_update_nr_prod(int cpu, unsigned long nr_running,
+					bool inc) { }
+static inline void sched_nr_running_tick(int cpu, unsigned long nr_running) { }
+#endif
+
 
 extern void calc_global_load(unsigned long ticks);
 
@@ -1284,6 +1298,10 @@ struct task_struct {
 #ifdef CONFIG_SMP
 	struct plist_node pushable_tasks;
 #endif
+#ifdef CONFIG_OOM_ADJ_BUCKETS
+	/* entry in oom_adj_buckets[], thread group leaders only */
+	struct hlist_node oom_adj_node;
+#endif
 
 	struct mm_struct *mm, *active_mm;
 #ifdef CONFIG_COMPAT_BRK
@@ -0,0 +1,26 @@
+#ifndef __LINUX_VMPRESSURE_H
+#define __LINUX_VMPRESSURE_H
+
+#include <linux/gfp.h>
+#include <linux/notifier.h>
+
+/*
+ * Listeners registered with vmpressure_notifier_register() are called from
+ * process context once per reclaim window, with the pressure (0-100, the
+ * share of scanned pages that could not be reclaimed) as the action value.
+ */
+#define VMPRESSURE_LOW		0
+#define VMPRESSURE_MEDIUM	60
+#define VMPRESSURE_CRITICAL	95
+
+#ifdef CONFIG_VMPRESSURE
+extern void vmpressure(gfp_t gfp, unsigned long scanned,
+		       unsigned long reclaimed);
+extern int vmpressure_notifier_register(struct notifier_block *nb);
+extern int vmpressure_notifier_unregister(struct notifier_block *nb);
+#else
+static inline void vmpressure(gfp_t gfp, unsigned long scanned,
+			      unsigned long reclaimed) { }
+#endif
+
+#endif /* __LINUX_VMPRESSURE_H */
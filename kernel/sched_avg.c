@@ -0,0 +1,132 @@
+/*
+ * kernel/sched_avg.c
+ *
+ * Time-weighted average of the number of runnable tasks, maintained by
+ * the scheduler itself so that cpufreq/hotplug governors no longer have
+ * to poll nr_running() from a timer of their own.
+ *
+ * Every enqueue and dequeue folds "nr_running * time since the last
+ * change" into a per-cpu product sum, which makes the average exact
+ * rather than sampled: a burst that comes and goes between two governor
+ * samples is still accounted for.
+ *
+ * This file is released under the GPLv2.
+ */
+
+#include <linux/module.h>
+#include <linux/notifier.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/spinlock.h>
+#include <linux/math64.h>
+
+struct nr_avg {
+	raw_spinlock_t lock;
+	/* sum of nr_running * ns since the last sched_get_nr_running_avg() */
+	u64 nr_prod_sum;
+	/* sched_clock() at the last change of nr */
+	u64 last_time;
+	unsigned long nr;
+};
+
+static DEFINE_PER_CPU(struct nr_avg, nr_avg) = {
+	.lock = __RAW_SPIN_LOCK_UNLOCKED(nr_avg.lock),
+};
+
+static DEFINE_RAW_SPINLOCK(nr_avg_get_lock);
+static u64 nr_avg_last_get;
+
+static ATOMIC_NOTIFIER_HEAD(nr_running_notifier);
+
+/**
+ * sched_update_nr_prod - account a change of a cpu's nr_running
+ * @cpu:		cpu whose runqueue changes
+ * @nr_running:		nr_running before the change
+ * @inc:		true for an enqueue, false for a dequeue
+ *
+ * Called with the runqueue lock held. sched_clock() rather than the rq
+ * clock is used, the sums of all cpus are compared against one another.
+ */
+void sched_update_nr_prod(int cpu, unsigned long nr_running, bool inc)
+{
+	struct nr_avg *avg = &per_cpu(nr_avg, cpu);
+	unsigned long flags;
+	u64 now;
+
+	raw_spin_lock_irqsave(&avg->lock, flags);
+	now = sched_clock();
+	if (likely(now > avg->last_time))
+		avg->nr_prod_sum += nr_running * (now - avg->last_time);
+	avg->last_time = now;
+	avg->nr = inc ? nr_running + 1 : nr_running - 1;
+	raw_spin_unlock_irqrestore(&avg->lock, flags);
+}
+
+/**
+ * sched_get_nr_running_avg - system wide average of runnable tasks
+ *
+ * Returns the time-weighted average of the sum of nr_running over all
+ * cpus since the previous call, multiplied by 100, and starts a new
+ * window. The first call after boot averages over the whole uptime;
+ * callers that care should make a throwaway call first.
+ */
+unsigned int sched_get_nr_running_avg(void)
+{
+	u64 sum = 0, now, window;
+	unsigned long flags;
+	int cpu;
+
+	raw_spin_lock_irqsave(&nr_avg_get_lock, flags);
+	now = sched_clock();
+	window = now - nr_avg_last_get;
+	nr_avg_last_get = now;
+
+	for_each_possible_cpu(cpu) {
+		struct nr_avg *avg = &per_cpu(nr_avg, cpu);
+
+		raw_spin_lock(&avg->lock);
+		sum += avg->nr_prod_sum;
+		if (now > avg->last_time)
+			sum += avg->nr * (now - avg->last_time);
+		avg->nr_prod_sum = 0;
+		avg->last_time = now;
+		raw_spin_unlock(&avg->lock);
+	}
+	raw_spin_unlock_irqrestore(&nr_avg_get_lock, flags);
+
+	if (!window)
+		return 0;
+	return (unsigned int)div64_u64(sum * 100, window);
+}
+EXPORT_SYMBOL_GPL(sched_get_nr_running_avg);
+
+/*
+ * Called from scheduler_tick() without the runqueue lock. Listeners are
+ * only told about ticks where work is queued behind the running task,
+ * so an idle or lightly loaded system doesn't pay for them.
+ */
+void sched_nr_running_tick(int cpu, unsigned long nr_running)
+{
+	if (nr_running > 1)
+		atomic_notifier_call_chain(&nr_running_notifier, nr_running,
+					   (void *)(long)cpu);
+}
+
+/**
+ * register_sched_nr_running_notifier - get told about run-queue bursts
+ *
+ * The callback runs in hard interrupt context on the ticking cpu, with
+ * the new nr_running as @val and the cpu number as @v. It must not sleep
+ * or take runqueue locks; queueing work is fine.
+ */
+int register_sched_nr_running_notifier(struct notifier_block *nb)
+{
+	return atomic_notifier_chain_register(&nr_running_notifier, nb);
+}
+EXPORT_SYMBOL_GPL(register_sched_nr_running_notifier);
+
+int unregister_sched_nr_running_notifier(struct notifier_block *nb)
+{
+	return atomic_notifier_chain_unregister(&nr_running_notifier, nb);
+}
+EXPORT_SYMBOL_GPL(unregister_sched_nr_running_notifier);
@@ -0,0 +1,202 @@
+/*
+ * LZ4 - Fast LZ compression algorithm
+ *
+ * Compressor for the LZ4 block format. A single hash table of 4K
+ * entries indexes the positions of previously seen 4-byte sequences;
+ * the search accelerates over incompressible input.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+static inline u32 lz4_hash(u32 sequence)
+{
+	return (sequence * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+/*
+ * Number of identical bytes at @ip and @ref, not extending past
+ * @limit.
+ */
+static inline size_t lz4_count(const u8 *ip, const u8 *ref, const u8 *limit)
+{
+	const u8 * const start = ip;
+
+	while (ip < limit - 3) {
+		u32 diff = LZ4_READ_LE32(ref) ^ LZ4_READ_LE32(ip);
+
+		if (!diff) {
+			ip += 4;
+			ref += 4;
+			continue;
+		}
+		return ip - start + (__ffs(diff) >> 3);
+	}
+
+	while (ip < limit && *ip == *ref) {
+		ip++;
+		ref++;
+	}
+
+	return ip - start;
+}
+
+static inline u8 *lz4_put_length(u8 *op, size_t len)
+{
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = (u8)len;
+
+	return op;
+}
+
+int lz4_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	u32 *hash_table = wrkmem;
+	const u8 *ip = src;
+	const u8 *anchor = src;
+	const u8 * const iend = src + src_len;
+	const u8 * const mflimit = iend - MFLIMIT;
+	const u8 * const matchlimit = iend - LASTLITERALS;
+	u8 *op = dst;
+	u8 * const oend = dst + *dst_len;
+	const u8 *ref;
+	u8 *token;
+	size_t len;
+	u32 h;
+
+	if (src_len > LZ4_MAX_INPUT_SIZE)
+		return -1;
+
+	memset(hash_table, 0, LZ4_MEM_COMPRESS);
+
+	/* Input too short to hold a match */
+	if (src_len < MFLIMIT + 1)
+		goto last_literals;
+
+	hash_table[lz4_hash(LZ4_READ32(ip))] = 0;
+	ip++;
+
+	for (;;) {
+		u32 attempts = 1 << SKIP_STRENGTH;
+		u32 step = 1;
+		u32 seq;
+
+		/* Find a match */
+		for (;;) {
+			if (unlikely(ip > mflimit))
+				goto last_literals;
+
+			seq = LZ4_READ32(ip);
+			h = lz4_hash(seq);
+			ref = src + hash_table[h];
+			hash_table[h] = ip - src;
+
+			if (ref < ip && ip - ref <= MAX_DISTANCE &&
+					LZ4_READ32(ref) == seq)
+				break;
+
+			ip += step;
+			step = attempts++ >> SKIP_STRENGTH;
+		}
+
+		/* Catch up */
+		while (ip > anchor && ref > (const u8 *)src &&
+				ip[-1] == ref[-1]) {
+			ip--;
+			ref--;
+		}
+
+		/* Encode literal length */
+		len = ip - anchor;
+		if (unlikely(op + len + (2 + 1 + LASTLITERALS) + len / 255 >
+				oend))
+			return -1;
+
+		token = op++;
+		if (len >= RUN_MASK) {
+			*token = RUN_MASK << ML_BITS;
+			op = lz4_put_length(op, len - RUN_MASK);
+		} else {
+			*token = len << ML_BITS;
+		}
+
+		memcpy(op, anchor, len);
+		op += len;
+
+next_match:
+		/* Encode offset */
+		LZ4_WRITE_LE16(op, (u16)(ip - ref));
+		op += 2;
+
+		/* Encode match length */
+		ip += MINMATCH;
+		ref += MINMATCH;
+		len = lz4_count(ip, ref, matchlimit);
+		ip += len;
+
+		if (unlikely(op + (1 + LASTLITERALS) + (len >> 8) > oend))
+			return -1;
+
+		if (len >= ML_MASK) {
+			*token += ML_MASK;
+			op = lz4_put_length(op, len - ML_MASK);
+		} else {
+			*token += len;
+		}
+
+		anchor = ip;
+
+		/* Test end of chunk */
+		if (ip > mflimit)
+			break;
+
+		/* Fill table */
+		hash_table[lz4_hash(LZ4_READ32(ip - 2))] = ip - 2 - src;
+
+		/* Test next position */
+		h = lz4_hash(LZ4_READ32(ip));
+		ref = src + hash_table[h];
+		hash_table[h] = ip - src;
+		if (ref < ip && ip - ref <= MAX_DISTANCE &&
+				LZ4_READ32(ref) == LZ4_READ32(ip)) {
+			token = op++;
+			*token = 0;
+			goto next_match;
+		}
+
+		/* Prepare next loop */
+		ip++;
+	}
+
+last_literals:
+	/* Encode last literals */
+	len = iend - anchor;
+	if (unlikely(op + len + 1 + (len + 255 - RUN_MASK) / 255 > oend))
+		return -1;
+
+	if (len >= RUN_MASK) {
+		*op++ = RUN_MASK << ML_BITS;
+		op = lz4_put_length(op, len - RUN_MASK);
+	} else {
+		*op++ = len << ML_BITS;
+	}
+	memcpy(op, anchor, iend - anchor);
+	op += iend - anchor;
+
+	*dst_len = op - dst;
+	return 0;
+}
+EXPORT_SYMBOL(lz4_compress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 compressor");
@@ -0,0 +1,126 @@
+/*
+ * LZ4 Decompressor for Linux kernel
+ *
+ * Safe decoder for the LZ4 block format: every literal run and match
+ * is checked against both the input and the output buffer, so
+ * corrupted input can never cause out-of-bounds accesses.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef STATIC
+#include <linux/module.h>
+#include <linux/kernel.h>
+#endif
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+/*
+ * Read an extended length: a run of 255 bytes terminated by a
+ * byte < 255. Returns -1 if the input ends first.
+ */
+static inline int lz4_get_length(const u8 **ipp, const u8 *iend,
+		size_t *len)
+{
+	const u8 *ip = *ipp;
+	unsigned int s;
+
+	do {
+		if (unlikely(ip >= iend))
+			return -1;
+		s = *ip++;
+		*len += s;
+	} while (s == 255);
+
+	*ipp = ip;
+	return 0;
+}
+
+int lz4_decompress_unknownoutputsize(const unsigned char *src, size_t src_len,
+		unsigned char *dest, size_t *dest_len)
+{
+	const u8 *ip = src;
+	const u8 * const iend = src + src_len;
+	u8 *op = dest;
+	u8 * const oend = dest + *dest_len;
+	const u8 *ref;
+	unsigned int token;
+	size_t length, offset;
+
+	while (ip < iend) {
+		token = *ip++;
+
+		/* get runlength */
+		length = token >> ML_BITS;
+		if (length == RUN_MASK &&
+				lz4_get_length(&ip, iend, &length))
+			goto _output_error;
+
+		/* copy literals */
+		if (unlikely(length > (size_t)(iend - ip) ||
+				length > (size_t)(oend - op)))
+			goto _output_error;
+		memcpy(op, ip, length);
+		op += length;
+		ip += length;
+
+		/* the last sequence has no match part */
+		if (ip == iend)
+			break;
+
+		/* get offset */
+		if (unlikely(iend - ip < 2))
+			goto _output_error;
+		offset = LZ4_READ_LE16(ip);
+		ip += 2;
+		if (unlikely(!offset || offset > (size_t)(op - dest)))
+			goto _output_error;
+		ref = op - offset;
+
+		/* get matchlength */
+		length = token & ML_MASK;
+		if (length == ML_MASK &&
+				lz4_get_length(&ip, iend, &length))
+			goto _output_error;
+		length += MINMATCH;
+
+		if (unlikely(length > (size_t)(oend - op)))
+			goto _output_error;
+
+		/*
+		 * copy repeated sequence: 8 bytes at a time when the
+		 * source is far enough behind and there is slack in the
+		 * output, byte by byte otherwise (overlapping copies
+		 * replicate short patterns).
+		 */
+		if (offset >= 8 && length + 8 <= (size_t)(oend - op)) {
+			u8 * const cpy = op + length;
+
+			do {
+				LZ4_COPY8(op, ref);
+				op += 8;
+				ref += 8;
+			} while (op < cpy);
+			op = cpy;
+		} else {
+			while (length--)
+				*op++ = *ref++;
+		}
+	}
+
+	*dest_len = op - dest;
+	return 0;
+
+_output_error:
+	return -1;
+}
+#ifndef STATIC
+EXPORT_SYMBOL(lz4_decompress_unknownoutputsize);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Decompressor");
+#endif
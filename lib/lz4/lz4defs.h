@@ -0,0 +1,36 @@
+/*
+ * lz4defs.h -- architecture specific defines
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define MINMATCH	4
+
+/* Last 5 bytes of a block are always literals */
+#define LASTLITERALS	5
+/* A match may not start within the last 12 bytes of a block */
+#define MFLIMIT		(8 + MINMATCH)
+
+#define ML_BITS		4
+#define ML_MASK		((1U << ML_BITS) - 1)
+#define RUN_BITS	(8 - ML_BITS)
+#define RUN_MASK	((1U << RUN_BITS) - 1)
+
+#define MAX_DISTANCE	((1 << 16) - 1)
+
+/*
+ * Increasing this value makes the compressor skip faster over
+ * incompressible data at the cost of ratio.
+ */
+#define SKIP_STRENGTH	6
+
+#define LZ4_HASH_SIZE	(1 << LZ4_HASH_LOG)
+
+#define LZ4_READ32(p)		get_unaligned((const u32 *)(p))
+#define LZ4_READ_LE32(p)	get_unaligned_le32(p)
+#define LZ4_READ_LE16(p)	get_unaligned_le16(p)
+#define LZ4_WRITE_LE16(p, v)	put_unaligned_le16(v, p)
+#define LZ4_COPY8(d, s)		\
+		put_unaligned(get_unaligned((const u64 *)(s)), (u64 *)(d))
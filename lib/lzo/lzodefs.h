@@ -15,6 +15,33 @@
 #define LZO_VERSION_STRING	"2.02"
 #define LZO_VERSION_DATE	"Oct 17 2005"
 
+/*
+ * ARMv6 and later kernels run with the alignment trap disabled (see
+ * arch/arm/mm/alignment.c), so a plain ldr/str copes with any address,
+ * while get_unaligned() is still done a byte at a time there. Not so for
+ * the boot decompressor (STATIC), which may run with the MMU off, where
+ * every unaligned access faults.
+ */
+#if defined(__arm__) && __LINUX_ARM_ARCH__ >= 6 && !defined(STATIC)
+#define LZO_FAST_UNALIGNED	1
+static inline void lzo_copy4(void *dst, const void *src)
+{
+	u32 v;
+
+	asm("ldr	%0, %1" : "=r" (v) : "Q" (*(const u32 *)src));
+	asm("str	%1, %0" : "=Q" (*(u32 *)dst) : "r" (v));
+}
+#define COPY4(dst, src)	lzo_copy4(dst, src)
+#else
+#if defined(CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS)
+#define LZO_FAST_UNALIGNED	1
+#endif
+#define COPY4(dst, src)	\
+		put_unaligned(get_unaligned((const u32 *)(src)), (u32 *)(dst))
+#endif
+#define COPY8(dst, src)	\
+		do { COPY4(dst, src); COPY4((dst) + 4, (src) + 4); } while (0)
+
 #define M1_MAX_OFFSET	0x0400
 #define M2_MAX_OFFSET	0x0800
 #define M3_MAX_OFFSET	0x4000
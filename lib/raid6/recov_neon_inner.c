@@ -0,0 +1,98 @@
+/*
+ * raid6/recov_neon_inner.c
+ *
+ * RAID-6 data recovery using NEON. The GF(2^8) multiplications by the
+ * constants are done a nibble at a time with vtbl lookups in the
+ * 16 entry tables of raid6_vgfmul, like the SSSE3 pshufb method.
+ *
+ * Built with -mfpu=neon and includes no kernel headers, see asm/neon.h.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#include <arm_neon.h>
+
+/* 16 entry table lookup of each byte of b, which must all be < 16 */
+static inline uint8x16_t vtbl16q_u8(uint8x16_t tbl, uint8x16_t b)
+{
+	uint8x8x2_t t = { { vget_low_u8(tbl), vget_high_u8(tbl) } };
+
+	return vcombine_u8(vtbl2_u8(t, vget_low_u8(b)),
+			   vtbl2_u8(t, vget_high_u8(b)));
+}
+
+/* multiply each byte of x by the constant whose raid6_vgfmul row is m */
+static inline uint8x16_t gfmulq_u8(uint8x16_t m0, uint8x16_t m1,
+				   uint8x16_t x)
+{
+	const uint8x16_t x0f = vdupq_n_u8(0x0f);
+
+	return veorq_u8(vtbl16q_u8(m0, vandq_u8(x, x0f)),
+			vtbl16q_u8(m1, vshrq_n_u8(x, 4)));
+}
+
+void __raid6_2data_recov_neon(int bytes, uint8_t *p, uint8_t *q, uint8_t *dp,
+			      uint8_t *dq, const uint8_t *pbmul,
+			      const uint8_t *qmul)
+{
+	const uint8x16_t pm0 = vld1q_u8(pbmul);
+	const uint8x16_t pm1 = vld1q_u8(pbmul + 16);
+	const uint8x16_t qm0 = vld1q_u8(qmul);
+	const uint8x16_t qm1 = vld1q_u8(qmul + 16);
+
+	/*
+	 * while ( bytes-- ) {
+	 *	px    = *p ^ *dp;
+	 *	qx    = qmul[*q ^ *dq];
+	 *	*dq++ = db = pbmul[px] ^ qx;
+	 *	*dp++ = db ^ px;
+	 *	p++; q++;
+	 * }
+	 */
+	while (bytes > 0) {
+		uint8x16_t px, qx, db;
+
+		px = veorq_u8(vld1q_u8(p), vld1q_u8(dp));
+		qx = gfmulq_u8(qm0, qm1, veorq_u8(vld1q_u8(q), vld1q_u8(dq)));
+		db = veorq_u8(gfmulq_u8(pm0, pm1, px), qx);
+
+		vst1q_u8(dq, db);
+		vst1q_u8(dp, veorq_u8(db, px));
+
+		bytes -= 16;
+		p += 16;
+		q += 16;
+		dp += 16;
+		dq += 16;
+	}
+}
+
+void __raid6_datap_recov_neon(int bytes, uint8_t *p, uint8_t *q, uint8_t *dq,
+			      const uint8_t *qmul)
+{
+	const uint8x16_t qm0 = vld1q_u8(qmul);
+	const uint8x16_t qm1 = vld1q_u8(qmul + 16);
+
+	/*
+	 * while (bytes--) {
+	 *	*p++ ^= *dq = qmul[*q ^ *dq];
+	 *	q++; dq++;
+	 * }
+	 */
+	while (bytes > 0) {
+		uint8x16_t vx;
+
+		vx = gfmulq_u8(qm0, qm1, veorq_u8(vld1q_u8(q), vld1q_u8(dq)));
+
+		vst1q_u8(dq, vx);
+		vst1q_u8(p, veorq_u8(vx, vld1q_u8(p)));
+
+		bytes -= 16;
+		p += 16;
+		q += 16;
+		dq += 16;
+	}
+}
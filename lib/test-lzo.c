@@ -0,0 +1,393 @@
+/*
+ * lib/test-lzo.c
+ *
+ * Checks lzo1x_decompress_safe() against the byte at a time decompressor
+ * it replaced, on pages compressed the way zram does it, and reports the
+ * throughput of both.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/hrtimer.h>
+#include <linux/lzo.h>
+#include <linux/math64.h>
+#include <linux/random.h>
+#include <linux/sched.h>
+#include <linux/vmalloc.h>
+#include <asm/unaligned.h>
+#include "lzo/lzodefs.h"
+
+static unsigned int size_kb = 1024;
+module_param(size_kb, uint, 0444);
+MODULE_PARM_DESC(size_kb, "amount of data to compress, in kB");
+
+static unsigned int loops = 16;
+module_param(loops, uint, 0444);
+MODULE_PARM_DESC(loops, "number of passes over the data per decompressor");
+
+#define REF_HAVE_IP(x, ip_end, ip) ((size_t)(ip_end - ip) < (x))
+#define REF_HAVE_OP(x, op_end, op) ((size_t)(op_end - op) < (x))
+#define REF_HAVE_LB(m_pos, out, op) (m_pos < out || m_pos >= op)
+
+#define REF_COPY4(dst, src)	\
+		put_unaligned(get_unaligned((const u32 *)(src)), (u32 *)(dst))
+
+/* lib/lzo/lzo1x_decompress.c before it was rewritten for word copies */
+static int lzo1x_decompress_bytewise(const unsigned char *in, size_t in_len,
+				     unsigned char *out, size_t *out_len)
+{
+	const unsigned char * const ip_end = in + in_len;
+	unsigned char * const op_end = out + *out_len;
+	const unsigned char *ip = in, *m_pos;
+	unsigned char *op = out;
+	size_t t;
+
+	*out_len = 0;
+
+	if (*ip > 17) {
+		t = *ip++ - 17;
+		if (t < 4)
+			goto match_next;
+		if (REF_HAVE_OP(t, op_end, op))
+			goto output_overrun;
+		if (REF_HAVE_IP(t + 1, ip_end, ip))
+			goto input_overrun;
+		do {
+			*op++ = *ip++;
+		} while (--t > 0);
+		goto first_literal_run;
+	}
+
+	while ((ip < ip_end)) {
+		t = *ip++;
+		if (t >= 16)
+			goto match;
+		if (t == 0) {
+			if (REF_HAVE_IP(1, ip_end, ip))
+				goto input_overrun;
+			while (*ip == 0) {
+				t += 255;
+				ip++;
+				if (REF_HAVE_IP(1, ip_end, ip))
+					goto input_overrun;
+			}
+			t += 15 + *ip++;
+		}
+		if (REF_HAVE_OP(t + 3, op_end, op))
+			goto output_overrun;
+		if (REF_HAVE_IP(t + 4, ip_end, ip))
+			goto input_overrun;
+
+		REF_COPY4(op, ip);
+		op += 4;
+		ip += 4;
+		if (--t > 0) {
+			if (t >= 4) {
+				do {
+					REF_COPY4(op, ip);
+					op += 4;
+					ip += 4;
+					t -= 4;
+				} while (t >= 4);
+				if (t > 0) {
+					do {
+						*op++ = *ip++;
+					} while (--t > 0);
+				}
+			} else {
+				do {
+					*op++ = *ip++;
+				} while (--t > 0);
+			}
+		}
+
+first_literal_run:
+		t = *ip++;
+		if (t >= 16)
+			goto match;
+		m_pos = op - (1 + M2_MAX_OFFSET);
+		m_pos -= t >> 2;
+		m_pos -= *ip++ << 2;
+
+		if (REF_HAVE_LB(m_pos, out, op))
+			goto lookbehind_overrun;
+
+		if (REF_HAVE_OP(3, op_end, op))
+			goto output_overrun;
+		*op++ = *m_pos++;
+		*op++ = *m_pos++;
+		*op++ = *m_pos;
+
+		goto match_done;
+
+		do {
+match:
+			if (t >= 64) {
+				m_pos = op - 1;
+				m_pos -= (t >> 2) & 7;
+				m_pos -= *ip++ << 3;
+				t = (t >> 5) - 1;
+				if (REF_HAVE_LB(m_pos, out, op))
+					goto lookbehind_overrun;
+				if (REF_HAVE_OP(t + 3 - 1, op_end, op))
+					goto output_overrun;
+				goto copy_match;
+			} else if (t >= 32) {
+				t &= 31;
+				if (t == 0) {
+					if (REF_HAVE_IP(1, ip_end, ip))
+						goto input_overrun;
+					while (*ip == 0) {
+						t += 255;
+						ip++;
+						if (REF_HAVE_IP(1, ip_end, ip))
+							goto input_overrun;
+					}
+					t += 31 + *ip++;
+				}
+				m_pos = op - 1;
+				m_pos -= get_unaligned_le16(ip) >> 2;
+				ip += 2;
+			} else if (t >= 16) {
+				m_pos = op;
+				m_pos -= (t & 8) << 11;
+
+				t &= 7;
+				if (t == 0) {
+					if (REF_HAVE_IP(1, ip_end, ip))
+						goto input_overrun;
+					while (*ip == 0) {
+						t += 255;
+						ip++;
+						if (REF_HAVE_IP(1, ip_end, ip))
+							goto input_overrun;
+					}
+					t += 7 + *ip++;
+				}
+				m_pos -= get_unaligned_le16(ip) >> 2;
+				ip += 2;
+				if (m_pos == op)
+					goto eof_found;
+				m_pos -= 0x4000;
+			} else {
+				m_pos = op - 1;
+				m_pos -= t >> 2;
+				m_pos -= *ip++ << 2;
+
+				if (REF_HAVE_LB(m_pos, out, op))
+					goto lookbehind_overrun;
+				if (REF_HAVE_OP(2, op_end, op))
+					goto output_overrun;
+
+				*op++ = *m_pos++;
+				*op++ = *m_pos;
+				goto match_done;
+			}
+
+			if (REF_HAVE_LB(m_pos, out, op))
+				goto lookbehind_overrun;
+			if (REF_HAVE_OP(t + 3 - 1, op_end, op))
+				goto output_overrun;
+
+			if (t >= 2 * 4 - (3 - 1) && (op - m_pos) >= 4) {
+				REF_COPY4(op, m_pos);
+				op += 4;
+				m_pos += 4;
+				t -= 4 - (3 - 1);
+				do {
+					REF_COPY4(op, m_pos);
+					op += 4;
+					m_pos += 4;
+					t -= 4;
+				} while (t >= 4);
+				if (t > 0)
+					do {
+						*op++ = *m_pos++;
+					} while (--t > 0);
+			} else {
+copy_match:
+				*op++ = *m_pos++;
+				*op++ = *m_pos++;
+				do {
+					*op++ = *m_pos++;
+				} while (--t > 0);
+			}
+match_done:
+			t = ip[-2] & 3;
+			if (t == 0)
+				break;
+match_next:
+			if (REF_HAVE_OP(t, op_end, op))
+				goto output_overrun;
+			if (REF_HAVE_IP(t + 1, ip_end, ip))
+				goto input_overrun;
+
+			*op++ = *ip++;
+			if (t > 1) {
+				*op++ = *ip++;
+				if (t > 2)
+					*op++ = *ip++;
+			}
+
+			t = *ip++;
+		} while (ip < ip_end);
+	}
+
+	*out_len = op - out;
+	return LZO_E_EOF_NOT_FOUND;
+
+eof_found:
+	*out_len = op - out;
+	return (ip == ip_end ? LZO_E_OK :
+		(ip < ip_end ? LZO_E_INPUT_NOT_CONSUMED : LZO_E_INPUT_OVERRUN));
+input_overrun:
+	*out_len = op - out;
+	return LZO_E_INPUT_OVERRUN;
+
+output_overrun:
+	*out_len = op - out;
+	return LZO_E_OUTPUT_OVERRUN;
+
+lookbehind_overrun:
+	*out_len = op - out;
+	return LZO_E_LOOKBEHIND_OVERRUN;
+}
+
+/*
+ * Something between text and binary: literals, short and long matches,
+ * and runs of zeroes, which compresses to about half like typical
+ * anonymous memory does.
+ */
+static void __init test_lzo_fill(u8 *buf, size_t len)
+{
+	size_t i = 0;
+
+	while (i < len) {
+		u32 r = random32();
+		size_t n = 1 + ((r >> 8) & 31);
+
+		switch (r & 3) {
+		case 0:
+			while (n-- && i < len)
+				buf[i++] = random32();
+			break;
+		case 1:
+			n = 64 * n;
+			while (n-- && i < len)
+				buf[i++] = 0;
+			break;
+		default:
+			if (i < 64) {
+				buf[i++] = r >> 16;
+				break;
+			}
+			r = 1 + (r >> 16) % min_t(size_t, i, 8192);
+			n += 2;
+			while (n-- && i < len) {
+				buf[i] = buf[i - r];
+				i++;
+			}
+		}
+	}
+}
+
+typedef int (*decompress_fn)(const unsigned char *, size_t,
+			     unsigned char *, size_t *);
+
+/* decompresses every page @loops times, returns the time taken in ns */
+static s64 __init test_lzo_run(decompress_fn fn, const u8 *cmp,
+			       const size_t *cmp_len, unsigned int pages,
+			       u8 *out, const u8 *orig)
+{
+	ktime_t start = ktime_get();
+	unsigned int i, l;
+
+	for (l = 0; l < loops; l++) {
+		for (i = 0; i < pages; i++) {
+			size_t out_len = PAGE_SIZE;
+			int ret;
+
+			ret = fn(cmp + i * lzo1x_worst_compress(PAGE_SIZE),
+				 cmp_len[i], out, &out_len);
+			if (ret != LZO_E_OK || out_len != PAGE_SIZE ||
+			    memcmp(out, orig + i * PAGE_SIZE, PAGE_SIZE)) {
+				pr_err("test_lzo: page %u: error %d, %zu bytes\n",
+				       i, ret, out_len);
+				return -1;
+			}
+		}
+		cond_resched();
+	}
+	return ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+static unsigned int __init test_lzo_mbps(unsigned int pages, s64 ns)
+{
+	u64 bytes = (u64)pages * PAGE_SIZE * loops;
+
+	return ns > 0 ? div64_u64(bytes * 1000, ns) : 0;
+}
+
+static int __init test_lzo_init(void)
+{
+	unsigned int pages = max(size_kb >> (PAGE_SHIFT - 10), 1U);
+	size_t wc = lzo1x_worst_compress(PAGE_SIZE), total = 0;
+	u8 *orig, *cmp, *out;
+	size_t *cmp_len;
+	void *wrkmem;
+	s64 t_new, t_ref;
+	unsigned int i;
+	int ret = -ENOMEM;
+
+	orig = vmalloc(pages * PAGE_SIZE);
+	cmp = vmalloc(pages * wc);
+	cmp_len = vmalloc(pages * sizeof(*cmp_len));
+	out = vmalloc(PAGE_SIZE);
+	wrkmem = vmalloc(LZO1X_MEM_COMPRESS);
+	if (!orig || !cmp || !cmp_len || !out || !wrkmem)
+		goto out;
+
+	test_lzo_fill(orig, pages * PAGE_SIZE);
+	for (i = 0; i < pages; i++) {
+		lzo1x_1_compress(orig + i * PAGE_SIZE, PAGE_SIZE,
+				 cmp + i * wc, &cmp_len[i], wrkmem);
+		total += cmp_len[i];
+	}
+
+	ret = -EINVAL;
+	t_ref = test_lzo_run(lzo1x_decompress_bytewise, cmp, cmp_len, pages,
+			     out, orig);
+	t_new = test_lzo_run(lzo1x_decompress_safe, cmp, cmp_len, pages,
+			     out, orig);
+	if (t_ref < 0 || t_new < 0)
+		goto out;
+
+	pr_info("test_lzo: %u pages, %zu%% compressed: "
+		"byte copies %u MB/s, word copies %u MB/s\n",
+		pages, total * 100 / ((size_t)pages * PAGE_SIZE),
+		test_lzo_mbps(pages, t_ref), test_lzo_mbps(pages, t_new));
+	ret = 0;
+out:
+	vfree(wrkmem);
+	vfree(out);
+	vfree(cmp_len);
+	vfree(cmp);
+	vfree(orig);
+	return ret;
+}
+
+static void __exit test_lzo_exit(void)
+{
+}
+
+module_init(test_lzo_init);
+module_exit(test_lzo_exit);
+
+MODULE_DESCRIPTION("LZO decompressor test and benchmark");
+MODULE_LICENSE("GPL");
@@ -96,6 +96,15 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		   K(bdi_thresh), K(dirty_thresh),
 		   K(background_thresh), nr_dirty, nr_io, nr_more_io,
 		   !list_empty(&bdi->bdi_list), bdi->state);
+#ifdef CONFIG_ADAPTIVE_READAHEAD
+	seq_printf(m,
+		   "Readahead:        %8lu kB\n"
+		   "ReadaheadUsed:    %8lu kB\n"
+		   "ReadaheadUnused:  %8lu kB\n",
+		   (unsigned long) K(bdi_stat(bdi, BDI_READAHEAD)),
+		   (unsigned long) K(bdi_stat(bdi, BDI_READAHEAD_USED)),
+		   (unsigned long) K(bdi_stat(bdi, BDI_READAHEAD_UNUSED)));
+#endif
 #undef K
 
 	return 0;
@@ -0,0 +1,505 @@
+/*
+ * Contiguous Memory Allocator framework: Segregated Fit allocator
+ *
+ * Holes are kept on free lists by size class, class n holding holes
+ * of 2^n up to 2^(n+1) - 1 pages, with a bitmap of the classes that
+ * are not empty.  A request is served from the first hole of the
+ * smallest class whose holes are all big enough, found with a single
+ * bit search, so unless alignment gets in the way the time it takes
+ * does not depend on how fragmented the region is.  Only if no such
+ * class has a hole is the request's own class searched hole by hole.
+ *
+ * Holes are also kept in an address ordered tree so that they can be
+ * merged with their neighbours when a chunk is freed.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License or (at your optional) any later version of the license.
+ */
+
+#define pr_fmt(fmt) "cma: sf: " fmt
+
+#ifdef CONFIG_CMA_DEBUG
+#  define DEBUG
+#endif
+
+#include <linux/errno.h>       /* Error numbers */
+#include <linux/slab.h>        /* kmalloc() */
+#include <linux/bitops.h>      /* find_next_bit() */
+#include <linux/log2.h>        /* is_power_of_2() */
+#include <linux/math64.h>      /* div_u64() */
+#include <linux/mutex.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+#include <linux/cma.h>         /* CMA structures */
+
+
+/************************* Data Types *************************/
+
+#define CMA_SF_CLASSES	BITS_PER_LONG
+
+struct cma_sf_item {
+	struct cma_chunk ch;
+	struct list_head by_class;
+	unsigned class;
+};
+
+struct cma_sf_stats {
+	unsigned long allocs;
+	unsigned long frees;
+	unsigned long failures;
+	/* requests no class above their own could serve */
+	unsigned long slow_path;
+	/* holes looked at on the slow path or for alignment */
+	unsigned long scanned;
+};
+
+struct cma_sf_private {
+	struct rb_root by_start_root;
+	struct list_head classes[CMA_SF_CLASSES];
+	unsigned long nonempty;
+	unsigned long holes[CMA_SF_CLASSES];
+
+	/*
+	 * Allocation and freeing are serialised by the CMA framework,
+	 * this only keeps the statistics file from seeing a hole list
+	 * that is being changed.
+	 */
+	struct mutex lock;
+	struct cma_sf_stats stats;
+	struct dentry *debugfs;
+};
+
+
+/************************* Prototypes *************************/
+
+static void __cma_sf_hole_insert_by_class(struct cma_sf_item *item);
+static void __cma_sf_hole_erase_by_class(struct cma_sf_item *item);
+static int  __must_check
+__cma_sf_hole_insert_by_start(struct cma_sf_item *item);
+static void __cma_sf_hole_erase_by_start(struct cma_sf_item *item);
+
+/**
+ * __cma_sf_hole_take - takes a chunk of memory out of a hole.
+ * @hole:	hole to take chunk from
+ * @start:	chunk's start, already aligned
+ * @size:	chunk's size
+ *
+ * The chunk must lie within the hole.  What is left of the hole on
+ * either side stays a hole, in the class it now belongs to.
+ *
+ * Returns allocated item or NULL on error (if kmalloc() failed).
+ */
+static struct cma_sf_item *__must_check
+__cma_sf_hole_take(struct cma_sf_item *hole, dma_addr_t start, size_t size);
+
+/**
+ * __cma_sf_hole_merge_maybe - tries to merge hole with neighbours.
+ * @item: hole to try and merge
+ */
+static void __cma_sf_hole_merge_maybe(struct cma_sf_item *item);
+
+static void cma_sf_debugfs_add(struct cma_region *reg);
+
+
+/************************* Device API *************************/
+
+static int cma_sf_init(struct cma_region *reg)
+{
+	struct cma_sf_private *prv;
+	struct cma_sf_item *item;
+	unsigned i;
+
+	prv = kzalloc(sizeof *prv, GFP_KERNEL);
+	if (unlikely(!prv))
+		return -ENOMEM;
+
+	item = kzalloc(sizeof *item, GFP_KERNEL);
+	if (unlikely(!item)) {
+		kfree(prv);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < CMA_SF_CLASSES; ++i)
+		INIT_LIST_HEAD(&prv->classes[i]);
+	mutex_init(&prv->lock);
+	reg->private_data = prv;
+
+	item->ch.start = reg->start;
+	item->ch.size  = reg->size;
+	item->ch.reg   = reg;
+
+	rb_root_init(&prv->by_start_root, &item->ch.by_start);
+	__cma_sf_hole_insert_by_class(item);
+
+	cma_sf_debugfs_add(reg);
+	return 0;
+}
+
+static void cma_sf_cleanup(struct cma_region *reg)
+{
+	struct cma_sf_private *prv = reg->private_data;
+	struct cma_sf_item *item =
+		rb_entry(prv->by_start_root.rb_node,
+			 struct cma_sf_item, ch.by_start);
+
+	debugfs_remove(prv->debugfs);
+
+	/* We can assume there is only a single hole in the tree. */
+	WARN_ON(item->ch.by_start.rb_left || item->ch.by_start.rb_right);
+
+	kfree(item);
+	kfree(prv);
+}
+
+static struct cma_chunk *cma_sf_alloc(struct cma_region *reg,
+				      size_t size, dma_addr_t alignment)
+{
+	struct cma_sf_private *prv = reg->private_data;
+	unsigned long pages = size >> PAGE_SHIFT;
+	unsigned class, first;
+	struct cma_sf_item *item;
+	dma_addr_t start;
+
+	if (unlikely(!pages))
+		return NULL;
+
+	/*
+	 * Every hole in class 'first' or above is big enough; with
+	 * a power of two request that includes its own class.
+	 */
+	class = __fls(pages);
+	first = is_power_of_2(pages) ? class : class + 1;
+
+	mutex_lock(&prv->lock);
+
+	for (class = find_next_bit(&prv->nonempty, CMA_SF_CLASSES, first);
+	     class < CMA_SF_CLASSES;
+	     class = find_next_bit(&prv->nonempty, CMA_SF_CLASSES, class + 1))
+		list_for_each_entry(item, &prv->classes[class], by_class) {
+			start = ALIGN(item->ch.start, alignment);
+			if (start < item->ch.start + item->ch.size &&
+			    item->ch.start + item->ch.size - start >= size)
+				goto found;
+			++prv->stats.scanned;
+		}
+
+	/* Last resort, holes of the request's own class that may fit. */
+	class = __fls(pages);
+	if (first != class) {
+		++prv->stats.slow_path;
+		list_for_each_entry(item, &prv->classes[class], by_class) {
+			start = ALIGN(item->ch.start, alignment);
+			if (start < item->ch.start + item->ch.size &&
+			    item->ch.start + item->ch.size - start >= size)
+				goto found;
+			++prv->stats.scanned;
+		}
+	}
+
+	++prv->stats.failures;
+	mutex_unlock(&prv->lock);
+	return NULL;
+
+found:
+	item = __cma_sf_hole_take(item, start, size);
+	if (likely(item))
+		++prv->stats.allocs;
+	else
+		++prv->stats.failures;
+	mutex_unlock(&prv->lock);
+
+	return likely(item) ? &item->ch : NULL;
+}
+
+static void cma_sf_free(struct cma_chunk *chunk)
+{
+	struct cma_sf_item *item = container_of(chunk, struct cma_sf_item, ch);
+	struct cma_sf_private *prv = chunk->reg->private_data;
+
+	mutex_lock(&prv->lock);
+
+	/* Add new hole */
+	if (unlikely(__cma_sf_hole_insert_by_start(item))) {
+		/*
+		 * Same as best-fit allocator: things are broken beyond
+		 * repair, just free the item and forget about it.
+		 */
+		kfree(item);
+	} else {
+		__cma_sf_hole_insert_by_class(item);
+
+		/* Merge with prev and next sibling */
+		__cma_sf_hole_merge_maybe(item);
+	}
+
+	++prv->stats.frees;
+	mutex_unlock(&prv->lock);
+}
+
+
+/************************* Basic List and Tree Manipulation *************************/
+
+static void __cma_sf_hole_insert_by_class(struct cma_sf_item *item)
+{
+	struct cma_sf_private *prv = item->ch.reg->private_data;
+
+	item->class = __fls(item->ch.size >> PAGE_SHIFT);
+	list_add(&item->by_class, &prv->classes[item->class]);
+	__set_bit(item->class, &prv->nonempty);
+	++prv->holes[item->class];
+}
+
+static void __cma_sf_hole_erase_by_class(struct cma_sf_item *item)
+{
+	struct cma_sf_private *prv = item->ch.reg->private_data;
+
+	list_del(&item->by_class);
+	if (list_empty(&prv->classes[item->class]))
+		__clear_bit(item->class, &prv->nonempty);
+	--prv->holes[item->class];
+}
+
+/* Moves hole to the class matching its size after the size changed. */
+static void __cma_sf_hole_reclass(struct cma_sf_item *item)
+{
+	if (item->class != __fls(item->ch.size >> PAGE_SHIFT)) {
+		__cma_sf_hole_erase_by_class(item);
+		__cma_sf_hole_insert_by_class(item);
+	}
+}
+
+static int  __must_check
+__cma_sf_hole_insert_by_start(struct cma_sf_item *item)
+{
+	struct cma_sf_private *prv = item->ch.reg->private_data;
+	struct rb_node **link = &prv->by_start_root.rb_node, *parent = NULL;
+	const typeof(item->ch.start) value = item->ch.start;
+
+	while (*link) {
+		struct cma_sf_item *i;
+		parent = *link;
+		i = rb_entry(parent, struct cma_sf_item, ch.by_start);
+
+		if (WARN_ON(value == i->ch.start))
+			/* See __cma_bf_hole_insert_by_start(). */
+			return -EBUSY;
+
+		link = value <= i->ch.start
+			? &parent->rb_left
+			: &parent->rb_right;
+	}
+
+	rb_link_node(&item->ch.by_start, parent, link);
+	rb_insert_color(&item->ch.by_start, &prv->by_start_root);
+	return 0;
+}
+
+static void __cma_sf_hole_erase_by_start(struct cma_sf_item *item)
+{
+	struct cma_sf_private *prv = item->ch.reg->private_data;
+	rb_erase(&item->ch.by_start, &prv->by_start_root);
+}
+
+
+/************************* More Complex Manipulation *************************/
+
+static struct cma_sf_item *__must_check
+__cma_sf_hole_take(struct cma_sf_item *hole, dma_addr_t start, size_t size)
+{
+	dma_addr_t end = hole->ch.start + hole->ch.size;
+	struct cma_sf_item *item, *tail = NULL;
+
+	/* The whole hole, it simply becomes a chunk. */
+	if (start == hole->ch.start && start + size == end) {
+		__cma_sf_hole_erase_by_class(hole);
+		__cma_sf_hole_erase_by_start(hole);
+		return hole;
+	}
+
+	item = kmalloc(sizeof *item, GFP_KERNEL);
+	if (unlikely(!item))
+		return NULL;
+	item->ch.start = start;
+	item->ch.size  = size;
+	item->ch.reg   = hole->ch.reg;
+
+	/* A piece at each end, the one at the end needs a new hole. */
+	if (start != hole->ch.start && start + size != end) {
+		tail = kmalloc(sizeof *tail, GFP_KERNEL);
+		if (unlikely(!tail)) {
+			kfree(item);
+			return NULL;
+		}
+		tail->ch.start = start + size;
+		tail->ch.size  = end - tail->ch.start;
+		tail->ch.reg   = hole->ch.reg;
+
+		if (unlikely(__cma_sf_hole_insert_by_start(tail))) {
+			kfree(tail);
+			kfree(item);
+			return NULL;
+		}
+		__cma_sf_hole_insert_by_class(tail);
+	}
+
+	/*
+	 * No need to update the tree; the hole keeps its place in the
+	 * address order whichever end it is left with.
+	 */
+	if (start == hole->ch.start) {
+		hole->ch.start += size;
+		hole->ch.size  -= size;
+	} else {
+		hole->ch.size = start - hole->ch.start;
+	}
+	__cma_sf_hole_reclass(hole);
+
+	return item;
+}
+
+static void __cma_sf_hole_merge_maybe(struct cma_sf_item *item)
+{
+	struct cma_sf_item *prev, *next;
+	struct rb_node *node;
+
+	node = rb_prev(&item->ch.by_start);
+	if (node) {
+		prev = rb_entry(node, struct cma_sf_item, ch.by_start);
+		if (prev->ch.start + prev->ch.size == item->ch.start) {
+			__cma_sf_hole_erase_by_class(item);
+			__cma_sf_hole_erase_by_start(item);
+			prev->ch.size += item->ch.size;
+			__cma_sf_hole_reclass(prev);
+			kfree(item);
+			item = prev;
+		}
+	}
+
+	node = rb_next(&item->ch.by_start);
+	if (node) {
+		next = rb_entry(node, struct cma_sf_item, ch.by_start);
+		if (item->ch.start + item->ch.size == next->ch.start) {
+			__cma_sf_hole_erase_by_class(next);
+			__cma_sf_hole_erase_by_start(next);
+			item->ch.size += next->ch.size;
+			__cma_sf_hole_reclass(item);
+			kfree(next);
+		}
+	}
+}
+
+
+/************************* Statistics *************************/
+
+#ifdef CONFIG_DEBUG_FS
+
+static struct dentry *cma_sf_debugfs_root;
+
+/*
+ * Fragmentation is the part of the free space that is not in the
+ * largest hole, in per cent.  It is 0 while all the free memory is
+ * one hole and tends to 100 as it is scattered over small ones.
+ */
+static int cma_sf_stats_show(struct seq_file *m, void *v)
+{
+	struct cma_region *reg = m->private;
+	struct cma_sf_private *prv = reg->private_data;
+	struct cma_sf_item *item;
+	size_t free = 0, largest = 0;
+	unsigned long holes = 0;
+	unsigned class;
+
+	mutex_lock(&prv->lock);
+
+	for (class = 0; class < CMA_SF_CLASSES; ++class)
+		list_for_each_entry(item, &prv->classes[class], by_class) {
+			free += item->ch.size;
+			largest = max(largest, item->ch.size);
+			++holes;
+		}
+
+	seq_printf(m, "size:          %zu kB\n", reg->size >> 10);
+	seq_printf(m, "free:          %zu kB\n", free >> 10);
+	seq_printf(m, "largest hole:  %zu kB\n", largest >> 10);
+	seq_printf(m, "holes:         %lu\n", holes);
+	seq_printf(m, "fragmentation: %u%%\n", free ?
+		   (unsigned)div_u64((u64)(free - largest) * 100, free) : 0);
+	seq_printf(m, "allocs:        %lu\n", prv->stats.allocs);
+	seq_printf(m, "frees:         %lu\n", prv->stats.frees);
+	seq_printf(m, "failures:      %lu\n", prv->stats.failures);
+	seq_printf(m, "slow path:     %lu\n", prv->stats.slow_path);
+	seq_printf(m, "holes scanned: %lu\n", prv->stats.scanned);
+
+	seq_puts(m, "holes by class (pages):\n");
+	for (class = 0; class < CMA_SF_CLASSES; ++class)
+		if (prv->holes[class])
+			seq_printf(m, "  %10lu+ %lu\n", 1ul << class,
+				   prv->holes[class]);
+
+	mutex_unlock(&prv->lock);
+	return 0;
+}
+
+static int cma_sf_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, cma_sf_stats_show, inode->i_private);
+}
+
+static const struct file_operations cma_sf_stats_fops = {
+	.open		= cma_sf_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void cma_sf_debugfs_add(struct cma_region *reg)
+{
+	struct cma_sf_private *prv = reg->private_data;
+	char name[32];
+
+	if (!cma_sf_debugfs_root)
+		return;
+
+	if (reg->name)
+		strlcpy(name, reg->name, sizeof name);
+	else
+		snprintf(name, sizeof name, "private-%08llx",
+			 (unsigned long long)reg->start);
+
+	prv->debugfs = debugfs_create_file(name, S_IRUGO, cma_sf_debugfs_root,
+					   reg, &cma_sf_stats_fops);
+}
+
+static void __init cma_sf_debugfs_init(void)
+{
+	cma_sf_debugfs_root = debugfs_create_dir("cma-sf", NULL);
+	if (IS_ERR(cma_sf_debugfs_root))
+		cma_sf_debugfs_root = NULL;
+}
+
+#else
+
+static inline void cma_sf_debugfs_add(struct cma_region *reg) { }
+static inline void cma_sf_debugfs_init(void) { }
+
+#endif
+
+
+/************************* Register *************************/
+static int __init cma_sf_module_init(void)
+{
+	static struct cma_allocator alloc = {
+		.name    = "sf",
+		.init    = cma_sf_init,
+		.cleanup = cma_sf_cleanup,
+		.alloc   = cma_sf_alloc,
+		.free    = cma_sf_free,
+	};
+
+	cma_sf_debugfs_init();
+	return cma_allocator_register(&alloc);
+}
+module_init(cma_sf_module_init);
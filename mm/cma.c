@@ -427,9 +427,9 @@ int cma_allocator_register(struct cma_allocator *alloc)
 	cma_foreach_region(reg) {
 		if (reg->alloc)
 			continue;
-		if (reg->alloc_name
-		  ? alloc->name && !strcmp(alloc->name, reg->alloc_name)
-		  : (!reg->used && first))
+		if (!(reg->alloc_name
+		    ? alloc->name && !strcmp(alloc->name, reg->alloc_name)
+		    : (!reg->used && first)))
 			continue;
 
 		reg->alloc = alloc;
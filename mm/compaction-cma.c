@@ -542,6 +542,10 @@ static int compact_finished(struct zone *zone,
 	if (cc->free_pfn <= cc->migrate_pfn)
 		return COMPACT_COMPLETE;
 
+	/* kcompactd gives up the CPU at the end of its slice */
+	if (cc->proactive && time_after_eq(jiffies, cc->deadline))
+		return COMPACT_PARTIAL;
+
 	/*
 	 * order == -1 is expected when compacting via
 	 * /proc/sys/vm/compact_memory
@@ -558,6 +562,10 @@ static int compact_finished(struct zone *zone,
 
 	/* Direct compactor: Is a suitable page free? */
 	for (order = cc->order; order < MAX_ORDER; order++) {
+		/* kcompactd does not allocate, any free block will do */
+		if (cc->proactive && zone->free_area[order].nr_free)
+			return COMPACT_PARTIAL;
+
 		/* Job done if page is free of the right migratetype */
 		if (!list_empty(&zone->free_area[order].free_list[cc->migratetype]))
 			return COMPACT_PARTIAL;
@@ -635,10 +643,15 @@ static int compact_zone(struct zone *zone, struct compact_control *cc)
 		;
 	}
 
-	/* Setup to move all movable pages to the end of the zone */
-	cc->migrate_pfn = zone->zone_start_pfn;
-	cc->free_pfn = cc->migrate_pfn + zone->spanned_pages;
-	cc->free_pfn &= ~(pageblock_nr_pages-1);
+	/*
+	 * Setup to move all movable pages to the end of the zone, unless
+	 * kcompactd is resuming a pass that ran out of time
+	 */
+	if (!cc->free_pfn) {
+		cc->migrate_pfn = zone->zone_start_pfn;
+		cc->free_pfn = cc->migrate_pfn + zone->spanned_pages;
+		cc->free_pfn &= ~(pageblock_nr_pages-1);
+	}
 
 	migrate_prep_local();
 
@@ -667,6 +680,14 @@ static int compact_zone(struct zone *zone, struct compact_control *cc)
 		count_vm_events(COMPACTPAGES, nr_migrate - nr_remaining);
 		if (nr_remaining)
 			count_vm_events(COMPACTPAGEFAILED, nr_remaining);
+		if (cc->proactive) {
+			count_vm_event(COMPACTBLOCKS_KCOMPACTD);
+			count_vm_events(COMPACTPAGES_KCOMPACTD,
+					nr_migrate - nr_remaining);
+		} else if (cc->order != -1) {
+			count_vm_events(COMPACTPAGES_DIRECT,
+					nr_migrate - nr_remaining);
+		}
 		trace_mm_compaction_migratepages(nr_migrate - nr_remaining,
 						nr_remaining);
 
@@ -708,6 +729,51 @@ static unsigned long compact_zone_order(struct zone *zone,
 	return compact_zone(zone, &cc);
 }
 
+/**
+ * compact_zone_budget - Compact a zone in the background for kcompactd
+ * @zone: The zone to compact
+ * @order: The order blocks are wanted of
+ * @cursor: Where the last pass stopped, updated on return
+ * @deadline: Time in jiffies to stop at
+ *
+ * Migration is asynchronous and the pass stops at @deadline, as soon as
+ * there is a free block of @order, or when the scanners meet.  In the
+ * first case @cursor lets the next call carry on from where this one
+ * stopped instead of rescanning the start of the zone.
+ */
+unsigned long compact_zone_budget(struct zone *zone, int order,
+				  struct compact_cursor *cursor,
+				  unsigned long deadline)
+{
+	struct compact_control cc = {
+		.nr_freepages = 0,
+		.nr_migratepages = 0,
+		.order = order,
+		.migratetype = MIGRATE_MOVABLE,
+		.zone = zone,
+		.sync = false,
+		.migrate_pfn = cursor->migrate_pfn,
+		.free_pfn = cursor->free_pfn,
+		.proactive = true,
+		.deadline = deadline,
+	};
+	unsigned long ret;
+
+	INIT_LIST_HEAD(&cc.freepages);
+	INIT_LIST_HEAD(&cc.migratepages);
+
+	ret = compact_zone(zone, &cc);
+
+	if (ret == COMPACT_COMPLETE) {
+		cursor->free_pfn = 0;
+	} else if (cc.free_pfn) {
+		cursor->migrate_pfn = cc.migrate_pfn;
+		cursor->free_pfn = cc.free_pfn;
+	}
+
+	return ret;
+}
+
 int sysctl_extfrag_threshold = 500;
 
 /**
@@ -124,6 +124,9 @@ struct compact_control {
 	int order;          /* order a direct compactor needs */
 	int migratetype;        /* MOVABLE, RECLAIMABLE etc */
 	struct zone *zone;
+
+	bool proactive;     /* kcompactd, not for an allocation */
+	unsigned long deadline; /* jiffies kcompactd may run until */
 };
 
 unsigned long
@@ -0,0 +1,211 @@
+/*
+ * linux/mm/kcompactd.c
+ *
+ * Background memory compaction.
+ *
+ * Direct compaction only starts once a high order allocation has failed,
+ * so the caller stalls for the whole pass.  kcompactd keeps an eye on the
+ * fragmentation index of a few orders instead and, while it is above
+ * sysctl_extfrag_threshold, compacts in short slices so that blocks of
+ * those orders are already free when they are asked for.  It stays out
+ * of the way while kswapd is reclaiming, compaction needs free pages to
+ * migrate into and would only compete with it for them.
+ *
+ * The compaction itself is done by compact_zone_budget() of whichever
+ * compaction.c variant is built.
+ */
+
+#include <linux/mm.h>
+#include <linux/mmzone.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/freezer.h>
+#include <linux/kthread.h>
+#include <linux/vmstat.h>
+#include <linux/wait.h>
+#include <linux/compaction.h>
+
+/*
+ * Orders kcompactd keeps free blocks of, as a bitmask.  The default
+ * covers ION's system heap (orders 8 and 4) and 9k jumbo frames (order
+ * 2).  Zero stops kcompactd altogether.
+ */
+int sysctl_kcompactd_orders = (1 << 8) | (1 << 4) | (1 << 2);
+/* How often to look at the fragmentation index, 0 for only on demand */
+int sysctl_kcompactd_interval_ms = 500;
+/* How long each look may spend compacting */
+int sysctl_kcompactd_budget_ms = 20;
+
+struct kcompactd_zone {
+	struct compact_cursor cursor;
+	/* Like zone->compact_defer_shift, for passes that did not help */
+	unsigned int defer_shift;
+	unsigned int considered;
+};
+
+struct kcompactd {
+	struct task_struct *task;
+	wait_queue_head_t wait;
+	int wake_order;
+	struct kcompactd_zone zones[MAX_NR_ZONES];
+};
+
+static struct kcompactd kcompactd_nodes[MAX_NUMNODES];
+
+static void kcompactd_defer(struct kcompactd_zone *kz)
+{
+	kz->considered = 0;
+	if (kz->defer_shift < COMPACT_MAX_DEFER_SHIFT)
+		kz->defer_shift++;
+}
+
+static bool kcompactd_deferred(struct kcompactd_zone *kz)
+{
+	unsigned int limit = 1U << kz->defer_shift;
+
+	if (++kz->considered > limit)
+		kz->considered = limit;
+
+	return kz->considered < limit;
+}
+
+/* kswapd is only ever on its wait queue when it has nothing to do */
+static bool kswapd_is_running(pg_data_t *pgdat)
+{
+	return pgdat->kswapd && !waitqueue_active(&pgdat->kswapd_wait);
+}
+
+/* Returns the highest of @orders that @zone is too fragmented for, or -1 */
+static int kcompactd_zone_order(struct zone *zone, unsigned long orders)
+{
+	int order;
+
+	for (order = MAX_ORDER - 1; order > 0; order--)
+		if ((orders & (1UL << order)) &&
+		    fragmentation_index(zone, order) > sysctl_extfrag_threshold)
+			return order;
+
+	return -1;
+}
+
+static void kcompactd_do_work(pg_data_t *pgdat, struct kcompactd *kcd,
+			      int wake_order)
+{
+	unsigned long deadline, orders;
+	int zoneid;
+
+	orders = sysctl_kcompactd_orders | (1UL << wake_order);
+	orders &= ((1UL << MAX_ORDER) - 1) & ~1UL;
+	deadline = jiffies + msecs_to_jiffies(sysctl_kcompactd_budget_ms);
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+		struct kcompactd_zone *kz = &kcd->zones[zoneid];
+		unsigned long status;
+		int order;
+
+		if (!populated_zone(zone) || kcompactd_deferred(kz))
+			continue;
+
+		order = kcompactd_zone_order(zone, orders);
+		if (order < 0) {
+			kz->defer_shift = 0;
+			continue;
+		}
+
+		if (kswapd_is_running(pgdat)) {
+			count_vm_event(KCOMPACTD_BACKOFF);
+			return;
+		}
+		if (time_after_eq(jiffies, deadline))
+			return;
+
+		status = compact_zone_budget(zone, order, &kz->cursor, deadline);
+
+		/*
+		 * A whole pass that left the zone as fragmented as it was
+		 * means the rest is pinned; try again less and less often.
+		 */
+		if (status == COMPACT_COMPLETE &&
+		    fragmentation_index(zone, order) > sysctl_extfrag_threshold)
+			kcompactd_defer(kz);
+	}
+}
+
+static int kcompactd(void *p)
+{
+	pg_data_t *pgdat = p;
+	struct kcompactd *kcd = &kcompactd_nodes[pgdat->node_id];
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(current, cpumask);
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		long timeout = MAX_SCHEDULE_TIMEOUT;
+		int wake_order;
+
+		if (sysctl_kcompactd_interval_ms)
+			timeout = msecs_to_jiffies(sysctl_kcompactd_interval_ms);
+
+		wait_event_freezable_timeout(kcd->wait,
+				kcd->wake_order || kthread_should_stop(),
+				timeout);
+		if (kthread_should_stop())
+			break;
+
+		wake_order = xchg(&kcd->wake_order, 0);
+		if (!sysctl_kcompactd_orders)
+			continue;
+
+		count_vm_event(KCOMPACTD_WAKE);
+		kcompactd_do_work(pgdat, kcd, wake_order);
+	}
+
+	return 0;
+}
+
+/**
+ * wakeup_kcompactd - Ask for blocks of an order an allocation is short of
+ * @zone: The preferred zone of the allocation
+ * @order: The order of the allocation
+ *
+ * Called from the page allocator slow path.  Blocks of @order are made
+ * on the next wakeup even if @order is not among the watched ones.
+ */
+void wakeup_kcompactd(struct zone *zone, int order)
+{
+	struct kcompactd *kcd = &kcompactd_nodes[zone_to_nid(zone)];
+
+	if (!kcd->task || !sysctl_kcompactd_orders || order >= MAX_ORDER)
+		return;
+
+	if (order > kcd->wake_order)
+		kcd->wake_order = order;
+	if (waitqueue_active(&kcd->wait))
+		wake_up_interruptible(&kcd->wait);
+}
+
+static int __init kcompactd_init(void)
+{
+	int nid;
+
+	for_each_node_state(nid, N_HIGH_MEMORY) {
+		struct kcompactd *kcd = &kcompactd_nodes[nid];
+		struct task_struct *task;
+
+		init_waitqueue_head(&kcd->wait);
+		task = kthread_run(kcompactd, NODE_DATA(nid), "kcompactd%d",
+				   nid);
+		if (IS_ERR(task)) {
+			printk(KERN_ERR "Failed to start kcompactd on node %d\n",
+			       nid);
+			continue;
+		}
+		kcd->task = task;
+	}
+
+	return 0;
+}
+module_init(kcompactd_init)
@@ -38,6 +38,83 @@ int sysctl_oom_kill_allocating_task;
 int sysctl_oom_dump_tasks = 1;
 static DEFINE_SPINLOCK(zone_scan_lock);
 
+#ifdef CONFIG_OOM_ADJ_BUCKETS
+DEFINE_SPINLOCK(oom_adj_bucket_lock);
+EXPORT_SYMBOL_GPL(oom_adj_bucket_lock);
+
+/* hlists, so they are usable before any initcall runs */
+struct hlist_head oom_adj_buckets[OOM_ADJ_BUCKETS];
+EXPORT_SYMBOL_GPL(oom_adj_buckets);
+
+static struct hlist_head *oom_adj_bucket(struct task_struct *p)
+{
+	int adj = clamp(p->signal->oom_adj, OOM_DISABLE, OOM_ADJUST_MAX);
+
+	return &oom_adj_buckets[adj - OOM_DISABLE];
+}
+
+/*
+ * The add, del and replace helpers are called with tasklist_lock held for
+ * writing, at the points where a thread group leader enters or leaves the
+ * process list.
+ */
+void oom_adj_bucket_add(struct task_struct *p)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&oom_adj_bucket_lock, flags);
+	hlist_add_head(&p->oom_adj_node, oom_adj_bucket(p));
+	spin_unlock_irqrestore(&oom_adj_bucket_lock, flags);
+}
+
+void oom_adj_bucket_del(struct task_struct *p)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&oom_adj_bucket_lock, flags);
+	hlist_del_init(&p->oom_adj_node);
+	spin_unlock_irqrestore(&oom_adj_bucket_lock, flags);
+}
+
+void oom_adj_bucket_replace(struct task_struct *old, struct task_struct *new)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&oom_adj_bucket_lock, flags);
+	if (!hlist_unhashed(&old->oom_adj_node)) {
+		hlist_del_init(&old->oom_adj_node);
+		hlist_add_head(&new->oom_adj_node, oom_adj_bucket(new));
+	}
+	spin_unlock_irqrestore(&oom_adj_bucket_lock, flags);
+}
+
+/**
+ * oom_adj_bucket_update - refile a process after its oom_adj changed
+ * @p:	any thread of the process
+ *
+ * Called after signal->oom_adj was written, without any locks held. The
+ * value is re-read under the bucket lock, so racing updates settle on
+ * the last value written; tasklist_lock keeps exec from changing the
+ * group leader under us.
+ */
+void oom_adj_bucket_update(struct task_struct *p)
+{
+	struct task_struct *leader;
+	unsigned long flags;
+
+	read_lock(&tasklist_lock);
+	spin_lock_irqsave(&oom_adj_bucket_lock, flags);
+	leader = p->group_leader;
+	/* an unhashed node means the process is already gone */
+	if (!hlist_unhashed(&leader->oom_adj_node)) {
+		hlist_del(&leader->oom_adj_node);
+		hlist_add_head(&leader->oom_adj_node, oom_adj_bucket(leader));
+	}
+	spin_unlock_irqrestore(&oom_adj_bucket_lock, flags);
+	read_unlock(&tasklist_lock);
+}
+#endif
+
 /**
  * test_set_oom_score_adj() - set current's oom_score_adj and return old value
  * @new_val: new oom_score_adj value
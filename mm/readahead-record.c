@@ -0,0 +1,345 @@
+/*
+ * mm/readahead-record.c
+ *
+ * Recording of page cache misses and replaying them as readahead.
+ *
+ * Boot and the first launch of an app fault in the same scattered file
+ * ranges every time, each of them a small synchronous read.  Writing a
+ * process group id to /sys/kernel/mm/readahead_record/pgid (0 for all
+ * tasks) starts recording where its tasks miss the page cache, writing
+ * -1 stops it.  The misses can then be read from "trace" as an array of
+ * struct readahead_record, with misses that extend an earlier one of
+ * the same file folded into it.
+ *
+ * Userspace keeps the trace, maps dev and ino back to files, and next
+ * time writes "<fd> <index> <nr_pages>" lines for files it has opened to
+ * "replay".  The extents of each write are sorted by fd and index and
+ * merged across small gaps, so that the replay reads ahead few and large
+ * extents in the order the files were opened.
+ */
+
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/kobject.h>
+#include <linux/sysfs.h>
+#include <linux/file.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/sched.h>
+#include <linux/mutex.h>
+#include <linux/pagemap.h>
+#include <linux/vmalloc.h>
+#include <linux/readahead_record.h>
+
+#define RECORD_ENTRIES		16384
+/* How many of the latest entries a miss may be folded into */
+#define RECORD_MERGE_WINDOW	8
+/* Holes up to this many pages are read along when replaying */
+#define REPLAY_MERGE_GAP	8
+
+bool readahead_recording __read_mostly;
+
+static DEFINE_MUTEX(record_mutex);	/* serialises start and stop */
+static DEFINE_SPINLOCK(record_lock);	/* protects the entries */
+static struct readahead_record *record_buf;
+static unsigned int record_nr;
+static unsigned long record_dropped;
+static pid_t record_pgid = -1;
+
+static bool record_fold(struct readahead_record *rec, u32 dev, u64 ino,
+			pgoff_t index, pgoff_t end)
+{
+	if (rec->dev != dev || rec->ino != ino ||
+	    index < rec->index || index > rec->index + rec->nr_pages)
+		return false;
+
+	if (end > rec->index + rec->nr_pages)
+		rec->nr_pages = end - rec->index;
+	return true;
+}
+
+void __readahead_record_miss(struct address_space *mapping, pgoff_t index,
+			     unsigned long nr_pages)
+{
+	struct inode *inode = mapping->host;
+	u32 dev = new_encode_dev(inode->i_sb->s_dev);
+	pid_t pgid = record_pgid;
+	pgoff_t end, eof;
+	unsigned int i;
+
+	if (pgid < 0 || (pgid && task_pgrp_nr(current) != pgid))
+		return;
+	if (!S_ISREG(inode->i_mode))
+		return;
+
+	/* A large read only misses up to the end of the file */
+	eof = (i_size_read(inode) + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT;
+	end = min(index + max(nr_pages, 1UL), eof);
+	if (index >= end)
+		return;
+
+	spin_lock(&record_lock);
+	if (!readahead_recording)
+		goto out;
+
+	for (i = record_nr; i > 0 && record_nr - i < RECORD_MERGE_WINDOW; i--)
+		if (record_fold(&record_buf[i - 1], dev, inode->i_ino,
+				index, end))
+			goto out;
+
+	if (record_nr == RECORD_ENTRIES) {
+		record_dropped++;
+		goto out;
+	}
+	record_buf[record_nr].dev = dev;
+	record_buf[record_nr].ino = inode->i_ino;
+	record_buf[record_nr].index = index;
+	record_buf[record_nr].nr_pages = end - index;
+	record_nr++;
+ out:
+	spin_unlock(&record_lock);
+}
+
+static int record_start(pid_t pgid)
+{
+	if (!record_buf) {
+		record_buf = vmalloc(RECORD_ENTRIES * sizeof(*record_buf));
+		if (!record_buf)
+			return -ENOMEM;
+	}
+
+	spin_lock(&record_lock);
+	record_nr = 0;
+	record_dropped = 0;
+	record_pgid = pgid;
+	readahead_recording = true;
+	spin_unlock(&record_lock);
+
+	return 0;
+}
+
+static void record_stop(void)
+{
+	spin_lock(&record_lock);
+	readahead_recording = false;
+	record_pgid = -1;
+	spin_unlock(&record_lock);
+}
+
+struct replay_extent {
+	int fd;
+	pgoff_t index;
+	unsigned long nr_pages;
+};
+
+static int replay_cmp(const void *a, const void *b)
+{
+	const struct replay_extent *l = a, *r = b;
+
+	if (l->fd != r->fd)
+		return l->fd < r->fd ? -1 : 1;
+	if (l->index != r->index)
+		return l->index < r->index ? -1 : 1;
+	return 0;
+}
+
+/* Sorts and merges the @nr extents in place, returns how many are left */
+static int replay_merge(struct replay_extent *ext, int nr)
+{
+	int i, n = 0;
+
+	sort(ext, nr, sizeof(*ext), replay_cmp, NULL);
+
+	for (i = 1; i < nr; i++) {
+		struct replay_extent *last = &ext[n];
+		pgoff_t end = last->index + last->nr_pages;
+
+		if (ext[i].fd == last->fd &&
+		    ext[i].index <= end + REPLAY_MERGE_GAP) {
+			if (ext[i].index + ext[i].nr_pages > end)
+				last->nr_pages = ext[i].index +
+						 ext[i].nr_pages - last->index;
+			continue;
+		}
+		ext[++n] = ext[i];
+	}
+
+	return nr ? n + 1 : 0;
+}
+
+static int replay_issue(struct replay_extent *ext, int nr)
+{
+	struct file *file = NULL;
+	int i, ret = 0;
+
+	for (i = 0; i < nr; i++) {
+		if (i == 0 || ext[i].fd != ext[i - 1].fd) {
+			if (file)
+				fput(file);
+			file = fget(ext[i].fd);
+			if (!file)
+				return -EBADF;
+			if (!(file->f_mode & FMODE_READ)) {
+				ret = -EBADF;
+				break;
+			}
+		}
+
+		ret = force_page_cache_readahead(file->f_mapping, file,
+						 ext[i].index, ext[i].nr_pages);
+		if (ret < 0)
+			break;
+		ret = 0;
+	}
+	if (file)
+		fput(file);
+
+	return ret;
+}
+
+static ssize_t pgid_show(struct kobject *kobj, struct kobj_attribute *attr,
+			 char *buf)
+{
+	return sprintf(buf, "%d\n", record_pgid);
+}
+
+static ssize_t pgid_store(struct kobject *kobj, struct kobj_attribute *attr,
+			  const char *buf, size_t count)
+{
+	long pgid;
+	int err;
+
+	err = strict_strtol(buf, 10, &pgid);
+	if (err || pgid < -1 || pgid > PID_MAX_LIMIT)
+		return -EINVAL;
+
+	mutex_lock(&record_mutex);
+	if (pgid < 0)
+		record_stop();
+	else
+		err = record_start(pgid);
+	mutex_unlock(&record_mutex);
+
+	return err ? err : count;
+}
+static struct kobj_attribute pgid_attr =
+	__ATTR(pgid, 0644, pgid_show, pgid_store);
+
+static ssize_t stat_show(struct kobject *kobj, struct kobj_attribute *attr,
+			 char *buf)
+{
+	unsigned int nr;
+	unsigned long dropped;
+
+	spin_lock(&record_lock);
+	nr = record_nr;
+	dropped = record_dropped;
+	spin_unlock(&record_lock);
+
+	return sprintf(buf, "%u %lu\n", nr, dropped);
+}
+static struct kobj_attribute stat_attr = __ATTR_RO(stat);
+
+static ssize_t replay_store(struct kobject *kobj, struct kobj_attribute *attr,
+			    const char *buf, size_t count)
+{
+	struct replay_extent *ext;
+	char *copy, *line, *p;
+	int nr = 0, max, err;
+
+	copy = kstrndup(buf, count, GFP_KERNEL);
+	if (!copy)
+		return -ENOMEM;
+
+	/* Each line takes at least six characters */
+	max = count / 6 + 1;
+	ext = kmalloc(max * sizeof(*ext), GFP_KERNEL);
+	if (!ext) {
+		kfree(copy);
+		return -ENOMEM;
+	}
+
+	p = copy;
+	while ((line = strsep(&p, "\n")) != NULL) {
+		unsigned long index, nr_pages;
+		int fd;
+
+		line = strim(line);
+		if (!*line)
+			continue;
+		err = -EINVAL;
+		if (nr == max ||
+		    sscanf(line, "%d %lu %lu", &fd, &index, &nr_pages) != 3 ||
+		    fd < 0 || !nr_pages || index + nr_pages < index)
+			goto out;
+		ext[nr].fd = fd;
+		ext[nr].index = index;
+		ext[nr].nr_pages = nr_pages;
+		nr++;
+	}
+
+	nr = replay_merge(ext, nr);
+	err = replay_issue(ext, nr);
+ out:
+	kfree(ext);
+	kfree(copy);
+	return err ? err : count;
+}
+static struct kobj_attribute replay_attr = __ATTR(replay, 0200, NULL,
+						   replay_store);
+
+static ssize_t trace_read(struct file *filp, struct kobject *kobj,
+			  struct bin_attribute *attr, char *buf,
+			  loff_t off, size_t count)
+{
+	size_t size;
+
+	spin_lock(&record_lock);
+	size = record_nr * sizeof(*record_buf);
+	if (off >= size)
+		count = 0;
+	else if (count > size - off)
+		count = size - off;
+	if (count)
+		memcpy(buf, (char *)record_buf + off, count);
+	spin_unlock(&record_lock);
+
+	return count;
+}
+static struct bin_attribute trace_attr = {
+	.attr	= { .name = "trace", .mode = 0400 },
+	.read	= trace_read,
+};
+
+static struct attribute *readahead_record_attrs[] = {
+	&pgid_attr.attr,
+	&stat_attr.attr,
+	&replay_attr.attr,
+	NULL,
+};
+
+static struct attribute_group readahead_record_attr_group = {
+	.attrs = readahead_record_attrs,
+};
+
+static int __init readahead_record_init(void)
+{
+	struct kobject *kobj;
+	int err;
+
+	kobj = kobject_create_and_add("readahead_record", mm_kobj);
+	if (!kobj) {
+		printk(KERN_ERR "readahead_record: failed to create kobject\n");
+		return -ENOMEM;
+	}
+
+	err = sysfs_create_group(kobj, &readahead_record_attr_group);
+	if (!err)
+		err = sysfs_create_bin_file(kobj, &trace_attr);
+	if (err) {
+		printk(KERN_ERR "readahead_record: failed to register sysfs\n");
+		kobject_put(kobj);
+	}
+	return err;
+}
+module_init(readahead_record_init)
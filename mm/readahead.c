@@ -150,7 +150,7 @@ out:
 static int
 __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 			pgoff_t offset, unsigned long nr_to_read,
-			unsigned long lookahead_size)
+			unsigned long lookahead_size, bool speculative)
 {
 	struct inode *inode = mapping->host;
 	struct page *page;
@@ -187,6 +187,8 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 		list_add(&page->lru, &page_pool);
 		if (page_idx == nr_to_read - lookahead_size)
 			SetPageReadahead(page);
+		if (speculative)
+			SetPageReadaheadUnused(page);
 		ret++;
 	}
 
@@ -223,7 +225,7 @@ int force_page_cache_readahead(struct address_space *mapping, struct file *filp,
 		if (this_chunk > nr_to_read)
 			this_chunk = nr_to_read;
 		err = __do_page_cache_readahead(mapping, filp,
-						offset, this_chunk, 0);
+						offset, this_chunk, 0, false);
 		if (err < 0) {
 			ret = err;
 			break;
@@ -245,6 +247,102 @@ unsigned long max_sane_readahead(unsigned long nr)
 		+ node_page_state(numa_node_id(), NR_FREE_PAGES)) / 2);
 }
 
+#ifdef CONFIG_ADAPTIVE_READAHEAD
+/*
+ * Adaptive readahead.
+ *
+ * Pages read in by ra_submit() carry PG_readahead_unused until a reader
+ * finds them in the page cache, see readahead_page_used(), or they are
+ * dropped from it unused.  Each file_ra_state counts the pages it read
+ * ahead and how many of those got used.  Once RA_ADAPT_SAMPLE of them
+ * are settled, the maximum window of the file is halved if less than a
+ * quarter was used, or doubled if nearly all of it was, within
+ * ra_pages >> -RA_SCALE_MIN and ra_pages << RA_SCALE_MAX.
+ */
+#define RA_ADAPT_SAMPLE		64
+#define RA_SCALE_MIN		(-3)
+#define RA_SCALE_MAX		2
+#define RA_MIN_PAGES		4
+
+static unsigned long ra_max_pages(struct file_ra_state *ra)
+{
+	unsigned long max = ra->ra_pages;
+
+	if (ra->scale >= 0)
+		return max << ra->scale;
+
+	return max_t(unsigned long, max >> -ra->scale,
+		     min_t(unsigned long, max, RA_MIN_PAGES));
+}
+
+/*
+ * Called before a new window replaces the one in @ra, most of which may
+ * still be used; only the pages read ahead before it count as settled.
+ */
+static void ra_adapt(struct file_ra_state *ra)
+{
+	unsigned int settled, used;
+
+	if (ra->nr_issued < ra->size + RA_ADAPT_SAMPLE)
+		return;
+
+	settled = ra->nr_issued - ra->size;
+	used = min(ra->nr_used, settled);
+
+	if (used < settled / 4) {
+		if (ra->scale > RA_SCALE_MIN)
+			ra->scale--;
+	} else if (used >= settled - settled / 16) {
+		if (ra->scale < RA_SCALE_MAX)
+			ra->scale++;
+	}
+
+	ra->nr_issued -= settled;
+	ra->nr_used -= used;
+}
+
+static void ra_account(struct file_ra_state *ra,
+		       struct address_space *mapping, int nr_pages)
+{
+	ra->nr_issued += nr_pages;
+	__add_bdi_stat(mapping->backing_dev_info, BDI_READAHEAD, nr_pages);
+}
+
+void __readahead_page_used(struct address_space *mapping,
+			   struct file_ra_state *ra, struct page *page)
+{
+	if (TestClearPageReadaheadUnused(page)) {
+		ra->nr_used++;
+		__inc_bdi_stat(mapping->backing_dev_info, BDI_READAHEAD_USED);
+	}
+}
+EXPORT_SYMBOL_GPL(__readahead_page_used);
+
+/*
+ * @page is leaving the page cache of @mapping, called under
+ * mapping->tree_lock with interrupts off.
+ */
+void readahead_page_evicted(struct address_space *mapping, struct page *page)
+{
+	if (TestClearPageReadaheadUnused(page))
+		__inc_bdi_stat(mapping->backing_dev_info, BDI_READAHEAD_UNUSED);
+}
+#else
+static inline unsigned long ra_max_pages(struct file_ra_state *ra)
+{
+	return ra->ra_pages;
+}
+
+static inline void ra_adapt(struct file_ra_state *ra)
+{
+}
+
+static inline void ra_account(struct file_ra_state *ra,
+			      struct address_space *mapping, int nr_pages)
+{
+}
+#endif /* CONFIG_ADAPTIVE_READAHEAD */
+
 /*
  * Submit IO for the read-ahead request in file_ra_state.
  */
@@ -253,12 +351,23 @@ unsigned long ra_submit(struct file_ra_state *ra,
 {
 	int actual;
 
-	actual = __do_page_cache_readahead(mapping, filp,
-					ra->start, ra->size, ra->async_size);
+	actual = __do_page_cache_readahead(mapping, filp, ra->start,
+					   ra->size, ra->async_size, true);
+	ra_account(ra, mapping, actual);
 
 	return actual;
 }
 
+/*
+ * Largest window for mmap read-around, adapted like ondemand_readahead()
+ * adapts its own.
+ */
+unsigned long ra_mmap_pages(struct file_ra_state *ra)
+{
+	ra_adapt(ra);
+	return max_sane_readahead(ra_max_pages(ra));
+}
+
 /*
  * Set the initial window size, round to next power of 2 and square
  * for small size, x 4 for medium, and x 2 for large
@@ -398,7 +507,10 @@ ondemand_readahead(struct address_space *mapping,
 		   bool hit_readahead_marker, pgoff_t offset,
 		   unsigned long req_size)
 {
-	unsigned long max = max_sane_readahead(ra->ra_pages);
+	unsigned long max;
+
+	ra_adapt(ra);
+	max = max_sane_readahead(ra_max_pages(ra));
 
 	/*
 	 * start of file
@@ -465,7 +577,8 @@ ondemand_readahead(struct address_space *mapping,
 	 * standalone, small random read
 	 * Read as is, and do not pollute the readahead state.
 	 */
-	return __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
+	return __do_page_cache_readahead(mapping, filp, offset, req_size, 0,
+					 false);
 
 initial_readahead:
 	ra->start = offset;
@@ -0,0 +1,108 @@
+/*
+ * linux/mm/vmpressure.c
+ *
+ * Global reclaim pressure notifications.
+ *
+ * Reclaim reports how many pages it scanned and how many of those it
+ * managed to free. Once a window's worth of pages has been scanned the
+ * ratio is turned into a pressure level and handed to the listeners from
+ * a work item, so they never run inside the reclaim path itself.
+ *
+ * This file is released under the GPLv2.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/spinlock.h>
+#include <linux/swap.h>
+#include <linux/vmpressure.h>
+#include <linux/workqueue.h>
+
+/*
+ * 512 pages, 2MB with 4K pages: small enough to react before kswapd has
+ * burnt through the page cache, large enough to average out the noise
+ * of individual shrink_list() batches.
+ */
+static const unsigned long vmpressure_win = SWAP_CLUSTER_MAX * 16;
+
+static DEFINE_SPINLOCK(vmpressure_lock);
+static unsigned long vmpressure_scanned;
+static unsigned long vmpressure_reclaimed;
+
+static BLOCKING_NOTIFIER_HEAD(vmpressure_notifier);
+
+static unsigned long vmpressure_calc_level(unsigned long scanned,
+					   unsigned long reclaimed)
+{
+	/* reclaim can free more than it scanned, e.g. via compound pages */
+	if (reclaimed >= scanned)
+		return 0;
+
+	return (scanned - reclaimed) * 100 / scanned;
+}
+
+static void vmpressure_work_fn(struct work_struct *work)
+{
+	unsigned long scanned, reclaimed;
+
+	spin_lock(&vmpressure_lock);
+	scanned = vmpressure_scanned;
+	reclaimed = vmpressure_reclaimed;
+	vmpressure_scanned = 0;
+	vmpressure_reclaimed = 0;
+	spin_unlock(&vmpressure_lock);
+
+	if (!scanned)
+		return;
+
+	blocking_notifier_call_chain(&vmpressure_notifier,
+				     vmpressure_calc_level(scanned, reclaimed),
+				     NULL);
+}
+
+static DECLARE_WORK(vmpressure_work, vmpressure_work_fn);
+
+/**
+ * vmpressure - account reclaim efficiency
+ * @gfp:	reclaimer's gfp mask
+ * @scanned:	number of pages scanned
+ * @reclaimed:	number of pages reclaimed
+ *
+ * Called from global reclaim, may be called with fs or io locks held.
+ */
+void vmpressure(gfp_t gfp, unsigned long scanned, unsigned long reclaimed)
+{
+	/*
+	 * Only page cache and anonymous user memory tell us anything about
+	 * how tight memory is; reclaim for other allocations is too
+	 * constrained to be representative.
+	 */
+	if (!(gfp & (__GFP_HIGHMEM | __GFP_MOVABLE | __GFP_IO | __GFP_FS)))
+		return;
+
+	if (!scanned)
+		return;
+
+	spin_lock(&vmpressure_lock);
+	vmpressure_scanned += scanned;
+	vmpressure_reclaimed += reclaimed;
+	scanned = vmpressure_scanned;
+	spin_unlock(&vmpressure_lock);
+
+	if (scanned < vmpressure_win)
+		return;
+
+	schedule_work(&vmpressure_work);
+}
+
+int vmpressure_notifier_register(struct notifier_block *nb)
+{
+	return blocking_notifier_chain_register(&vmpressure_notifier, nb);
+}
+EXPORT_SYMBOL_GPL(vmpressure_notifier_register);
+
+int vmpressure_notifier_unregister(struct notifier_block *nb)
+{
+	return blocking_notifier_chain_unregister(&vmpressure_notifier, nb);
+}
+EXPORT_SYMBOL_GPL(vmpressure_notifier_unregister);
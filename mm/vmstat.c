@@ -769,6 +769,11 @@ const char * const vmstat_text[] = {
 	"compact_stall",
 	"compact_fail",
 	"compact_success",
+	"compact_pages_moved_direct",
+	"compact_blocks_moved_kcompactd",
+	"compact_pages_moved_kcompactd",
+	"kcompactd_wake",
+	"kcompactd_backoff",
 #endif
 
 #ifdef CONFIG_HUGETLB_PAGE